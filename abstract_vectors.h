@@ -0,0 +1,171 @@
+/*----------------------------------------------------------------------------
+ * abstract_vectors.h - Simple, typesafe, growable arrays for C
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------
+ * Companion to abstract_lists.h. Elements are stored by value in a single
+ * contiguous block, so appending does not allocate per element and walking
+ * the vector does not chase pointers.
+ *
+ * Elements live at indices head .. tail - 1. Pushing and popping from the
+ * back never move an element to a different index. Shifting from the front
+ * does not either, until more than half of the block lies unused in front
+ * of head. Then the elements are moved to the start, so a vector used as a
+ * queue does not grow without bound. Pointers returned by the vector are
+ * only valid until the next push or shift, since both may move elements.
+ * Once a vector runs empty, head and tail are reset to 0.
+ *
+ * Example:
+ *   STATIC_VECTOR(event, event_t)
+ *   event_vec_t *v = event_vec_new();
+ *   event_t *e = event_vec_append(v);
+ *   for (i = v->head; i < v->tail; i++)
+ *       e = event_vec_get(v, i);
+ *   event_vec_destroy(v);
+ *----------------------------------------------------------------------------*/
+
+#ifndef ABSTRACT_VECTORS_H
+#define ABSTRACT_VECTORS_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define VECTOR_MIN_SIZE 16
+
+#define DECLARE_VECTOR_BACKEND(kind, prefix, type) \
+typedef struct prefix##_vec_s prefix##_vec_t;\
+struct prefix##_vec_s\
+{\
+	type *items;\
+	int head, tail, size;\
+};\
+kind prefix##_vec_t *prefix##_vec_new () __attribute__ ((unused));\
+kind void prefix##_vec_reserve (prefix##_vec_t *v, int size) __attribute__ ((unused));\
+kind type *prefix##_vec_append (prefix##_vec_t *v) __attribute__ ((unused));\
+kind type *prefix##_vec_push (prefix##_vec_t *v, type e) __attribute__ ((unused));\
+kind int prefix##_vec_pop (prefix##_vec_t *v, type *e) __attribute__ ((unused));\
+kind int prefix##_vec_shift (prefix##_vec_t *v, type *e) __attribute__ ((unused));\
+kind type *prefix##_vec_get (prefix##_vec_t *v, int i) __attribute__ ((unused));\
+kind type *prefix##_vec_first (prefix##_vec_t *v) __attribute__ ((unused));\
+kind type *prefix##_vec_last (prefix##_vec_t *v) __attribute__ ((unused));\
+kind int prefix##_vec_len (prefix##_vec_t *v) __attribute__ ((unused));\
+kind int prefix##_vec_empty (prefix##_vec_t *v) __attribute__ ((unused));\
+kind void prefix##_vec_clear (prefix##_vec_t *v) __attribute__ ((unused));\
+kind void prefix##_vec_destroy (prefix##_vec_t *v) __attribute__ ((unused));
+
+#define IMPLEMENT_VECTOR_BACKEND(kind, prefix, type) \
+kind prefix##_vec_t *prefix##_vec_new ()\
+{\
+	prefix##_vec_t *v = malloc(sizeof(prefix##_vec_t));\
+	v->items = NULL;\
+	v->head = 0;\
+	v->tail = 0;\
+	v->size = 0;\
+	return v;\
+}\
+kind void prefix##_vec_reserve (prefix##_vec_t *v, int size)\
+{\
+	type *items;\
+	if (size <= v->size)\
+		return;\
+	if ((items = realloc(v->items, size * sizeof(type))) == NULL)\
+	{\
+		fprintf(stderr, "Cannot grow vector to %d elements.\n", size);\
+		exit(1);\
+	}\
+	v->items = items;\
+	v->size = size;\
+}\
+kind type *prefix##_vec_append (prefix##_vec_t *v)\
+{\
+	if (v->tail == v->size)\
+		prefix##_vec_reserve(v, v->size < VECTOR_MIN_SIZE ? VECTOR_MIN_SIZE : 2 * v->size);\
+	memset(&(v->items[v->tail]), 0, sizeof(type));\
+	return &(v->items[v->tail++]);\
+}\
+kind type *prefix##_vec_push (prefix##_vec_t *v, type e)\
+{\
+	type *n = prefix##_vec_append(v);\
+	*n = e;\
+	return n;\
+}\
+kind int prefix##_vec_pop (prefix##_vec_t *v, type *e)\
+{\
+	if (v->head == v->tail)\
+		return 0;\
+	v->tail--;\
+	if (e != NULL)\
+		*e = v->items[v->tail];\
+	if (v->head == v->tail)\
+		v->head = v->tail = 0;\
+	return 1;\
+}\
+kind int prefix##_vec_shift (prefix##_vec_t *v, type *e)\
+{\
+	if (v->head == v->tail)\
+		return 0;\
+	if (e != NULL)\
+		*e = v->items[v->head];\
+	v->head++;\
+	if (v->head == v->tail)\
+		v->head = v->tail = 0;\
+	else if (v->head > v->size / 2)\
+	{\
+		memmove(v->items, v->items + v->head, (v->tail - v->head) * sizeof(type));\
+		v->tail -= v->head;\
+		v->head = 0;\
+	}\
+	return 1;\
+}\
+kind type *prefix##_vec_get (prefix##_vec_t *v, int i)\
+{\
+	if (i < v->head || i >= v->tail)\
+		return NULL;\
+	return &(v->items[i]);\
+}\
+kind type *prefix##_vec_first (prefix##_vec_t *v)\
+{\
+	return prefix##_vec_get(v, v->head);\
+}\
+kind type *prefix##_vec_last (prefix##_vec_t *v)\
+{\
+	return prefix##_vec_get(v, v->tail - 1);\
+}\
+kind int prefix##_vec_len (prefix##_vec_t *v)\
+{\
+	return v->tail - v->head;\
+}\
+kind int prefix##_vec_empty (prefix##_vec_t *v)\
+{\
+	return v->head == v->tail;\
+}\
+kind void prefix##_vec_clear (prefix##_vec_t *v)\
+{\
+	v->head = 0;\
+	v->tail = 0;\
+}\
+kind void prefix##_vec_destroy (prefix##_vec_t *v)\
+{\
+	free(v->items);\
+	free(v);\
+}
+
+#define DECLARE_VECTOR(prefix, type) DECLARE_VECTOR_BACKEND(;, prefix, type)
+#define IMPLEMENT_VECTOR(prefix, type) IMPLEMENT_VECTOR_BACKEND(;, prefix, type)
+#define DECLARE_STATIC_VECTOR(prefix, type) DECLARE_VECTOR_BACKEND(static, prefix, type)
+#define IMPLEMENT_STATIC_VECTOR(prefix, type) IMPLEMENT_VECTOR_BACKEND(static, prefix, type)
+#define STATIC_VECTOR(prefix, type) DECLARE_STATIC_VECTOR(prefix, type) IMPLEMENT_STATIC_VECTOR(prefix, type)
+
+#endif
@@ -20,45 +20,154 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <math.h>
 #include "ass.h"
-#include "abstract_lists.h"
+#include "auto_split.h"
+#include "abstract_vectors.h"
 
 #ifndef DEBUG
 #define DEBUG 0
 #endif
 
-void parse_ass(char *filename)
+/* Frames added before and after each event, in case the renderer rounds
+ * differently
+ */
+#define ASS_MARGIN 1
+
+STATIC_VECTOR(asi, ass_sub_info_t)
+
+static int compare_start (const void *a, const void *b)
+{
+    return ((ass_sub_info_t *)a)->start - ((ass_sub_info_t *)b)->start;
+}
+
+ass_reader_t *new_ass_reader(int fps_num, int fps_den)
+{
+    ass_reader_t *ar = calloc(1, sizeof(ass_reader_t));
+
+    ar->ms_fac = ((double)fps_num) / (1000.0 * fps_den);
+    ar->events = asi_vec_new();
+    ar->intervals = asi_vec_new();
+
+    return ar;
+}
+
+void ass_reader_add(ass_reader_t *ar, long long start_ms, long long end_ms, int forced)
+{
+    ass_sub_info_t *e = asi_vec_append(ar->events);
+
+    e->start = MAX((int)floor(start_ms * ar->ms_fac) - ASS_MARGIN, 0);
+    e->end = (int)ceil(end_ms * ar->ms_fac) + ASS_MARGIN;
+    e->forced = forced;
+    if (e->end <= e->start)
+        asi_vec_pop(ar->events, NULL);
+}
+
+void ass_reader_finish(ass_reader_t *ar)
+{
+    ass_sub_info_t *e, *last = NULL;
+    int n = asi_vec_len(ar->events), i, forced_end = 0;
+
+    /* Merge overlapping and adjacent events into intervals */
+    qsort(ar->events->items, n, sizeof(ass_sub_info_t), compare_start);
+    for (i = 0; i < n; i++)
+    {
+        e = asi_vec_get(ar->events, i);
+        if (e->forced)
+            forced_end = MAX(forced_end, e->end);
+        e->forced_end = forced_end;
+        if (last != NULL && e->start <= last->end)
+            last->end = MAX(last->end, e->end);
+        else
+        {
+            last = asi_vec_push(ar->intervals, *e);
+            last->forced = 0;
+        }
+    }
+}
+
+int ass_reader_frames(ass_reader_t *ar)
+{
+    ass_sub_info_t *iv = asi_vec_last(ar->intervals);
+
+    return iv == NULL ? 0 : iv->end + 1;
+}
+
+ass_reader_t *parse_ass(char *filename, int fps_num, int fps_den)
 {
     char l[BUFSIZ];
     char p[128];
     int start[4], end[4];
+    ass_reader_t *ar;
     FILE *fh;
 
     if ((fh = fopen(filename, "r")) == NULL)
 	{
 		perror("Error opening input ASS file");
-		exit(1);
+		return NULL;
 	}
 
+    ar = new_ass_reader(fps_num, fps_den);
+
     int i = 0;
     while (fgets(l, BUFSIZ - 1, fh) != NULL) {
         i++;
         if (l[0] == 0 || l[0] == '\n' || l[0] == '\r')
             continue;
-        size_t x = sscanf(l, "Dialogue: %*d,%d:%02d:%02d.%02d,%d:%02d:%02d.%02d,%s[127]", &start[0], &start[1], &start[2], &start[3], &end[0], &end[1], &end[2], &end[3], p);
+        size_t x = sscanf(l, "Dialogue: %*d,%d:%02d:%02d.%02d,%d:%02d:%02d.%02d,%127s", &start[0], &start[1], &start[2], &start[3], &end[0], &end[1], &end[2], &end[3], p);
         if (x == 9) {
             char *subchar_start = strstr(p, ",");
             if (subchar_start == NULL) {
-                printf("Error while parsing ASS in line %d - no ',' found after end timestamp.", i);
-                exit(1);
+                fprintf(stderr, "Error while parsing ASS in line %d - no ',' found after end timestamp.\n", i);
+                fclose(fh);
+                close_ass_reader(ar);
+                return NULL;
             }
             subchar_start++;
-            if (subchar_start[0] == '!') {
-                printf("%d forced!\n", i);
-            }
+
+            /* Times are in centiseconds */
+            ass_reader_add(ar, 10LL * (((start[0] * 60 + start[1]) * 60 + start[2]) * 100 + start[3]),
+                               10LL * (((end[0] * 60 + end[1]) * 60 + end[2]) * 100 + end[3]),
+                               subchar_start[0] == '!');
         }
     }
 
     fclose(fh);
+    ass_reader_finish(ar);
+
+    return ar;
+}
+
+int ass_next_visible(ass_reader_t *ar, int frame)
+{
+    ass_sub_info_t *iv;
+
+    while ((iv = asi_vec_get(ar->intervals, ar->cur_interval)) != NULL && iv->end <= frame)
+        ar->cur_interval++;
+
+    if (iv == NULL)
+        return INT_MAX;
+
+    return MAX(frame, iv->start);
+}
+
+int ass_forced_at(ass_reader_t *ar, int frame)
+{
+    ass_sub_info_t *e;
+
+    while ((e = asi_vec_get(ar->events, ar->cur_event)) != NULL && e->start <= frame)
+        ar->cur_event++;
+
+    /* A forced event started so far has not ended yet */
+    e = asi_vec_get(ar->events, ar->cur_event - 1);
+
+    return e != NULL && e->forced_end > frame;
+}
+
+void close_ass_reader(ass_reader_t *ar)
+{
+    asi_vec_destroy(ar->events);
+    asi_vec_destroy(ar->intervals);
+    free(ar);
 }
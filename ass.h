@@ -16,29 +16,51 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *----------------------------------------------------------------------------*/
 
-#ifndef SUP_H
-#define SUP_H
-
-#include "abstract_lists.h"
+#ifndef ASS_H
+#define ASS_H
 
+/* Frames, end is exclusive */
 typedef struct ass_sub_info_s
 {
 	int start;
 	int end;
     int forced;
+	int forced_end;  /* Latest end of forced events sorted up to this one */
 } ass_sub_info_t;
 
+struct asi_vec_s;
 
-DECLARE_LIST(asi, ass_sub_info_t)
-
+/* Timing of the Dialogue lines of an ASS file. Frames outside of the
+ * merged intervals cannot show any subtitle, so they need not be read.
+ */
 typedef struct ass_reader_s
 {
-	FILE *fh;
-	asi_list_t *asil;
+	double ms_fac;               /* Frames per millisecond */
+	struct asi_vec_s *events;    /* Sorted by start */
+	struct asi_vec_s *intervals; /* Overlapping events merged */
+	int cur_interval;            /* First interval not over yet */
+	int cur_event;               /* First event starting after the last query */
 } ass_reader_t;
 
+/* Returns NULL and prints the reason on failure */
+ass_reader_t *parse_ass (char *filename, int fps_num, int fps_den);
 
-void parse_ass(char *filename);
+/* For events from elsewhere: add all events, then call ass_reader_finish */
+ass_reader_t *new_ass_reader (int fps_num, int fps_den);
+void ass_reader_add (ass_reader_t *ar, long long start_ms, long long end_ms, int forced);
+void ass_reader_finish (ass_reader_t *ar);
 
-#endif
+/* One past the last frame that may show a subtitle */
+int ass_reader_frames (ass_reader_t *ar);
+
+/* First frame from frame on that may show a subtitle, or INT_MAX. Frames
+ * must be queried in increasing order.
+ */
+int ass_next_visible (ass_reader_t *ar, int frame);
 
+/* Whether an event shown at frame is marked forced with '!' */
+int ass_forced_at (ass_reader_t *ar, int frame);
+
+void close_ass_reader (ass_reader_t *ar);
+
+#endif
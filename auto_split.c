@@ -20,7 +20,7 @@
 #include <string.h>
 #include <limits.h>
 #include "auto_split.h"
-#include "abstract_lists.h"
+#include "abstract_vectors.h"
 #include "sort.h"
 
 /* Transparent pixels are assumed to be set to zero */
@@ -370,7 +370,7 @@ typedef struct interval_s
 	int start, end;
 } interval_t;
 
-STATIC_LIST(interval, interval_t)
+STATIC_VECTOR(interval, interval_t)
 
 int cmp_rect_x (rect_t *a, rect_t *b)
 {
@@ -402,7 +402,7 @@ int find_windows (rect_t *rects, int n_rects, rect_t *windows)
 	void *work[2][2]    = { {rect_bounds_x, cmp_rect_x}
 	                      , {rect_bounds_y, cmp_rect_y}
 	                      };
-	interval_list_t *segs;
+	interval_vec_t *segs = interval_vec_new();
 	interval_t *iv = NULL;
 	window_t *fwd, *bwd;
 	rect_t best[2], tmp;
@@ -411,6 +411,7 @@ int find_windows (rect_t *rects, int n_rects, rect_t *windows)
 
 	if (!n_rects)
 	{
+		interval_vec_destroy(segs);
 		free(sorted);
 		return 0;
 	}
@@ -426,7 +427,7 @@ int find_windows (rect_t *rects, int n_rects, rect_t *windows)
 		sort((sort_func_t)work[dir][1], (void **)sorted, n_rects);
 
 		/* Group overlapping rectangles. */
-		segs  = interval_list_new();
+		interval_vec_clear(segs);
 		n_ivs = 0;
 		edge  = -1;
 
@@ -436,58 +437,51 @@ int find_windows (rect_t *rects, int n_rects, rect_t *windows)
 			rect_bounds(sorted[i], &a, &b);
 			if (a < edge)
 			{
+				iv      = interval_vec_last(segs);
 				iv->end = MAX(iv->end, a + b);
 				iv->r   = merge_rects(iv->r, *(sorted[i]));
 				edge    = iv->end;
 			}
 			else
 			{
-				iv = malloc(sizeof(interval_t));
+				iv = interval_vec_append(segs);
 				iv->start = a;
 				iv->end   = a + b;
 				iv->r     = *(sorted[i]);
-				interval_list_insert_after(segs, iv);
 				n_ivs++;
 				edge = iv->end;
 			}
 		}
 
 		if (!n_ivs)
-		{
-			interval_list_destroy_deep(segs);
 			continue;
-		}
 
 		/* Sum up scores for interval 0-n and vice versa. */
 		fwd = malloc(sizeof(window_t) * n_ivs);
 		bwd = malloc(sizeof(window_t) * n_ivs);
 
-		iv = interval_list_first(segs);
 		/* Initialize first candidate. */
-		fwd[0].r = iv->r;
+		fwd[0].r = segs->items[0].r;
 		fwd[0].s = score_rect(fwd[0].r);
 		/* Merge/sum up the rest. */
-		for (i = 1; i < n_ivs && iv != NULL; i++)
+		for (i = 1; i < n_ivs; i++)
 		{
-			iv = interval_list_next(segs);
-			fwd[i].r = merge_rects(fwd[i - 1].r, iv->r);
+			fwd[i].r = merge_rects(fwd[i - 1].r, segs->items[i].r);
 			fwd[i].s = score_rect(fwd[i].r);
 		}
 
-		iv = interval_list_last(segs);
 		/* Corresponding to a "merged all" forward window is a null window. */
 		memset(&(bwd[n_ivs - 1]), 0, sizeof(window_t));
 		/* Initialize first real candidate if it exists. */
 		if (n_ivs > 1)
 		{
-			bwd[n_ivs - 2].r = iv->r;
+			bwd[n_ivs - 2].r = segs->items[n_ivs - 1].r;
 			bwd[n_ivs - 2].s = score_rect(bwd[n_ivs - 2].r);
 		}
 		/* Merge/sum up the rest. */
-		for (i = n_ivs - 3; i >= 0 && iv != NULL; i--)
+		for (i = n_ivs - 3; i >= 0; i--)
 		{
-			iv = interval_list_prev(segs);
-			bwd[i].r = merge_rects(bwd[i + 1].r, iv->r);
+			bwd[i].r = merge_rects(bwd[i + 1].r, segs->items[i + 1].r);
 			bwd[i].s = score_rect(bwd[i].r);
 		}
 
@@ -503,7 +497,6 @@ int find_windows (rect_t *rects, int n_rects, rect_t *windows)
 		/* Cleanup. */
 		free(bwd);
 		free(fwd);
-		interval_list_destroy_deep(segs);
 	}
 
 	/* Is any of the best rectangles not null? */
@@ -535,6 +528,7 @@ int find_windows (rect_t *rects, int n_rects, rect_t *windows)
 	}
 
 	/* Cleanup. */
+	interval_vec_destroy(segs);
 	free(sorted);
 
 	return found;
@@ -148,6 +148,35 @@
  *----------------------------------------------------------------------------*/
 
 #include "common.h"
+#include "avs2sup.h"
+
+/* Run the inputs of a manifest, see avs2sup_batch_add_manifest. Options
+ * given on the command line are the default settings.
+ */
+static int run_batch (char *manifest, int jobs, int threads, char *settings[][2])
+{
+	avs2sup_batch_t *batch = avs2sup_batch_new(jobs, threads);
+	avs2sup_job_t *defaults = avs2sup_job_new();
+	int r = 0, i;
+
+	if (batch == NULL || defaults == NULL)
+	{
+		fprintf(stderr, "Cannot allocate batch.\n");
+		r = 1;
+	}
+	for (i = 0; !r && settings[i][0] != NULL; i++)
+		if ((r = avs2sup_job_set(defaults, settings[i][0], settings[i][1])))
+			fprintf(stderr, "Error: Invalid %s (%s).\n", settings[i][0], settings[i][1]);
+
+	if (!r)
+		r = avs2sup_batch_add_manifest(batch, defaults, manifest);
+	if (!r)
+		r = avs2sup_batch_run(batch, NULL);
+
+	avs2sup_job_free(defaults);
+	avs2sup_batch_free(batch);
+	return r ? 1 : 0;
+}
 
 /* Most of the time seems to be spent in AviSynth (about 4/5). */
 int main (int argc, char *argv[])
@@ -187,13 +216,32 @@ int main (int argc, char *argv[])
 	char *stricter_string = "0";
 	char *count_string = "2147483647";
 	char *in_img = NULL, *old_img = NULL, *tmp = NULL, *out_buf = NULL;
-	char *intc_buf = NULL, *outtc_buf = NULL;
 	char *drop_frame = NULL;
     char *mark_forced_string = "0";
+	char *threads_string = "0";
+	char *dedup_string = "1";
+	char *png_profile_string = "default";
+	char *epoch_stats_string = "0";
+	char *sup_index_string = "0";
+	char *sup_index_fn = NULL;
+	char *ass_filename = NULL;
+	char *batch_filename = NULL;
+	char *jobs_string = "0";
+	char *stats_string = "0";
+	char *stats_json_fn = NULL;
+	char *cache_fn = NULL;
+	char *checkpoint_string = "0";
+	char *resume_string = "0";
+	char *checkpoint_fn = NULL;
+	char run_id[4 * MAX_PATH + 256];
 	char png_dir[MAX_PATH + 1] = {0};
+	char identity[2 * MAX_PATH + 128];
+	sink_dir_t png_dest = {png_dir, NULL, NULL};
 	crop_t crops[2];
-	pic_t pic;
+	png_ref_t png_refs[2] = {{0, 0}, {0, 0}};
+	pic_t pic, in_pic;
 	uint32_t *pal = NULL;
+	quantizer_t *quant = NULL;
 	int out_filename_idx = 0;
 	int have_fps = 0;
 	int n_crop = 1;
@@ -209,7 +257,6 @@ int main (int argc, char *argv[])
 	int num_of_events = 0;
 	int i, c, j;
 	int have_line = 0;
-	int must_zero = 0;
 	int checked_empty;
 	int even_y = 0;
 	int auto_cut = 0;
@@ -217,19 +264,47 @@ int main (int argc, char *argv[])
 	int ugly = 0;
 	int progress_step = 1000;
 	int buffer_opt;
-	int bench_start = time(NULL);
+	stats_t stats;
+	double t, run_start = wall_clock();
+	int print_run_stats = 0;
 	int fps_num = 25, fps_den = 1;
 	int sup_output = 0;
 	int xml_output = 0;
 	int allow_empty = 0;
 	int stricter = 0;
     int mark_forced = 0;
+	int threads = 0;
+	int dedup = 1;
+	int epoch_stats = 0;
+	int sup_index = 0;
+	int checkpoint_every = 0, checkpoint_next = 0;
+	int resume = 0;
+	int start_at;
+	int64_t xml_size = 0;
+	checkpoint_t cp;
 	sup_writer_t *sw = NULL;
-	avis_input_t *avis_hnd;
+	frame_cache_t *cache = NULL;
+	cached_line_t *cached, line, copy;
+	recent_lines_t *recent = NULL;
+	uint8_t *line_rle[2] = {NULL, NULL};
+	int line_rle_len[2] = {0, 0};
+	png_pool_t *png_pool = NULL;
+	png_index_t *png_index = NULL;
+	png_profile_t *png_profile = NULL;
+	xml_writer_t *xw = NULL;
+	sup_decoder_t *sup_in = NULL;
+	bdn_input_t *bdn_in = NULL;
+	ass_reader_t *ass = NULL;
+	libass_input_t *libass_in = NULL;
+	int visible;
+	int next_frame = 0;
+	int progress_next = 0;
+	int line_forced = 0;
+	clock_t decode_start;
+	double decode_time;
+	avis_input_t *avis_hnd = NULL;
 	stream_info_t *s_info = malloc(sizeof(stream_info_t));
-	event_list_t *events = event_list_new();
-	event_t *event;
-	FILE *fh;
+	event_vec_t *events = event_vec_new();
 
 	/* Get args */
 	if (argc < 2)
@@ -260,11 +335,24 @@ int main (int argc, char *argv[])
 			, {"null-xml",     required_argument, 0, 'n'}
 			, {"stricter",     required_argument, 0, 'z'}
 			, {"forced",       required_argument, 0, 'F'}
+			, {"threads",      required_argument, 0, 'T'}
+			, {"dedup",        required_argument, 0, 'D'}
+			, {"png-profile",  required_argument, 0, 'P'}
+			, {"epoch-stats",  required_argument, 0, 'E'}
+			, {"sup-index",    required_argument, 0, 'I'}
+			, {"ass",          required_argument, 0, 'A'}
+			, {"batch",        required_argument, 0, 'B'}
+			, {"jobs",         required_argument, 0, 'J'}
+			, {"stats",        required_argument, 0, 'S'}
+			, {"stats-json",   required_argument, 0, 'R'}
+			, {"cache",        required_argument, 0, 'K'}
+			, {"checkpoint",   required_argument, 0, 'C'}
+			, {"resume",       required_argument, 0, 'r'}
 			, {0, 0, 0, 0}
 			};
 			int option_index = 0;
 
-			c = getopt_long(argc, argv, "o:j:c:t:l:v:f:x:y:d:b:s:m:e:p:a:u:n:z:F:", long_options, &option_index);
+			c = getopt_long(argc, argv, "o:j:c:t:l:v:f:x:y:d:b:s:m:e:p:a:u:n:z:F:T:D:P:E:I:A:B:J:S:R:K:C:r:", long_options, &option_index);
 			if (c == -1)
 				break;
 			switch (c)
@@ -335,12 +423,72 @@ int main (int argc, char *argv[])
 				case 'F':
 					mark_forced_string = optarg;
 					break;
+				case 'T':
+					threads_string = optarg;
+					break;
+				case 'D':
+					dedup_string = optarg;
+					break;
+				case 'P':
+					png_profile_string = optarg;
+					break;
+				case 'E':
+					epoch_stats_string = optarg;
+					break;
+				case 'I':
+					sup_index_string = optarg;
+					break;
+				case 'A':
+					ass_filename = optarg;
+					break;
+				case 'B':
+					batch_filename = optarg;
+					break;
+				case 'J':
+					jobs_string = optarg;
+					break;
+				case 'S':
+					stats_string = optarg;
+					break;
+				case 'R':
+					stats_json_fn = optarg;
+					break;
+				case 'K':
+					cache_fn = optarg;
+					break;
+				case 'C':
+					checkpoint_string = optarg;
+					break;
+				case 'r':
+					resume_string = optarg;
+					break;
 				default:
 					print_usage();
 					return 0;
 					break;
 			}
 	}
+	if (batch_filename != NULL)
+	{
+		char *settings[][2] = { {"trackname", track_name}, {"language", language}
+		                      , {"video-format", video_format}, {"fps", frame_rate}
+		                      , {"t-offset", t_offset}, {"x-offset", x_offset}
+		                      , {"y-offset", y_offset}, {"split-at", split_after}
+		                      , {"min-split", minimum_split}, {"even-y", even_y_string}
+		                      , {"autocrop", auto_crop_image}, {"palette", palletize_png}
+		                      , {"ugly", ugly_option}, {"buffer-opt", buffer_optimize}
+		                      , {"null-xml", allow_empty_string}, {"stricter", stricter_string}
+		                      , {"forced", mark_forced_string}, {"seek", seek_string}
+		                      , {"count", count_string}, {NULL, NULL}
+		                      };
+
+		if (argc - optind || out_filename[0] != NULL)
+		{
+			fprintf(stderr, "Inputs and outputs of a batch are listed in its manifest.\n");
+			return 1;
+		}
+		return run_batch(batch_filename, parse_int(jobs_string, "jobs", NULL), parse_int(threads_string, "threads", NULL), settings);
+	}
 	if (argc - optind == 1)
 		avs_filename = argv[optind];
 	else
@@ -368,7 +516,8 @@ int main (int argc, char *argv[])
 		{
 			xml_output_fn = out_filename[i];
 			xml_output++;
-			get_dir_path(xml_output_fn, png_dir);
+			if (get_dir_path(xml_output_fn, png_dir))
+				return 1;
 		}
 		else if (is_extension(out_filename[i], "sup") || is_extension(out_filename[i], "pgs"))
 		{
@@ -404,9 +553,30 @@ int main (int argc, char *argv[])
 	if (!min_split)
 		min_split = 1;
 	mark_forced = parse_int(mark_forced_string, "forced", NULL);
+	threads = parse_int(threads_string, "threads", NULL);
+	dedup = parse_int(dedup_string, "dedup", NULL);
+	epoch_stats = parse_int(epoch_stats_string, "epoch-stats", NULL);
+	sup_index = parse_int(sup_index_string, "sup-index", NULL);
+	print_run_stats = parse_int(stats_string, "stats", NULL);
+	checkpoint_every = parse_int(checkpoint_string, "checkpoint", NULL);
+	resume = parse_int(resume_string, "resume", NULL);
+	memset(&stats, 0, sizeof(stats));
+	if ((png_profile = get_png_profile(png_profile_string)) == NULL)
+	{
+		fprintf(stderr, "Error: Invalid PNG profile (%s).\n", png_profile_string);
+		return 1;
+	}
 
 	/* TODO: Sanity check video_format and frame_rate. */
 
+	/* BDN XML input brings its own frame rate */
+	if (is_extension(avs_filename, "xml"))
+	{
+		if ((bdn_in = open_bdn_input(avs_filename)) == NULL)
+			return 1;
+		frame_rate = bdn_in->frame_rate;
+	}
+
 	/* Get frame rate */
 	i = 0;
 	while (framerates[i].name != NULL)
@@ -429,10 +599,45 @@ int main (int argc, char *argv[])
 	}
 
 	/* Get timecode offset. */
-	to = parse_tc(t_offset, fps);
+	to = parse_tc(t_offset, fps, NULL);
+
+	/* Subtitle timings, to skip frames without subtitles */
+	if (ass_filename != NULL && (ass = parse_ass(ass_filename, fps_num, fps_den)) == NULL)
+		return 1;
 
-	/* Get video info and allocate buffer */
-	if (open_file_avis(avs_filename, &avis_hnd, s_info))
+	/* Get video info and allocate buffer. SUP and BDN XML input are turned
+	 * back into frames, which only happens for frames where the picture
+	 * changes.
+	 */
+	if (is_extension(avs_filename, "ass") || is_extension(avs_filename, "ssa"))
+	{
+		if (!bdn_video_size(video_format, &(s_info->i_width), &(s_info->i_height)))
+		{
+			fprintf(stderr, "Error: Invalid video format (%s).\n", video_format);
+			return 1;
+		}
+		if ((libass_in = open_libass_input(avs_filename, s_info->i_width, s_info->i_height, fps_num, fps_den)) == NULL)
+			return 1;
+		s_info->i_fps_num = fps_num;
+		s_info->i_fps_den = fps_den;
+	}
+	else if (bdn_in != NULL)
+	{
+		s_info->i_width = bdn_in->im_w;
+		s_info->i_height = bdn_in->im_h;
+		s_info->i_fps_num = fps_num;
+		s_info->i_fps_den = fps_den;
+	}
+	else if (is_extension(avs_filename, "sup") || is_extension(avs_filename, "pgs"))
+	{
+		if ((sup_in = open_sup_decoder(avs_filename, fps_num, fps_den)) == NULL)
+			return 1;
+		s_info->i_width = sup_in->im_w;
+		s_info->i_height = sup_in->im_h;
+		s_info->i_fps_num = fps_num;
+		s_info->i_fps_den = fps_den;
+	}
+	else if (open_file_avis(avs_filename, &avis_hnd, s_info))
 	{
 		print_usage();
 		return 1;
@@ -466,7 +671,14 @@ int main (int argc, char *argv[])
 	crops[0].h = pic.h;
 
 	/* Get frame number */
-	frames = get_frame_total_avis(avis_hnd);
+	if (libass_in != NULL)
+		frames = libass_in->frames;
+	else if (bdn_in != NULL)
+		frames = bdn_in->frames;
+	else if (sup_in != NULL)
+		frames = sup_in->frames;
+	else
+		frames = get_frame_total_avis(avis_hnd);
 	if (count_frames + init_frame > frames)
 	{
 		count_frames = frames - init_frame;
@@ -491,22 +703,139 @@ int main (int argc, char *argv[])
 			progress_step = 1;
 	}
 
+	/* One quantizer serves all palettes */
+	quant = new_quantizer();
+
+	/* Progress is kept next to the first output file, for everything that
+	 * affects the output */
+	start_at = init_frame;
+	memset(&cp, 0, sizeof(cp));
+	if (checkpoint_every || resume)
+	{
+		checkpoint_fn = malloc(strlen(out_filename[0]) + 6);
+		sprintf(checkpoint_fn, "%s.ckpt", out_filename[0]);
+		snprintf(run_id, sizeof(run_id), "%s %s %s %d-%d %dx%d %d/%d t%d x%d y%d s%d m%d b%d a%d u%d e%d p%d z%d F%d D%d I%d %s %s %s %s", avs_filename, sup_output ? sup_output_fn : "", xml_output ? xml_output_fn : "", init_frame, last_frame, pic.w, pic.h, fps_num, fps_den, to, xo, yo, split_at, min_split, buffer_opt, autocrop, ugly, even_y, pal_png, stricter, mark_forced, dedup, sup_index, png_profile->name, track_name, language, video_format);
+	}
+	if (resume)
+	{
+		if (read_checkpoint(checkpoint_fn, run_id, &cp))
+			return 1;
+		start_at = cp.frame;
+		first_frame = cp.first_frame;
+		end_frame = cp.end_frame;
+		num_of_events = cp.num_of_events;
+		fprintf(stderr, "Resuming at frame %d, after %d events.\n", start_at, num_of_events);
+	}
+	else if (checkpoint_fn != NULL)
+		remove(checkpoint_fn);
+	checkpoint_next = start_at + checkpoint_every;
+
 	/* Open SUP writer, if applicable */
 	if (sup_output)
-		sw = new_sup_writer(sup_output_fn, pic.w, pic.h, fps_num, fps_den);
+	{
+		if (resume)
+			sw = reopen_sup_writer(sup_output_fn, cp.sup.offset, pic.w, pic.h, fps_num, fps_den);
+		else
+			sw = new_sup_writer(sup_output_fn, pic.w, pic.h, fps_num, fps_den);
+		if (sw == NULL)
+			return 1;
+		if (epoch_stats)
+			sw->model->report = stderr;
+		sw->stats = &stats;
+		if (sup_index)
+		{
+			sup_index_fn = malloc(strlen(sup_output_fn) + 5);
+			sprintf(sup_index_fn, "%s.idx", sup_output_fn);
+			enable_sup_index(sw, sup_index_fn);
+			free(sup_index_fn);
+		}
+		if (resume)
+			restore_sup_writer(sw, &(cp.sup));
+		free(cp.sup.index);
+		cp.sup.index = NULL;
+	}
+
+	/* Open XML writer, if applicable */
+	if (xml_output)
+	{
+		if (resume)
+			xw = reopen_xml_writer(xml_output_fn, cp.xml_size, fps, frames, to, xo, yo, track_name, language, video_format, frame_rate, drop_frame);
+		else
+			xw = new_xml_writer(xml_output_fn, fps, frames, to, xo, yo, track_name, language, video_format, frame_rate, drop_frame);
+		if (xw == NULL)
+		{
+			perror("Error opening output XML file");
+			return 1;
+		}
+		if (xw->error)
+			return 1;
+	}
+
+	/* Start PNG writer threads, if applicable */
+	if (xml_output && threads != 1)
+		png_pool = new_png_pool(threads);
+	png_pool_set_stats(png_pool, &stats);
+	if (xml_output && dedup)
+		png_index = new_png_index();
+
+	/* Results of earlier runs, for everything that affects them */
+	if (cache_fn != NULL)
+	{
+		snprintf(identity, sizeof(identity), "%s %dx%d %d/%d b%d a%d u%d e%d p%d %s %s", avs_filename, pic.w, pic.h, fps_num, fps_den, buffer_opt, autocrop, ugly, even_y, pal_png, png_profile->name, xml_output ? png_dir : "");
+		cache = open_frame_cache(cache_fn, identity, start_at, last_frame, xml_output ? png_dir : NULL, sup_output);
+	}
+
+	/* Lines of this run, unless XML output writes every graphic to its own
+	 * PNG file */
+	if (!xml_output || png_index != NULL)
+		recent = new_recent_lines();
 
 	/* Process frames */
-	for (i = init_frame; i < last_frame; i++)
+	decode_start = clock();
+	for (i = start_at; i < last_frame; i = next_frame)
 	{
-		if (read_frame_avis(in_img, avis_hnd, i))
+		next_frame = i + 1;
+		t = wall_clock();
+		if (libass_in != NULL)
+			next_frame = MIN(libass_input_frame(libass_in, (uint8_t *)in_img, i), last_frame);
+		else if (bdn_in != NULL)
+			next_frame = MIN(bdn_input_frame(bdn_in, (uint8_t *)in_img, i), last_frame);
+		else if (sup_in != NULL)
+			next_frame = MIN(sup_decode_frame(sup_in, (uint8_t *)in_img, i), last_frame);
+		else if (ass != NULL && (visible = ass_next_visible(ass, i)) > i)
+		{
+			/* No subtitle until the next interval, so the gap is empty */
+			memset(in_img, 0, s_info->i_width * s_info->i_height * 4);
+			next_frame = MIN(visible, last_frame);
+		}
+		else if (read_frame_avis(in_img, avis_hnd, i))
 		{
 			fprintf(stderr, "Error reading frame.\n");
 			return 1;
 		}
+		t = stats_lap(&stats, STAGE_READ, t);
+		stats.frames++;
+		stats.read_bytes += s_info->i_width * s_info->i_height * 4;
 		checked_empty = 0;
 
 		/* Progress indicator */
-		if (i % (count_frames / progress_step) == 0)
+		if (bdn_in != NULL)
+		{
+			if (bdn_in->cur >= progress_next)
+			{
+				fprintf(stderr, "\rProgress: %d/%d events - Lines: %d", bdn_in->cur, bdn_input_events(bdn_in), num_of_events);
+				progress_next += 100;
+			}
+		}
+		else if (sup_in != NULL)
+		{
+			if (sup_in->decoded >= progress_next)
+			{
+				fprintf(stderr, "\rProgress: %d/%d display sets - Lines: %d", sup_in->decoded, sup_in->display_sets, num_of_events);
+				progress_next += 100;
+			}
+		}
+		else if (i % (count_frames / progress_step) == 0)
 		{
 			fprintf(stderr, "\rProgress: %d/%d - Lines: %d", i - init_frame, count_frames, num_of_events);
 		}
@@ -514,18 +843,44 @@ int main (int argc, char *argv[])
 		/* If we are outside any lines, check for empty frames first */
 		if (!have_line)
 		{
-			if (is_empty(s_info, in_img))
+			checked_empty = is_empty(s_info, in_img);
+			t = stats_lap(&stats, STAGE_EMPTY, t);
+			if (checked_empty)
+			{
+				stats.empty_frames++;
+				/* Two empty frames after a line, so the next line starts a
+				 * new epoch. Its state is all in the counters and in what
+				 * was written so far. */
+				if (checkpoint_every && next_frame >= checkpoint_next && i > end_frame)
+				{
+					if (png_pool_wait(png_pool, &png_dest))
+						return 1;
+					if ((!xml_output || (xml_size = xml_writer_checkpoint(xw, events)) >= 0) && (!sup_output || !sup_writer_checkpoint(sw, &(cp.sup))))
+					{
+						cp.frame = next_frame;
+						cp.first_frame = first_frame;
+						cp.end_frame = end_frame;
+						cp.num_of_events = num_of_events;
+						cp.xml_size = xml_size;
+						write_checkpoint(checkpoint_fn, run_id, &cp);
+						checkpoint_next = next_frame + checkpoint_every;
+					}
+				}
 				continue;
+			}
 			else
 				checked_empty = 1;
 		}
 
 		/* Check for duplicate, unless first frame */
 		if ((i != init_frame) && have_line && is_identical(s_info, in_img, old_img))
+		{
+			stats_lap(&stats, STAGE_DUP, t);
+			stats.dup_frames++;
 			continue;
-		/* Mark frames that were not used as new image in comparison to have transparent pixels zeroed */
-		else if (!(i && have_line))
-			must_zero = 1;
+		}
+		if (have_line)
+			t = stats_lap(&stats, STAGE_DUP, t);
 
 		/* Not a dup, write end-of-line, if we had a line before */
 		if (have_line)
@@ -533,47 +888,157 @@ int main (int argc, char *argv[])
 			if (sup_output)
 			{
 				assert(pal != NULL);
-				write_sup_wrapper(sw, (uint8_t *)out_buf, n_crop, crops, pal, start_frame + to, i + to, split_at, min_split, stricter, mark_forced);
+				if (cache != NULL || recent != NULL)
+					write_sup_rle_wrapper(sw, n_crop, crops, line_rle, line_rle_len, pal, start_frame + to, i + to, split_at, min_split, stricter, line_forced);
+				else
+					write_sup_wrapper(sw, (uint8_t *)out_buf, n_crop, crops, pal, start_frame + to, i + to, split_at, min_split, stricter, line_forced);
 				if (!xml_output)
 					free(pal);
 				pal = NULL;
+				t = wall_clock();
 			}
 			if (xml_output)
-				add_event_xml(events, split_at, min_split, start_frame + to, i + to, n_crop, crops, mark_forced);
+			{
+				add_event_xml(events, split_at, min_split, start_frame + to, i + to, n_crop, crops, png_refs, line_forced);
+				write_xml_events(xw, events);
+				t = stats_lap(&stats, STAGE_XML, t);
+			}
 			end_frame = i;
 			have_line = 0;
 		}
 
 		/* Check for empty frame, if we didn't before */
-		if (!checked_empty && is_empty(s_info, in_img))
-			continue;
+		if (!checked_empty)
+		{
+			checked_empty = is_empty(s_info, in_img);
+			t = stats_lap(&stats, STAGE_EMPTY, t);
+			if (checked_empty)
+			{
+				stats.empty_frames++;
+				continue;
+			}
+		}
 
-		/* Zero transparent pixels, if needed */
-		if (must_zero)
-			zero_transparent(s_info, in_img);
-		must_zero = 0;
+		/* Zero transparent pixels. is_identical only did so up to the first
+		 * difference, and later frames are compared against this one. */
+		zero_transparent(s_info, in_img);
 
 		/* Not an empty frame, start line */
 		have_line = 1;
 		start_frame = i;
-		swap_rb(s_info, in_img, out_buf);
-		if (buffer_opt)
-			n_crop = auto_split(pic, crops, ugly, even_y);
-		else if (autocrop)
+		line_forced = mark_forced || (libass_in != NULL && libass_in->forced) || (sup_in != NULL && sup_in->forced) || (bdn_in != NULL && bdn_in->forced) || (ass != NULL && ass_forced_at(ass, i));
+		cached = NULL;
+		if (cache != NULL || recent != NULL)
 		{
-			crops[0].x = 0;
-			crops[0].y = 0;
-			crops[0].w = pic.w;
-			crops[0].h = pic.h;
-			auto_crop(pic, crops);
+			line.hash = hash_frame((uint8_t *)in_img, s_info->i_width * s_info->i_height * 4);
+			in_pic = pic;
+			in_pic.b = in_img;
+			if (recent != NULL && (cached = recent_lines_find(recent, line.hash, in_pic)) != NULL)
+			{
+				/* Shown before in this run, keep it for the next one too */
+				if (cache != NULL)
+				{
+					copy_cached_line(&line, cached);
+					line.frame = i;
+					frame_cache_add(cache, &line);
+				}
+				stats.repeated_lines++;
+			}
+			else if (cache != NULL && (cached = frame_cache_find(cache, i, line.hash)) != NULL)
+			{
+				if (recent != NULL)
+				{
+					copy_cached_line(&line, cached);
+					recent_lines_add(recent, &line, in_pic);
+				}
+				stats.cached_lines++;
+			}
+			t = stats_lap(&stats, STAGE_CACHE, t);
+		}
+		if (cached != NULL)
+		{
+			/* Same picture as before, its PNG files are still there */
+			n_crop = cached->n_crop;
+			memcpy(crops, cached->crops, sizeof(crops));
+			memcpy(png_refs, cached->png, sizeof(png_refs));
+			memcpy(line_rle, cached->rle, sizeof(line_rle));
+			memcpy(line_rle_len, cached->rle_len, sizeof(line_rle_len));
+			if (cached->flags & FRAME_CACHE_PAL)
+			{
+				pal = malloc(256 * sizeof(uint32_t));
+				memcpy(pal, cached->pal, 256 * sizeof(uint32_t));
+			}
+		}
+		else
+		{
+			swap_rb(s_info, in_img, out_buf);
+			t = stats_lap(&stats, STAGE_SWAP, t);
+			if (buffer_opt)
+				n_crop = auto_split(pic, crops, ugly, even_y);
+			else if (autocrop)
+			{
+				crops[0].x = 0;
+				crops[0].y = 0;
+				crops[0].w = pic.w;
+				crops[0].h = pic.h;
+				auto_crop(pic, crops);
+			}
+			if ((buffer_opt || autocrop) && even_y)
+				enforce_even_y(crops, n_crop);
+			t = stats_lap(&stats, STAGE_CROP, t);
+			if ((pal_png || sup_output) && pal == NULL)
+			{
+				pal = palletize_with(quant, out_buf, s_info->i_width, s_info->i_height);
+				t = stats_lap(&stats, STAGE_PALETTE, t);
+			}
+			if (xml_output)
+			{
+				for (j = 0; j < n_crop; j++)
+				{
+					png_refs[j].file_id = start_frame;
+					png_refs[j].graphic = j;
+					if (png_index == NULL || !png_index_find(png_index, (uint8_t *)out_buf, s_info->i_width, pal, crops[j], &(png_refs[j])))
+					{
+						if (png_pool_write(png_pool, &png_dest, start_frame, (uint8_t *)out_buf, s_info->i_width, s_info->i_height, j, pal, crops[j], png_profile))
+							return 1;
+						if (png_pool == NULL)
+							stats.png_files++;
+					}
+				}
+				/* Without writer threads, the PNG files were encoded right here */
+				t = stats_lap(&stats, png_pool == NULL ? STAGE_PNG : STAGE_PNG_QUEUE, t);
+			}
+			if (cache != NULL || recent != NULL)
+			{
+				/* Remember what the line became. The RLE data is encoded
+				 * once here, and kept by the recent lines or the cache. */
+				line.frame = i;
+				line.flags = (pal != NULL ? FRAME_CACHE_PAL : 0) | (xml_output ? FRAME_CACHE_PNG : 0) | (sup_output ? FRAME_CACHE_RLE : 0);
+				line.n_crop = n_crop;
+				memcpy(line.crops, crops, sizeof(crops));
+				if (pal != NULL)
+					memcpy(line.pal, pal, 256 * sizeof(uint32_t));
+				memcpy(line.png, png_refs, sizeof(png_refs));
+				memset(line.rle, 0, sizeof(line.rle));
+				memset(line.rle_len, 0, sizeof(line.rle_len));
+				for (j = 0; sup_output && j < n_crop; j++)
+					line.rle[j] = rl_encode((uint8_t *)out_buf, pic.w, pic.h, crops[j], &(line.rle_len[j]));
+				memcpy(line_rle, line.rle, sizeof(line_rle));
+				memcpy(line_rle_len, line.rle_len, sizeof(line_rle_len));
+				if (recent != NULL && cache != NULL)
+				{
+					copy_cached_line(&copy, &line);
+					recent_lines_add(recent, &line, in_pic);
+					frame_cache_add(cache, &copy);
+				}
+				else if (recent != NULL)
+					recent_lines_add(recent, &line, in_pic);
+				else
+					frame_cache_add(cache, &line);
+				if (sup_output)
+					t = stats_lap(&stats, STAGE_RLE, t);
+			}
 		}
-		if ((buffer_opt || autocrop) && even_y)
-			enforce_even_y(crops, n_crop);
-		if ((pal_png || sup_output) && pal == NULL)
-			pal = palletize(out_buf, s_info->i_width, s_info->i_height);
-		if (xml_output)
-			for (j = 0; j < n_crop; j++)
-				write_png(png_dir, start_frame, (uint8_t *)out_buf, s_info->i_width, s_info->i_height, j, pal, crops[j]);
 		if (pal_png && xml_output && !sup_output)
 		{
 			free(pal);
@@ -590,6 +1055,13 @@ int main (int argc, char *argv[])
 	}
 
 	fprintf(stderr, "\rProgress: %d/%d - Lines: %d - Done\n", i - init_frame, count_frames, num_of_events);
+	decode_time = MAX((double)(clock() - decode_start) / CLOCKS_PER_SEC, 0.001);
+	if (libass_in != NULL)
+		fprintf(stderr, "Rendered %d frames into %d events in %.2fs (%.0f events/s)\n", libass_in->rendered, num_of_events, decode_time, num_of_events / decode_time);
+	else if (bdn_in != NULL)
+		fprintf(stderr, "Loaded %d PNG files for %d events in %.2fs (%.0f events/s)\n", bdn_in->loaded, num_of_events, decode_time, num_of_events / decode_time);
+	else if (sup_in != NULL)
+		fprintf(stderr, "Decoded %d display sets into %d events in %.2fs (%.0f events/s)\n", sup_in->decoded, num_of_events, decode_time, num_of_events / decode_time);
 
 	/* Add last event, if available */
 	if (have_line)
@@ -597,14 +1069,20 @@ int main (int argc, char *argv[])
 		if (sup_output)
 		{
 			assert(pal != NULL);
-			write_sup_wrapper(sw, (uint8_t *)out_buf, n_crop, crops, pal, start_frame + to, i - 1 + to, split_at, min_split, stricter, mark_forced);
+			if (cache != NULL || recent != NULL)
+				write_sup_rle_wrapper(sw, n_crop, crops, line_rle, line_rle_len, pal, start_frame + to, i - 1 + to, split_at, min_split, stricter, line_forced);
+			else
+				write_sup_wrapper(sw, (uint8_t *)out_buf, n_crop, crops, pal, start_frame + to, i - 1 + to, split_at, min_split, stricter, line_forced);
 			if (!xml_output)
 				free(pal);
 			pal = NULL;
 		}
 		if (xml_output)
 		{
-			add_event_xml(events, split_at, min_split, start_frame + to, i - 1 + to, n_crop, crops, mark_forced);
+			t = wall_clock();
+			add_event_xml(events, split_at, min_split, start_frame + to, i - 1 + to, n_crop, crops, png_refs, line_forced);
+			write_xml_events(xw, events);
+			stats_lap(&stats, STAGE_XML, t);
 			free(pal);
 			pal = NULL;
 		}
@@ -612,10 +1090,18 @@ int main (int argc, char *argv[])
 		end_frame = i - 1;
 	}
 
-	if (sup_output)
-	{
-		close_sup_writer(sw);
-	}
+	if (sup_output && close_sup_writer(sw))
+		return 1;
+	if (cache != NULL && close_frame_cache(cache))
+		return 1;
+	if (recent != NULL)
+		destroy_recent_lines(recent);
+
+	/* Wait for outstanding PNG files */
+	if (close_png_pool(png_pool))
+		return 1;
+	if (png_index != NULL)
+		destroy_png_index(png_index);
 
 	if (xml_output)
 	{
@@ -625,6 +1111,9 @@ int main (int argc, char *argv[])
 			if (!allow_empty)
 			{
 				fprintf(stderr, "No events detected. Cowardly refusing to write XML file.\n");
+				discard_xml_writer(xw);
+				if (checkpoint_fn != NULL)
+					remove(checkpoint_fn);
 				return 0;
 			}
 			else
@@ -634,73 +1123,41 @@ int main (int argc, char *argv[])
 			}
 		}
 
-		/* Initialize timecode buffers */
-		intc_buf = calloc(12, 1);
-		outtc_buf = calloc(12, 1);
-
-		/* Creating output file */
-		if ((fh = fopen(xml_output_fn, "w")) == 0)
-		{
-			perror("Error opening output XML file");
+		/* Write remaining events and header, then close XML file */
+		t = wall_clock();
+		if (close_xml_writer(xw, events, first_frame + to, end_frame + to + auto_cut, num_of_events, auto_cut))
 			return 1;
-		}
-
-		/* Write XML header */
-		mk_timecode(first_frame + to, fps, intc_buf);
-		mk_timecode(end_frame + to + auto_cut, fps, outtc_buf);
-		fprintf(fh, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-			"<BDN Version=\"0.93\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\"\n"
-			"xsi:noNamespaceSchemaLocation=\"BD-03-006-0093b BDN File Format.xsd\">\n"
-			"<Description>\n"
-			"<Name Title=\"%s\" Content=\"\"/>\n"
-			"<Language Code=\"%s\"/>\n"
-			"<Format VideoFormat=\"%s\" FrameRate=\"%s\" DropFrame=\"%s\"/>\n"
-			"<Events LastEventOutTC=\"%s\" FirstEventInTC=\"%s\"\n", track_name, language, video_format, frame_rate, drop_frame, outtc_buf, intc_buf);
-
-		mk_timecode(0, fps, intc_buf);
-		mk_timecode(frames + to, fps, outtc_buf);
-		fprintf(fh, "ContentInTC=\"%s\" ContentOutTC=\"%s\" NumberofEvents=\"%d\" Type=\"Graphic\"/>\n"
-			"</Description>\n"
-			"<Events>\n", intc_buf, outtc_buf, num_of_events);
-
-		/* Write XML events */
-		if (!event_list_empty(events))
-		{
-			event = event_list_first(events);
-			do
-			{
-				mk_timecode(event->start_frame, fps, intc_buf);
-				mk_timecode(event->end_frame, fps, outtc_buf);
-
-				if (auto_cut && event->end_frame == frames - 1)
-				{
-					mk_timecode(event->end_frame + 1, fps, outtc_buf);
-				}
-
-				fprintf(fh, "<Event Forced=\"%s\" InTC=\"%s\" OutTC=\"%s\">\n", (event->forced ? "True" : "False"), intc_buf, outtc_buf);
-				for (i = 0; i < event->graphics; i++)
-				{
-					fprintf(fh, "<Graphic Width=\"%d\" Height=\"%d\" X=\"%d\" Y=\"%d\">%08d_%d.png</Graphic>\n", event->c[i].w, event->c[i].h, xo + event->c[i].x, yo + event->c[i].y, event->image_number - to, i);
-				}
-				fprintf(fh, "</Event>\n");
-				event = event_list_next(events);
-			}
-			while (event != NULL);
-		}
-
-		/* Write XML footer */
-		fprintf(fh, "</Events>\n</BDN>\n");
+		stats_lap(&stats, STAGE_XML, t);
+	}
+	event_vec_destroy(events);
 
-		/* Close XML file */
-		fclose(fh);
+	/* Nothing left to resume */
+	if (checkpoint_fn != NULL)
+	{
+		remove(checkpoint_fn);
+		free(checkpoint_fn);
 	}
 
 	/* Cleanup */
-	close_file_avis(avis_hnd);
+	destroy_quantizer(quant);
+	if (ass != NULL)
+		close_ass_reader(ass);
+	if (libass_in != NULL)
+		close_libass_input(libass_in);
+	else if (bdn_in != NULL)
+		close_bdn_input(bdn_in);
+	else if (sup_in != NULL)
+		close_sup_decoder(sup_in);
+	else
+		close_file_avis(avis_hnd);
 
 	/* Give runtime */
-	if (0)
-        fprintf(stderr, "Time elapsed: %llu\n", time(NULL) - bench_start);
+	stats.total = wall_clock() - run_start;
+	stats.lines = num_of_events;
+	if (print_run_stats)
+		print_stats(&stats, stderr);
+	if (stats_json_fn != NULL && write_stats_json(&stats, stats_json_fn))
+		return 1;
 
 	return 0;
 }
@@ -1,24 +1,300 @@
 #include "avs2sup.h"
 #include "common.h"
 #include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdbool.h>
+#include <ctype.h>
+#include <pthread.h>
 
-static ProgressCallback progress_callback = NULL;  // 保存回调函数指针
-volatile int stopFlag = 0;
+struct avs2sup_job_s
+{
+    /* Settings */
+    char *track_name;
+    char *language;
+    char *video_format;
+    char *frame_rate;
+    char *t_offset;
+    int xo;
+    int yo;
+    int split_at;
+    int min_split;
+    int even_y;
+    int autocrop;
+    int pal_png;
+    int ugly;
+    int buffer_opt;
+    int allow_empty;
+    int stricter;
+    int mark_forced;
+    int init_frame;
+    int count_frames;
 
-void avs2sup_reg_callback(ProgressCallback callback)
+    avs2sup_progress_t progress;
+    void *opaque;
+    volatile int stop;
+    volatile int *also_stop;      /* Flag of the older interface, or NULL */
+    char error[256];
+
+    /* Kept from one run to the next, released by avs2sup_job_free */
+    char *in_raw;
+    char *old_raw;
+    char *out_raw;
+    size_t in_size;
+    size_t old_size;
+    size_t out_size;
+    quantizer_t *quant;
+    png_pool_t *shared_png_pool;  /* Pool of the batch running the job, or NULL */
+
+    /* Everything a run allocates, released by job_cleanup */
+    avis_input_t *avis_hnd;
+    stream_info_t s_info;
+    uint32_t *pal;
+    event_vec_t *events;
+    sup_writer_t *sw;
+    xml_writer_t *xw;
+    png_pool_t *png_pool;
+    png_index_t *png_index;
+
+    /* State between avs2sup_job_open and avs2sup_job_finish */
+    int open;
+    char *out_filename;
+    int sup_output;
+    int xml_output;
+    char png_dir[MAX_PATH + 1];
+    sink_dir_t png_sinks;         /* Set by the host, or all NULL */
+    sink_dir_t png_dest;          /* Where PNG files of this run go */
+    char *old_img;                /* Frame shown by the current line */
+    char *out_buf;                /* Same in R, G, B, A order */
+    pic_t pic;
+    crop_t crops[2];
+    int n_crop;
+    png_ref_t png_refs[2];
+    int fps;
+    int to;
+    int frames;                   /* Expected number of frames, or INT_MAX */
+    int next_frame;               /* Frames before this were pushed */
+    int have_line;
+    int start_frame;
+    int first_frame;
+    int end_frame;
+    int num_of_events;
+};
+
+typedef struct job_option_s
 {
-    progress_callback = callback;
+    const char *name;
+    int is_string;
+    size_t offset;
+} job_option_t;
+
+static const job_option_t job_options[] = { {"trackname",    1, offsetof(avs2sup_job_t, track_name)}
+                                          , {"language",     1, offsetof(avs2sup_job_t, language)}
+                                          , {"video-format", 1, offsetof(avs2sup_job_t, video_format)}
+                                          , {"fps",          1, offsetof(avs2sup_job_t, frame_rate)}
+                                          , {"t-offset",     1, offsetof(avs2sup_job_t, t_offset)}
+                                          , {"x-offset",     0, offsetof(avs2sup_job_t, xo)}
+                                          , {"y-offset",     0, offsetof(avs2sup_job_t, yo)}
+                                          , {"split-at",     0, offsetof(avs2sup_job_t, split_at)}
+                                          , {"min-split",    0, offsetof(avs2sup_job_t, min_split)}
+                                          , {"even-y",       0, offsetof(avs2sup_job_t, even_y)}
+                                          , {"autocrop",     0, offsetof(avs2sup_job_t, autocrop)}
+                                          , {"palette",      0, offsetof(avs2sup_job_t, pal_png)}
+                                          , {"ugly",         0, offsetof(avs2sup_job_t, ugly)}
+                                          , {"buffer-opt",   0, offsetof(avs2sup_job_t, buffer_opt)}
+                                          , {"null-xml",     0, offsetof(avs2sup_job_t, allow_empty)}
+                                          , {"stricter",     0, offsetof(avs2sup_job_t, stricter)}
+                                          , {"forced",       0, offsetof(avs2sup_job_t, mark_forced)}
+                                          , {"seek",         0, offsetof(avs2sup_job_t, init_frame)}
+                                          , {"count",        0, offsetof(avs2sup_job_t, count_frames)}
+                                          , {NULL, 0, 0}
+                                          };
+
+avs2sup_job_t *avs2sup_job_new(void)
+{
+    avs2sup_job_t *job = calloc(1, sizeof(avs2sup_job_t));
+
+    if (job == NULL)
+        return NULL;
+
+    job->track_name = strdup("Undefined");
+    job->language = strdup("und");
+    job->video_format = strdup("1080p");
+    job->frame_rate = strdup("23.976");
+    job->t_offset = strdup("0");
+    job->min_split = 3;
+    job->autocrop = 1;
+    job->pal_png = 1;
+    job->count_frames = INT_MAX;
+
+    return job;
 }
 
-int avs2sup_process(const char* avs_filename, const char* outFileName, const char* language, const char* video_format, const char* frame_rate)
+int avs2sup_job_set(avs2sup_job_t *job, const char *name, const char *value)
+{
+    const job_option_t *o;
+    char **str;
+    int v, e;
+
+    if (name == NULL || value == NULL)
+        return AVS2SUP_EINVAL;
+
+    for (o = job_options; o->name != NULL; o++)
+    {
+        if (strcmp(o->name, name))
+            continue;
+        if (o->is_string)
+        {
+            str = (char **)((char *)job + o->offset);
+            free(*str);
+            *str = strdup(value);
+        }
+        else
+        {
+            v = parse_int((char *)value, NULL, &e);
+            if (e)
+                return AVS2SUP_EINVAL;
+            *(int *)((char *)job + o->offset) = v;
+        }
+        return AVS2SUP_OK;
+    }
+
+    return AVS2SUP_EINVAL;
+}
+
+void avs2sup_job_set_progress(avs2sup_job_t *job, avs2sup_progress_t callback, void *opaque)
+{
+    job->progress = callback;
+    job->opaque = opaque;
+}
+
+void avs2sup_job_stop(avs2sup_job_t *job)
+{
+    job->stop = 1;
+}
+
+const char *avs2sup_job_error(avs2sup_job_t *job)
+{
+    return job->error;
+}
+
+void avs2sup_job_free(avs2sup_job_t *job)
+{
+    const job_option_t *o;
+
+    if (job == NULL)
+        return;
+
+    for (o = job_options; o->name != NULL; o++)
+        if (o->is_string)
+            free(*(char **)((char *)job + o->offset));
+    free(job->in_raw);
+    free(job->old_raw);
+    free(job->out_raw);
+    destroy_quantizer(job->quant);
+    free(job);
+}
+
+/* Make dst use the settings of src */
+static void job_copy_settings(avs2sup_job_t *dst, const avs2sup_job_t *src)
 {
-    int result = 0;
-    if(stopFlag)
+    const job_option_t *o;
+    char **str;
+
+    for (o = job_options; o->name != NULL; o++)
     {
-        result = 2;
-        goto cleanup;
+        if (o->is_string)
+        {
+            str = (char **)((char *)dst + o->offset);
+            free(*str);
+            *str = strdup(*(char **)((char *)src + o->offset));
+        }
+        else
+            *(int *)((char *)dst + o->offset) = *(int *)((char *)src + o->offset);
     }
+}
+
+static int job_stopped(avs2sup_job_t *job)
+{
+    return job->stop || (job->also_stop != NULL && *job->also_stop);
+}
+
+/* Record the reason for a failure and pass the return code through */
+static int job_fail(avs2sup_job_t *job, int result, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(job->error, sizeof(job->error), format, args);
+    va_end(args);
+    fprintf(stderr, "%s\n", job->error);
+
+    return result;
+}
+
+/* Wait for the PNG files of this job, returns -1 if any failed */
+static int job_png_wait(avs2sup_job_t *job)
+{
+    int r;
+
+    if (job->shared_png_pool != NULL)
+        return png_pool_wait(job->shared_png_pool, &(job->png_dest));
+    r = close_png_pool(job->png_pool);
+    job->png_pool = NULL;
+
+    return r;
+}
+
+/* Release whatever a run left open. Unfinished output files are deleted. */
+static void job_cleanup(avs2sup_job_t *job)
+{
+    job_png_wait(job);
+    if (job->png_index != NULL)
+        destroy_png_index(job->png_index);
+    job->png_index = NULL;
+    if (job->xw != NULL)
+        discard_xml_writer(job->xw);
+    job->xw = NULL;
+    if (job->sw != NULL)
+        discard_sup_writer(job->sw);
+    job->sw = NULL;
+    if (job->events != NULL)
+        event_vec_destroy(job->events);
+    job->events = NULL;
+    if (job->avis_hnd != NULL)
+        close_file_avis(job->avis_hnd);
+    job->avis_hnd = NULL;
+    free(job->pal);
+    job->pal = NULL;
+    free(job->out_filename);
+    job->out_filename = NULL;
+    job->open = 0;
+    job->stop = 0;
+}
+
+/* Frame buffer with room for aligning it to 16 bytes and over read/write.
+ * The buffer of an earlier run is used again if it is large enough.
+ */
+static char *job_buffer(avs2sup_job_t *job, char **raw, size_t *size)
+{
+    size_t need = job->pic.w * job->pic.h * 4 + 16 * 2;
+
+    if (*size < need)
+    {
+        free(*raw);
+        *size = 0;
+        if ((*raw = calloc(need, sizeof(char))) == NULL)
+            return NULL;
+        *size = need;
+    }
+    return *raw + (short)(16 - ((long)*raw % 16));
+}
+
+/* Open the output, by out_filename or as sink in format. The sink belongs
+ * to the job, and is discarded if opening fails.
+ */
+static int job_open(avs2sup_job_t *job, const char *out_filename, sink_t *sink, const char *format, int width, int height, const char *frame_rate)
+{
     struct framerate_entry_s framerates[] = { {"23.976", "23.976", 24, 0, 24000, 1001}
         /*, {"23.976d", "23.976", 24000/1001.0, 1}*/
         , {"24", "24", 24, 0, 24, 1}
@@ -32,443 +308,842 @@ int avs2sup_process(const char* avs_filename, const char* outFileName, const cha
         /*, {"59.94d", "59.94", 60000/1001.0, 1}*/
         , {NULL, NULL, 0, 0, 0, 0}
     };
-    char *track_name = "Undefined";
-    char *sup_output_fn = NULL;
-    char *xml_output_fn = NULL;
-    char *x_offset = "0";
-    char *y_offset = "0";
-    char *t_offset = "0";
-    char *buffer_optimize = "0";
-    char *split_after = "0";
-    char *minimum_split = "3";
-    char *palletize_png = "1";
-    char *even_y_string = "0";
-    char *auto_crop_image = "1";
-    char *ugly_option = "0";
-    char *seek_string = "0";
-    char *allow_empty_string = "0";
-    char *stricter_string = "0";
-    char *count_string = "2147483647";
-    char *in_img = NULL, *old_img = NULL, *tmp = NULL, *out_buf = NULL;
-    char *intc_buf = NULL, *outtc_buf = NULL;
+    const char *name = sink != NULL ? "output" : out_filename;
+    char *out_name = NULL;
     char *drop_frame = NULL;
-    char *mark_forced_string = "0";
-    char png_dir[MAX_PATH + 1] = {0};
-    crop_t crops[2];
-    pic_t pic;
-    uint32_t *pal = NULL;
-    int have_fps = 0;
-    int n_crop = 1;
-    int split_at = 0;
-    int min_split = 3;
-    int autocrop = 0;
-    int xo, yo, to;
-    int fps = 25;
-    int count_frames = INT_MAX, last_frame;
-    int init_frame = 0;
-    int frames;
-    int first_frame = -1, start_frame = -1, end_frame = -1;
-    int num_of_events = 0;
-    int i, j;
-    int have_line = 0;
-    int must_zero = 0;
-    int checked_empty;
-    int even_y = 0;
-    int auto_cut = 0;
-    int pal_png = 1;
-    int ugly = 0;
-    int progress_step = 1000;
-    int buffer_opt;
-    int bench_start = time(NULL);
+    char t_offset[16] = {0};
     int fps_num = 25, fps_den = 1;
-    int sup_output = 0;
-    int xml_output = 0;
-    int allow_empty = 0;
-    int stricter = 0;
-    int mark_forced = 0;
-    sup_writer_t *sw = NULL;
-    avis_input_t *avis_hnd;
-    stream_info_t *s_info = malloc(sizeof(stream_info_t));
-    event_list_t *events = event_list_new();
-    event_t *event;
-    FILE *fh;
+    int i, e, r;
 
-    /* Both input and output filenames are required */
-    if (avs_filename == NULL || outFileName == NULL)
+    job->error[0] = 0;
+    if (job->open)
     {
-        print_usage();
-        result = -1;
-        goto cleanup;
+        r = job_fail(job, AVS2SUP_EINVAL, "Job is already open.");
+        goto fail;
     }
 
     /* Get target output format */
-    if (is_extension(outFileName, "xml"))
-    {
-        xml_output_fn = outFileName;
-        xml_output++;
-        get_dir_path(xml_output_fn, png_dir);
-    }
-    else if (is_extension(outFileName, "sup") || is_extension(outFileName, "pgs"))
-    {
-        sup_output_fn = outFileName;
-        sup_output++;
-        pal_png = 1;
-    }
+    job->sup_output = 0;
+    job->xml_output = 0;
+    if (sink != NULL ? !strcasecmp(format, "xml") : is_extension(out_filename, "xml"))
+        job->xml_output = 1;
+    else if (sink != NULL ? !strcasecmp(format, "sup") || !strcasecmp(format, "pgs") : is_extension(out_filename, "sup") || is_extension(out_filename, "pgs"))
+        job->sup_output = 1;
     else
     {
-        fprintf(stderr, "Output file extension must be \".xml\", \".sup\" or \".pgs\".\n");
-        result = 1;
-        goto cleanup;
+        r = job_fail(job, AVS2SUP_EINVAL, "Output file extension must be \".xml\", \".sup\" or \".pgs\".");
+        goto fail;
     }
-    if (sup_output > 1 || xml_output > 1)
+
+    /* PNG files go next to the XML file, unless the host takes them */
+    if (job->xml_output)
     {
-        fprintf(stderr, "If more than one output filename is used, they must have\ndifferent output formats.\n");
-        exit(0);
+        if (job->png_sinks.open != NULL)
+            job->png_dest = job->png_sinks;
+        else if (sink == NULL && !get_dir_path((char *)out_filename, job->png_dir))
+        {
+            job->png_dest.dir = job->png_dir;
+            job->png_dest.open = NULL;
+        }
+        else
+        {
+            r = job_fail(job, AVS2SUP_EINVAL, "No place for the PNG files of %s.", name);
+            goto fail;
+        }
     }
 
-    /* Set X and Y offsets, and split value */
-    xo = parse_int(x_offset, "x-offset", NULL);
-    yo = parse_int(y_offset, "y-offset", NULL);
-    pal_png = parse_int(palletize_png, "palette", NULL);
-    even_y = parse_int(even_y_string, "even-y", NULL);
-    autocrop = parse_int(auto_crop_image, "autocrop", NULL);
-    split_at = parse_int(split_after, "split-at", NULL);
-    ugly = parse_int(ugly_option, "ugly", NULL);
-    allow_empty = parse_int(allow_empty_string, "null-xml", NULL);
-    stricter = parse_int(stricter_string, "stricter", NULL);
-    init_frame = parse_int(seek_string, "seek", NULL);
-    count_frames = parse_int(count_string, "count", NULL);
-    min_split = parse_int(minimum_split, "min-split", NULL);
-    if (!min_split)
-        min_split = 1;
-    mark_forced = parse_int(mark_forced_string, "forced", NULL);
-
-    /* TODO: Sanity check video_format and frame_rate. */
+    /* Check minimum size */
+    if (width < 8 || height < 8)
+    {
+        r = job_fail(job, AVS2SUP_EINVAL, "Error: Video dimensions below 8x8 (%dx%d).", width, height);
+        goto fail;
+    }
 
     /* Get frame rate */
-    i = 0;
-    while (framerates[i].name != NULL)
+    if (frame_rate == NULL)
+        frame_rate = job->frame_rate;
+    for (i = 0; framerates[i].name != NULL; i++)
     {
-        if(stopFlag)
-        {
-            result = 2;
-            goto cleanup;
-        }
         if (!strcasecmp(framerates[i].name, frame_rate))
         {
-            frame_rate = framerates[i].out_name;
-            fps = framerates[i].rate;
+            out_name = framerates[i].out_name;
+            job->fps = framerates[i].rate;
             drop_frame = framerates[i].drop ? "true" : "false";
             fps_num = framerates[i].fps_num;
             fps_den = framerates[i].fps_den;
-            have_fps = 1;
         }
-        i++;
     }
-    if (!have_fps)
+    if (out_name == NULL)
     {
-        fprintf(stderr, "Error: Invalid framerate (%s).\n", frame_rate);
-        result = 1;
-        goto cleanup;
+        r = job_fail(job, AVS2SUP_EINVAL, "Error: Invalid framerate (%s).", frame_rate);
+        goto fail;
     }
 
-    /* Get timecode offset. */
-    to = parse_tc(t_offset, fps);
+    /* Get timecode offset, parse_tc takes the string apart */
+    strncpy(t_offset, job->t_offset, sizeof(t_offset) - 1);
+    job->to = parse_tc(t_offset, job->fps, &e);
+    if (e)
+    {
+        r = job_fail(job, AVS2SUP_EINVAL, "Error: Invalid timecode offset (%s).", job->t_offset);
+        goto fail;
+    }
 
-    /* Get video info and allocate buffer */
-    if (open_file_avis(avs_filename, &avis_hnd, s_info))
+    /* Set up buffers and buffer (non-)optimization */
+    job->pic.w = width;
+    job->pic.h = height;
+    job->pic.s = width;
+    job->s_info.i_width = width;
+    job->s_info.i_height = height;
+    if ((job->old_img = job_buffer(job, &(job->old_raw), &(job->old_size))) == NULL || (job->out_buf = job_buffer(job, &(job->out_raw), &(job->out_size))) == NULL)
     {
-        print_usage();
-        result = 1;
-        goto cleanup;
+        job_cleanup(job);
+        r = job_fail(job, AVS2SUP_ERROR, "Cannot allocate frame buffers.");
+        goto fail;
     }
-    in_img  = calloc(s_info->i_width * s_info->i_height * 4 + 16 * 2, sizeof(char)); /* allocate + 16 for alignment, and + n * 16 for over read/write */
-    old_img = calloc(s_info->i_width * s_info->i_height * 4 + 16 * 2, sizeof(char)); /* see above */
-    out_buf = calloc(s_info->i_width * s_info->i_height * 4 + 16 * 2, sizeof(char));
+    if (job->quant == NULL && (job->quant = new_quantizer()) == NULL)
+    {
+        job_cleanup(job);
+        r = job_fail(job, AVS2SUP_ERROR, "Cannot allocate palette quantizer.");
+        goto fail;
+    }
+    job->pic.b = job->out_buf;
+    job->n_crop = 1;
+    job->crops[0].x = 0;
+    job->crops[0].y = 0;
+    job->crops[0].w = width;
+    job->crops[0].h = height;
+    memset(job->png_refs, 0, sizeof(job->png_refs));
 
-    /* Check minimum size */
-    if (s_info->i_width < 8 || s_info->i_height < 8)
-    {
-        fprintf(stderr, "Error: Video dimensions below 8x8 (%dx%d).\n", s_info->i_width, s_info->i_height);
-        result = 1;
-        goto cleanup;
-    }
-
-    /* Align buffers */
-    in_img  = in_img + (short)(16 - ((long)in_img % 16));
-    old_img = old_img + (short)(16 - ((long)old_img % 16));
-    out_buf = out_buf + (short)(16 - ((long)out_buf % 16));
-
-    /* Set up buffer (non-)optimization */
-    buffer_opt = parse_int(buffer_optimize, "buffer-opt", NULL);
-    pic.b = out_buf;
-    pic.w = s_info->i_width;
-    pic.h = s_info->i_height;
-    pic.s = s_info->i_width;
-    n_crop = 1;
-    crops[0].x = 0;
-    crops[0].y = 0;
-    crops[0].w = pic.w;
-    crops[0].h = pic.h;
+    job->out_filename = strdup(name);
+    job->frames = job->count_frames;
+    job->next_frame = 0;
+    job->have_line = 0;
+    job->start_frame = -1;
+    job->first_frame = -1;
+    job->end_frame = -1;
+    job->num_of_events = 0;
 
-    /* Get frame number */
-    frames = get_frame_total_avis(avis_hnd);
-    if (count_frames + init_frame > frames)
+    /* Open SUP writer, if applicable */
+    if (job->sup_output)
     {
-        count_frames = frames - init_frame;
+        if (sink != NULL)
+            job->sw = new_sup_writer_sink(sink, width, height, fps_num, fps_den);
+        else
+            job->sw = new_sup_writer(job->out_filename, width, height, fps_num, fps_den);
+        if (job->sw == NULL)
+        {
+            job_cleanup(job);
+            return job_fail(job, AVS2SUP_ERROR, "Cannot create output file (%s).", name);
+        }
     }
-    last_frame = count_frames + init_frame;
 
-    /* No frames mean nothing to do */
-    if (count_frames < 1)
+    /* Start PNG writer threads and open XML writer, if applicable */
+    if (job->xml_output)
     {
-        fprintf(stderr, "No frames found.\n");
-        result = 0;
-        goto cleanup;
+        job->events = event_vec_new();
+        if (job->shared_png_pool == NULL)
+            job->png_pool = new_png_pool(0);
+        job->png_index = new_png_index();
+        if (sink != NULL)
+            job->xw = new_xml_writer_sink(sink, job->fps, job->frames, job->to, job->xo, job->yo, job->track_name, job->language, job->video_format, out_name, drop_frame);
+        else
+            job->xw = new_xml_writer(job->out_filename, job->fps, job->frames, job->to, job->xo, job->yo, job->track_name, job->language, job->video_format, out_name, drop_frame);
+        if (job->xw == NULL || job->xw->error)
+        {
+            job_cleanup(job);
+            return job_fail(job, AVS2SUP_ERROR, "Cannot create output file (%s).", name);
+        }
     }
 
-    /* Set progress step */
-    if (count_frames < 1000)
+    job->open = 1;
+    return AVS2SUP_OK;
+
+fail:
+    if (sink != NULL)
+        discard_sink(sink);
+    return r;
+}
+
+int avs2sup_job_open(avs2sup_job_t *job, const char *out_filename, int width, int height, const char *frame_rate)
+{
+    /* Output filename is required */
+    if (out_filename == NULL)
+        return job_fail(job, AVS2SUP_EINVAL, "An output filename is required.");
+
+    return job_open(job, out_filename, NULL, NULL, width, height, frame_rate);
+}
+
+int avs2sup_job_open_sink(avs2sup_job_t *job, sink_t *sink, const char *format, int width, int height, const char *frame_rate)
+{
+    if (sink == NULL || format == NULL)
     {
-        if (count_frames > 200)
-            progress_step = 50;
-        else if (count_frames > 50)
-            progress_step = 10;
-        else
-            progress_step = 1;
+        if (sink != NULL)
+            discard_sink(sink);
+        return job_fail(job, AVS2SUP_EINVAL, "A sink and its format are required.");
     }
 
-    /* Open SUP writer, if applicable */
-    if (sup_output)
-        sw = new_sup_writer(sup_output_fn, pic.w, pic.h, fps_num, fps_den);
+    return job_open(job, NULL, sink, format, width, height, frame_rate);
+}
 
-    /* Process frames */
-    for (i = init_frame; i <= last_frame; i++)
+void avs2sup_job_set_png_sinks(avs2sup_job_t *job, sink_t *(*open)(void *opaque, const char *name), void *opaque)
+{
+    job->png_sinks.dir = NULL;
+    job->png_sinks.open = open;
+    job->png_sinks.opaque = opaque;
+}
+
+/* Write the line shown since start_frame, ending before frame end */
+static void end_line(avs2sup_job_t *job, int end)
+{
+    int min_split = job->min_split ? job->min_split : 1;
+
+    if (job->sup_output)
+    {
+        assert(job->pal != NULL);
+        write_sup_wrapper(job->sw, (uint8_t *)job->out_buf, job->n_crop, job->crops, job->pal, job->start_frame + job->to, end + job->to, job->split_at, min_split, job->stricter, job->mark_forced);
+        free(job->pal);
+        job->pal = NULL;
+    }
+    if (job->xml_output)
+    {
+        add_event_xml(job->events, job->split_at, min_split, job->start_frame + job->to, end + job->to, job->n_crop, job->crops, job->png_refs, job->mark_forced);
+        write_xml_events(job->xw, job->events);
+    }
+    job->end_frame = end;
+    job->have_line = 0;
+}
+
+int avs2sup_job_push_frame(avs2sup_job_t *job, const void *bgra, int stride, int frame)
+{
+    const char *img = bgra;
+    int w = job->pic.w, h = job->pic.h;
+    int j;
+
+    if (!job->open)
+        return job_fail(job, AVS2SUP_EINVAL, "Job is not open.");
+    if (frame < job->next_frame)
+        return job_fail(job, AVS2SUP_EINVAL, "Frame %d pushed after frame %d.", frame, job->next_frame - 1);
+    if (job_stopped(job))
+    {
+        job_cleanup(job);
+        return AVS2SUP_STOPPED;
+    }
+    job->next_frame = frame + 1;
+
+    /* Duplicates and empty frames are checked in place */
+    if (job->have_line && is_identical_stride(w, h, img, stride, job->old_img))
+        return AVS2SUP_OK;
+    if (job->have_line)
     {
-        if(stopFlag)
+        end_line(job, frame);
+        if (job->xml_output && job->xw->error)
         {
-            result = 2;
-            goto cleanup;
+            j = job_fail(job, AVS2SUP_ERROR, "Error writing XML file (%s).", job->out_filename);
+            job_cleanup(job);
+            return j;
         }
-        if (read_frame_avis(in_img, avis_hnd, i))
+    }
+    if (is_empty_stride(w, h, img, stride))
+        return AVS2SUP_OK;
+
+    /* Not an empty frame, start line */
+    job->have_line = 1;
+    job->start_frame = frame;
+    copy_zero_transparent(w, h, img, stride, job->old_img);
+    swap_rb(&(job->s_info), job->old_img, job->out_buf);
+    if (job->buffer_opt)
+        job->n_crop = auto_split(job->pic, job->crops, job->ugly, job->even_y);
+    else if (job->autocrop)
+    {
+        job->crops[0].x = 0;
+        job->crops[0].y = 0;
+        job->crops[0].w = w;
+        job->crops[0].h = h;
+        auto_crop(job->pic, job->crops);
+    }
+    if ((job->buffer_opt || job->autocrop) && job->even_y)
+        enforce_even_y(job->crops, job->n_crop);
+    if ((job->pal_png || job->sup_output) && job->pal == NULL)
+        job->pal = palletize_with(job->quant, job->out_buf, w, h);
+    if (job->xml_output)
+    {
+        for (j = 0; j < job->n_crop; j++)
         {
-            fprintf(stderr, "Error reading frame.\n");
-            result = 1;
-            goto cleanup;
+            job->png_refs[j].file_id = frame;
+            job->png_refs[j].graphic = j;
+            if (!png_index_find(job->png_index, (uint8_t *)job->out_buf, w, job->pal, job->crops[j], &(job->png_refs[j]))
+                && png_pool_write(job->shared_png_pool != NULL ? job->shared_png_pool : job->png_pool, &(job->png_dest), frame, (uint8_t *)job->out_buf, w, h, j, job->pal, job->crops[j], NULL))
+            {
+                j = job_fail(job, AVS2SUP_ERROR, "Cannot write PNG files of %s.", job->out_filename);
+                job_cleanup(job);
+                return j;
+            }
         }
-        checked_empty = 0;
+        free(job->pal);
+        job->pal = NULL;
+    }
+    job->num_of_events++;
+    if (job->first_frame == -1)
+        job->first_frame = frame;
 
-        /* Progress indicator */
-        // if (i % (count_frames / progress_step) == 0)
-        // {
-        //     fprintf(stderr, "\rProgress: %d/%d - Lines: %d", i - init_frame, count_frames, num_of_events);
-        // }
-        progress_callback(i - init_frame);
-
-        /* If we are outside any lines, check for empty frames first */
-        if (!have_line)
+    return AVS2SUP_OK;
+}
+
+int avs2sup_job_finish(avs2sup_job_t *job)
+{
+    int auto_cut = 0;
+    int r;
+
+    if (!job->open)
+        return job_fail(job, AVS2SUP_EINVAL, "Job is not open.");
+    if (job_stopped(job))
+    {
+        job_cleanup(job);
+        return AVS2SUP_STOPPED;
+    }
+
+    /* Add last event, if available */
+    if (job->have_line)
+    {
+        end_line(job, job->next_frame);
+        auto_cut = 1;
+    }
+
+    if (job->sup_output)
+    {
+        r = close_sup_writer(job->sw);
+        job->sw = NULL;
+        if (r)
         {
-            if (is_empty(s_info, in_img))
-                continue;
-            else
-                checked_empty = 1;
+            r = job_fail(job, AVS2SUP_ERROR, "Error writing SUP/PGS file (%s).", job->out_filename);
+            job_cleanup(job);
+            return r;
         }
+    }
 
-        /* Check for duplicate, unless first frame */
-        if ((i != init_frame) && have_line && is_identical(s_info, in_img, old_img))
-            continue;
-        /* Mark frames that were not used as new image in comparison to have transparent pixels zeroed */
-        else if (!(i && have_line))
-            must_zero = 1;
+    /* Wait for outstanding PNG files */
+    if (job_png_wait(job))
+    {
+        r = job_fail(job, AVS2SUP_ERROR, "Cannot write PNG files of %s.", job->out_filename);
+        job_cleanup(job);
+        return r;
+    }
 
-        /* Not a dup, write end-of-line, if we had a line before */
-        if (have_line)
+    if (job->xml_output)
+    {
+        /* Check if we actually have any events */
+        if (job->first_frame == -1)
         {
-            if (sup_output)
+            if (!job->allow_empty)
             {
-                assert(pal != NULL);
-                write_sup_wrapper(sw, (uint8_t *)out_buf, n_crop, crops, pal, start_frame + to, i + to, split_at, min_split, stricter, mark_forced);
-                if (!xml_output)
-                    free(pal);
-                pal = NULL;
+                fprintf(stderr, "No events detected. Cowardly refusing to write XML file.\n");
+                job_cleanup(job);
+                return AVS2SUP_OK;
             }
-            if (xml_output)
-                add_event_xml(events, split_at, min_split, start_frame + to, i + to, n_crop, crops, mark_forced);
-            end_frame = i;
-            have_line = 0;
+            job->first_frame = 0;
+            job->end_frame = 0;
         }
 
-        /* Check for empty frame, if we didn't before */
-        if (!checked_empty && is_empty(s_info, in_img))
-            continue;
-
-        /* Zero transparent pixels, if needed */
-        if (must_zero)
-            zero_transparent(s_info, in_img);
-        must_zero = 0;
-
-        /* Not an empty frame, start line */
-        have_line = 1;
-        start_frame = i;
-        swap_rb(s_info, in_img, out_buf);
-        if (buffer_opt)
-            n_crop = auto_split(pic, crops, ugly, even_y);
-        else if (autocrop)
+        /* The length is only known now, unless it was given as count */
+        if (job->frames == INT_MAX)
         {
-            crops[0].x = 0;
-            crops[0].y = 0;
-            crops[0].w = pic.w;
-            crops[0].h = pic.h;
-            auto_crop(pic, crops);
+            job->xw->frames = job->next_frame;
+            job->xw->content_out = job->next_frame + job->to;
         }
-        if ((buffer_opt || autocrop) && even_y)
-            enforce_even_y(crops, n_crop);
-        if ((pal_png || sup_output) && pal == NULL)
-            pal = palletize(out_buf, s_info->i_width, s_info->i_height);
-        if (xml_output)
-            for (j = 0; j < n_crop; j++)
-                write_png(png_dir, start_frame, (uint8_t *)out_buf, s_info->i_width, s_info->i_height, j, pal, crops[j]);
-        if (pal_png && xml_output && !sup_output)
+
+        /* Write remaining events and header, then close XML file */
+        r = close_xml_writer(job->xw, job->events, job->first_frame + job->to, job->end_frame + job->to + auto_cut, job->num_of_events, auto_cut);
+        job->xw = NULL;
+        if (r)
         {
-            free(pal);
-            pal = NULL;
+            r = job_fail(job, AVS2SUP_ERROR, "Error writing XML file (%s).", job->out_filename);
+            job_cleanup(job);
+            return r;
         }
-        num_of_events++;
-        if (first_frame == -1)
-            first_frame = i;
+    }
+
+    job_cleanup(job);
+    return AVS2SUP_OK;
+}
+
+/* Convert avs_filename into one output per job, reading every frame only
+ * once. Seeking and counting follow the settings of the first job. On
+ * failure, all jobs are closed and the failing one has the reason.
+ */
+static int run_jobs(avs2sup_job_t **jobs, const char *const *out_filenames, int n, const char *avs_filename, int *frames_read, int verbose)
+{
+    avs2sup_job_t *job = jobs[0];
+    stream_info_t s_info;
+    avis_input_t *avis_hnd;
+    char *in_img;
+    int count_frames = job->count_frames, last_frame;
+    int init_frame = job->init_frame;
+    int frames, count;
+    int i, k, r = AVS2SUP_OK;
 
-        /* Save image for next comparison. */
-        tmp = in_img;
-        in_img = old_img;
-        old_img = tmp;
+    *frames_read = 0;
+    for (k = 0; k < n; k++)
+    {
+        jobs[k]->error[0] = 0;
+        if (jobs[k]->open)
+            return job_fail(jobs[k], AVS2SUP_EINVAL, "Job is already open.");
     }
+    for (k = 0; k < n; k++)
+        if (job_stopped(jobs[k]))
+            r = AVS2SUP_STOPPED;
+    if (r)
+    {
+        /* Nothing allocated yet, but the flags are reset like after a run */
+        for (k = 0; k < n; k++)
+            job_cleanup(jobs[k]);
+        return r;
+    }
+
+    /* Both input and output filenames are required */
+    for (k = 0; k < n; k++)
+        if (avs_filename == NULL || out_filenames[k] == NULL)
+            return job_fail(jobs[k], AVS2SUP_EINVAL, "Input and output filenames are required.");
+
+    /* Get video info */
+    if (open_file_avis((char *)avs_filename, &avis_hnd, &s_info))
+        return job_fail(job, AVS2SUP_ERROR, "Cannot open input file (%s).", avs_filename);
+
+    /* Get frame number */
+    frames = get_frame_total_avis(avis_hnd);
+    if (count_frames + init_frame > frames)
+        count_frames = frames - init_frame;
+    last_frame = count_frames + init_frame;
 
-    if(stopFlag)
+    /* No frames mean nothing to do */
+    if (count_frames < 1)
     {
-        result = 2;
-        goto cleanup;
+        close_file_avis(avis_hnd);
+        fprintf(stderr, "No frames found.\n");
+        return AVS2SUP_OK;
     }
 
-    fprintf(stderr, "\rProgress: %d/%d - Lines: %d - Done\n", i - init_frame, count_frames, num_of_events);
+    /* The XML file needs the length of the clip up front */
+    for (k = 0; k < n; k++)
+    {
+        count = jobs[k]->count_frames;
+        jobs[k]->count_frames = frames;
+        r = avs2sup_job_open(jobs[k], out_filenames[k], s_info.i_width, s_info.i_height, NULL);
+        jobs[k]->count_frames = count;
+        if (r)
+        {
+            while (k--)
+                job_cleanup(jobs[k]);
+            close_file_avis(avis_hnd);
+            return r;
+        }
+    }
+    job->avis_hnd = avis_hnd;
+    if ((in_img = job_buffer(job, &(job->in_raw), &(job->in_size))) == NULL)
+        r = job_fail(job, AVS2SUP_ERROR, "Cannot allocate frame buffers.");
 
-    /* Add last event, if available */
-    if (have_line)
+    /* Process frames */
+    for (i = init_frame; i < last_frame && !r; i++)
     {
-        if (sup_output)
+        if (read_frame_avis(in_img, job->avis_hnd, i))
         {
-            assert(pal != NULL);
-            write_sup_wrapper(sw, (uint8_t *)out_buf, n_crop, crops, pal, start_frame + to, i - 1 + to, split_at, min_split, stricter, mark_forced);
-            if (!xml_output)
-                free(pal);
-            pal = NULL;
+            r = job_fail(job, AVS2SUP_ERROR, "Error reading frame %d.", i);
+            break;
         }
-        if (xml_output)
+
+        /* Progress indicator */
+        if (job->progress != NULL)
+            job->progress(job->opaque, i - init_frame, count_frames);
+
+        for (k = 0; k < n && !r; k++)
+            r = avs2sup_job_push_frame(jobs[k], in_img, s_info.i_width * 4, i);
+        if (r)
+            break;
+    }
+    *frames_read = i - init_frame;
+    if (r)
+    {
+        for (k = 0; k < n; k++)
+            job_cleanup(jobs[k]);
+        return r;
+    }
+
+    if (verbose)
+        fprintf(stderr, "\rProgress: %d/%d - Lines: %d - Done\n", i - init_frame, count_frames, job->num_of_events);
+
+    /* Outputs are independent, so all of them are finished */
+    for (k = 0; k < n; k++)
+    {
+        i = avs2sup_job_finish(jobs[k]);
+        if (!r)
+            r = i;
+    }
+
+    return r;
+}
+
+int avs2sup_job_run(avs2sup_job_t *job, const char *avs_filename, const char *out_filename)
+{
+    int frames;
+
+    return run_jobs(&job, &out_filename, 1, avs_filename, &frames, 1);
+}
+
+/* Batches */
+
+typedef struct batch_entry_s
+{
+    avs2sup_job_t *settings;
+    char *avs_filename;
+    char **out_filenames;
+    int n_out;
+    int line;                     /* Of the manifest, or 0 */
+} batch_entry_t;
+
+STATIC_VECTOR(batch_entry, batch_entry_t)
+
+struct avs2sup_batch_s
+{
+    int threads;
+    int png_threads;
+    batch_entry_vec_t *entries;
+    pthread_mutex_t lock;         /* Guards next, stats and the report */
+    int next;                     /* First entry not started yet */
+    volatile int stop;
+    png_pool_t *png_pool;
+    avs2sup_batch_stats_t stats;
+};
+
+avs2sup_batch_t *avs2sup_batch_new(int threads, int png_threads)
+{
+    avs2sup_batch_t *batch = calloc(1, sizeof(avs2sup_batch_t));
+
+    if (batch == NULL)
+        return NULL;
+
+    batch->threads = threads < 1 ? get_cpu_count() : threads;
+    batch->png_threads = png_threads;
+    batch->entries = batch_entry_vec_new();
+    pthread_mutex_init(&batch->lock, NULL);
+
+    return batch;
+}
+
+int avs2sup_batch_add(avs2sup_batch_t *batch, const avs2sup_job_t *settings, const char *avs_filename, const char *const *out_filenames, int n_out)
+{
+    batch_entry_t *e;
+    int i;
+
+    if (avs_filename == NULL || out_filenames == NULL || n_out < 1)
+        return AVS2SUP_EINVAL;
+    for (i = 0; i < n_out; i++)
+        if (out_filenames[i] == NULL)
+            return AVS2SUP_EINVAL;
+
+    e = batch_entry_vec_append(batch->entries);
+    if ((e->settings = avs2sup_job_new()) == NULL)
+    {
+        batch_entry_vec_pop(batch->entries, NULL);
+        return AVS2SUP_ERROR;
+    }
+    if (settings != NULL)
+        job_copy_settings(e->settings, settings);
+    e->avs_filename = strdup(avs_filename);
+    e->out_filenames = calloc(n_out, sizeof(char *));
+    for (i = 0; i < n_out; i++)
+        e->out_filenames[i] = strdup(out_filenames[i]);
+    e->n_out = n_out;
+
+    return AVS2SUP_OK;
+}
+
+/* Split line into words at white space, keeping quoted parts together and
+ * dropping the quotes. Returns the number of words, or -1 if there are
+ * more than max.
+ */
+static int split_words(char *line, char **words, int max)
+{
+    char *in = line, *out = line;
+    int n = 0, quoted;
+
+    for (;;)
+    {
+        while (isspace((unsigned char)*in))
+            in++;
+        if (!*in || *in == '#')
+            return n;
+        if (n == max)
+            return -1;
+        words[n++] = out;
+        for (quoted = 0; *in && (quoted || !isspace((unsigned char)*in)); in++)
         {
-            add_event_xml(events, split_at, min_split, start_frame + to, i - 1 + to, n_crop, crops, mark_forced);
-            free(pal);
-            pal = NULL;
+            if (*in == '"')
+                quoted = !quoted;
+            else
+                *out++ = *in;
         }
-        auto_cut = 1;
-        end_frame = i - 1;
+        if (*in)
+            in++;
+        *out++ = 0;
     }
+}
 
-    if (sup_output)
+int avs2sup_batch_add_manifest(avs2sup_batch_t *batch, const avs2sup_job_t *defaults, const char *filename)
+{
+    avs2sup_job_t *settings, *line_settings;
+    char line[4096], *words[64], *files[64], *value;
+    FILE *fh;
+    int n, n_files, i, r = AVS2SUP_OK, line_no = 0;
+
+    if ((fh = fopen(filename, "r")) == NULL)
     {
-        close_sup_writer(sw);
+        fprintf(stderr, "Cannot open manifest (%s).\n", filename);
+        return AVS2SUP_EINVAL;
     }
+    settings = avs2sup_job_new();
+    line_settings = avs2sup_job_new();
+    if (settings == NULL || line_settings == NULL)
+    {
+        r = AVS2SUP_ERROR;
+        goto done;
+    }
+    if (defaults != NULL)
+        job_copy_settings(settings, defaults);
 
-    if (xml_output)
+    while (fgets(line, sizeof(line), fh) != NULL)
     {
-        /* Check if we actually have any events */
-        if (first_frame == -1)
+        line_no++;
+        if (strchr(line, '\n') == NULL && !feof(fh))
+        {
+            fprintf(stderr, "%s:%d: Line too long.\n", filename, line_no);
+            r = AVS2SUP_EINVAL;
+            goto done;
+        }
+        if ((n = split_words(line, words, 64)) < 0)
+        {
+            fprintf(stderr, "%s:%d: Too many words.\n", filename, line_no);
+            r = AVS2SUP_EINVAL;
+            goto done;
+        }
+
+        /* Words are files, or settings like language=eng */
+        job_copy_settings(line_settings, settings);
+        for (i = n_files = 0; i < n; i++)
         {
-            if (!allow_empty)
+            if ((value = strchr(words[i], '=')) == NULL)
             {
-                fprintf(stderr, "No events detected. Cowardly refusing to write XML file.\n");
-                result = 0;
-                goto cleanup;
+                files[n_files++] = words[i];
+                continue;
             }
-            else
+            *value++ = 0;
+            if (avs2sup_job_set(line_settings, words[i], value))
             {
-                first_frame = 0;
-                end_frame = 0;
+                fprintf(stderr, "%s:%d: Invalid setting (%s=%s).\n", filename, line_no, words[i], value);
+                r = AVS2SUP_EINVAL;
+                goto done;
             }
         }
 
-        /* Initialize timecode buffers */
-        intc_buf = calloc(12, 1);
-        outtc_buf = calloc(12, 1);
+        /* Settings on a line of their own apply to all lines below */
+        if (!n_files)
+            job_copy_settings(settings, line_settings);
+        else if (n_files == 1)
+        {
+            fprintf(stderr, "%s:%d: No output file for %s.\n", filename, line_no, files[0]);
+            r = AVS2SUP_EINVAL;
+            goto done;
+        }
+        else
+        {
+            if ((r = avs2sup_batch_add(batch, line_settings, files[0], (const char *const *)files + 1, n_files - 1)))
+                goto done;
+            batch_entry_vec_last(batch->entries)->line = line_no;
+        }
+    }
+
+done:
+    avs2sup_job_free(settings);
+    avs2sup_job_free(line_settings);
+    fclose(fh);
+    return r;
+}
+
+static void *batch_worker(void *arg)
+{
+    avs2sup_batch_t *batch = arg;
+    avs2sup_job_t **jobs = NULL;  /* Kept, with their buffers, for all entries */
+    int n_jobs = 0;
+    batch_entry_t *e;
+    double start, seconds;
+    int index, frames, lines;
+    int k, r;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&batch->lock);
+        index = batch->next++;
+        e = batch->stop ? NULL : batch_entry_vec_get(batch->entries, index);
+        pthread_mutex_unlock(&batch->lock);
+        if (e == NULL)
+            break;
 
-        /* Creating output file */
-        if ((fh = fopen(xml_output_fn, "w")) == 0)
+        if (n_jobs < e->n_out)
         {
-            perror("Error opening output XML file");
-            result = 1;
-            goto cleanup;
+            jobs = realloc(jobs, e->n_out * sizeof(avs2sup_job_t *));
+            for (; n_jobs < e->n_out; n_jobs++)
+                jobs[n_jobs] = avs2sup_job_new();
         }
+        for (k = 0; k < e->n_out; k++)
+        {
+            job_copy_settings(jobs[k], e->settings);
+            jobs[k]->shared_png_pool = batch->png_pool;
+            jobs[k]->also_stop = &batch->stop;
+        }
+
+        start = wall_clock();
+        r = run_jobs(jobs, (const char *const *)e->out_filenames, e->n_out, e->avs_filename, &frames, 0);
+        seconds = wall_clock() - start;
+        for (k = lines = 0; k < e->n_out && !r; k++)
+            lines += jobs[k]->num_of_events;
 
-        /* Write XML header */
-        mk_timecode(first_frame + to, fps, intc_buf);
-        mk_timecode(end_frame + to + auto_cut, fps, outtc_buf);
-        fprintf(fh, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-                    "<BDN Version=\"0.93\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\"\n"
-                    "xsi:noNamespaceSchemaLocation=\"BD-03-006-0093b BDN File Format.xsd\">\n"
-                    "<Description>\n"
-                    "<Name Title=\"%s\" Content=\"\"/>\n"
-                    "<Language Code=\"%s\"/>\n"
-                    "<Format VideoFormat=\"%s\" FrameRate=\"%s\" DropFrame=\"%s\"/>\n"
-                    "<Events LastEventOutTC=\"%s\" FirstEventInTC=\"%s\"\n", track_name, language, video_format, frame_rate, drop_frame, outtc_buf, intc_buf);
-
-        mk_timecode(0, fps, intc_buf);
-        mk_timecode(frames + to, fps, outtc_buf);
-        fprintf(fh, "ContentInTC=\"%s\" ContentOutTC=\"%s\" NumberofEvents=\"%d\" Type=\"Graphic\"/>\n"
-                    "</Description>\n"
-                    "<Events>\n", intc_buf, outtc_buf, num_of_events);
-
-        /* Write XML events */
-        if (!event_list_empty(events))
+        pthread_mutex_lock(&batch->lock);
+        batch->stats.inputs++;
+        batch->stats.outputs += e->n_out;
+        batch->stats.frames += frames;
+        batch->stats.lines += lines;
+        if (r == AVS2SUP_OK)
+            fprintf(stderr, "[%d/%d] %s: %d frames, %d lines, %.1f frames/s\n", index + 1, batch_entry_vec_len(batch->entries), e->avs_filename, frames, lines, frames / MAX(seconds, 0.001));
+        else if (r != AVS2SUP_STOPPED)
         {
-            event = event_list_first(events);
-            do
-            {
-                mk_timecode(event->start_frame, fps, intc_buf);
-                mk_timecode(event->end_frame, fps, outtc_buf);
-
-                if (auto_cut && event->end_frame == frames - 1)
-                {
-                    mk_timecode(event->end_frame + 1, fps, outtc_buf);
-                }
-
-                fprintf(fh, "<Event Forced=\"%s\" InTC=\"%s\" OutTC=\"%s\">\n", (event->forced ? "True" : "False"), intc_buf, outtc_buf);
-                for (i = 0; i < event->graphics; i++)
-                {
-                    fprintf(fh, "<Graphic Width=\"%d\" Height=\"%d\" X=\"%d\" Y=\"%d\">%08d_%d.png</Graphic>\n", event->c[i].w, event->c[i].h, xo + event->c[i].x, yo + event->c[i].y, event->image_number - to, i);
-                }
-                fprintf(fh, "</Event>\n");
-                event = event_list_next(events);
-            }
-            while (event != NULL);
+            batch->stats.failed++;
+            for (k = 0; k < e->n_out - 1 && !jobs[k]->error[0]; k++)
+                ;
+            fprintf(stderr, "[%d/%d] %s: Failed: %s\n", index + 1, batch_entry_vec_len(batch->entries), e->avs_filename, jobs[k]->error);
         }
+        pthread_mutex_unlock(&batch->lock);
+    }
+
+    for (k = 0; k < n_jobs; k++)
+        avs2sup_job_free(jobs[k]);
+    free(jobs);
+
+    return NULL;
+}
+
+int avs2sup_batch_run(avs2sup_batch_t *batch, avs2sup_batch_stats_t *stats)
+{
+    pthread_t *threads;
+    double start = wall_clock();
+    int n_threads = 0, n = batch_entry_vec_len(batch->entries);
+    int i;
+
+    memset(&batch->stats, 0, sizeof(batch->stats));
+    batch->next = batch->entries->head;
+
+    /* PNG files of all XML outputs share one pool */
+    batch->png_pool = new_png_pool(batch->png_threads);
+
+    /* There is no point in more threads than inputs, and without any, the
+     * calling thread does the work.
+     */
+    threads = calloc(MIN(batch->threads, n), sizeof(pthread_t));
+    for (i = 0; i < MIN(batch->threads, n); i++)
+    {
+        if (pthread_create(&(threads[n_threads]), NULL, batch_worker, batch))
+        {
+            fprintf(stderr, "Cannot start batch thread, running %d at once.\n", MAX(n_threads, 1));
+            break;
+        }
+        n_threads++;
+    }
+    if (!n_threads)
+        batch_worker(batch);
+    for (i = 0; i < n_threads; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+
+    close_png_pool(batch->png_pool);
+    batch->png_pool = NULL;
+
+    batch->stats.seconds = wall_clock() - start;
+    fprintf(stderr, "Batch: %d inputs (%d failed), %d outputs, %lld frames, %lld lines in %.1f s - %.1f frames/s\n",
+            batch->stats.inputs, batch->stats.failed, batch->stats.outputs, batch->stats.frames, batch->stats.lines,
+            batch->stats.seconds, batch->stats.frames / MAX(batch->stats.seconds, 0.001));
+    if (stats != NULL)
+        *stats = batch->stats;
+
+    if (batch->stop)
+        return AVS2SUP_STOPPED;
+    return batch->stats.failed ? AVS2SUP_ERROR : AVS2SUP_OK;
+}
+
+void avs2sup_batch_stop(avs2sup_batch_t *batch)
+{
+    batch->stop = 1;
+}
 
-        /* Write XML footer */
-        fprintf(fh, "</Events>\n</BDN>\n");
+void avs2sup_batch_free(avs2sup_batch_t *batch)
+{
+    batch_entry_t *e;
+    int i;
+
+    if (batch == NULL)
+        return;
 
-        /* Close XML file */
-        fclose(fh);
+    while ((e = batch_entry_vec_last(batch->entries)) != NULL)
+    {
+        avs2sup_job_free(e->settings);
+        free(e->avs_filename);
+        for (i = 0; i < e->n_out; i++)
+            free(e->out_filenames[i]);
+        free(e->out_filenames);
+        batch_entry_vec_pop(batch->entries, NULL);
     }
+    batch_entry_vec_destroy(batch->entries);
+    pthread_mutex_destroy(&batch->lock);
+    free(batch);
+}
+
+/* The older interface runs one job at a time */
+static ProgressCallback progress_callback = NULL;  // 保存回调函数指针
+static volatile int stopFlag = 0;
+
+static void legacy_progress(void *opaque, int progress, int frames)
+{
+    if (progress_callback != NULL)
+        progress_callback(progress);
+}
+
+void avs2sup_reg_callback(ProgressCallback callback)
+{
+    progress_callback = callback;
+}
 
-    /* Cleanup */
-    close_file_avis(avis_hnd);
+int avs2sup_process(const char* avs_filename, const char* outFileName, const char* language, const char* video_format, const char* frame_rate)
+{
+    avs2sup_job_t *job;
+    int result;
 
-    /* Give runtime */
-    if (0)
-        fprintf(stderr, "Time elapsed: %lld\n", time(NULL) - bench_start);
+    if (stopFlag)
+    {
+        stopFlag = 0;
+        return AVS2SUP_STOPPED;
+    }
+    if ((job = avs2sup_job_new()) == NULL)
+        return AVS2SUP_ERROR;
 
-    result = 0;
-    goto cleanup;
+    if ((language != NULL && avs2sup_job_set(job, "language", language))
+        || (video_format != NULL && avs2sup_job_set(job, "video-format", video_format))
+        || (frame_rate != NULL && avs2sup_job_set(job, "fps", frame_rate)))
+    {
+        avs2sup_job_free(job);
+        return AVS2SUP_EINVAL;
+    }
+    avs2sup_job_set_progress(job, legacy_progress, NULL);
+    job->also_stop = &stopFlag;
 
+    result = avs2sup_job_run(job, avs_filename, outFileName);
 
-cleanup:
+    avs2sup_job_free(job);
     stopFlag = 0;
     return result;
 }
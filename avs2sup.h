@@ -1,8 +1,134 @@
 #ifndef AVS2SUP_H
 #define AVS2SUP_H
+#include "sink.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
+
+/* Return codes of avs2sup_job_run and avs2sup_process */
+#define AVS2SUP_OK       0
+#define AVS2SUP_EINVAL  -1  /* Bad filenames or settings */
+#define AVS2SUP_ERROR    1  /* Input or output failed, see avs2sup_job_error */
+#define AVS2SUP_STOPPED  2  /* avs2sup_job_stop was called */
+
+/* All state of one conversion. Jobs share nothing, so several of them may
+ * run at the same time on different threads.
+ */
+typedef struct avs2sup_job_s avs2sup_job_t;
+
+/* Called from the thread running the job, with the number of frames done */
+typedef void (*avs2sup_progress_t)(void *opaque, int progress, int frames);
+
+avs2sup_job_t *avs2sup_job_new(void);
+
+/* Change a setting, named like the long options of avs2bdnxml, e.g.
+ * ("fps", "23.976") or ("split-at", "0"). Returns AVS2SUP_EINVAL for
+ * unknown names and values that are not integers where one is expected.
+ */
+int avs2sup_job_set(avs2sup_job_t *job, const char *name, const char *value);
+
+void avs2sup_job_set_progress(avs2sup_job_t *job, avs2sup_progress_t callback, void *opaque);
+
+/* Convert avsFile into outFileName, which may end in .sup, .pgs or .xml */
+int avs2sup_job_run(avs2sup_job_t *job, const char *avsFile, const char *outFileName);
+
+/* Frames rendered by the host can be pushed instead, with the same change
+ * detection and encoding as avs2sup_job_run. frame_rate is named like the
+ * "fps" setting, which is used when it is NULL.
+ */
+int avs2sup_job_open(avs2sup_job_t *job, const char *outFileName, int width, int height, const char *frame_rate);
+
+/* Same for output to a sink (see sink.h) instead of a file, with format
+ * "sup", "pgs" or "xml". The sink belongs to the job from now on, and is
+ * discarded if opening fails or the job does not finish. XML output needs
+ * avs2sup_job_set_png_sinks.
+ */
+int avs2sup_job_open_sink(avs2sup_job_t *job, sink_t *sink, const char *format, int width, int height, const char *frame_rate);
+
+/* Have open create the sinks for PNG files, named like 00000012_0.png,
+ * instead of writing them next to the XML file. open is called from PNG
+ * writer threads and must return NULL on failure.
+ */
+void avs2sup_job_set_png_sinks(avs2sup_job_t *job, sink_t *(*open)(void *opaque, const char *name), void *opaque);
+
+/* Push the frame with number frame, as B, G, R, A bytes like AviSynth RGB32
+ * frames, with rows stride bytes apart. Frame numbers must increase, the
+ * picture of skipped frames is that of the frame pushed before. bgra is
+ * only read during the call, and only copied when the picture changes.
+ */
+int avs2sup_job_push_frame(avs2sup_job_t *job, const void *bgra, int stride, int frame);
+
+/* Write the last line, ending after the last pushed frame, and close the
+ * output. After an error from push or finish, the job is closed already.
+ */
+int avs2sup_job_finish(avs2sup_job_t *job);
+
+/* Make a running job return AVS2SUP_STOPPED soon. May be called from any
+ * thread, also before avs2sup_job_run, which then returns right away.
+ */
+void avs2sup_job_stop(avs2sup_job_t *job);
+
+/* Reason for the last failure of avs2sup_job_run, or "" */
+const char *avs2sup_job_error(avs2sup_job_t *job);
+
+/* Settings stay with the job, and so do its frame buffers, which are used
+ * again by the next run with frames of the same or a smaller size.
+ */
+void avs2sup_job_free(avs2sup_job_t *job);
+
+/* A batch converts many inputs on a number of threads, each with at most
+ * one AviSynth instance open. Each input is read once for all its outputs.
+ * Threads keep their frame buffers and palette quantizers from one input to
+ * the next, and the PNG files of all XML outputs share one pool of writer
+ * threads.
+ */
+typedef struct avs2sup_batch_s avs2sup_batch_t;
+
+typedef struct avs2sup_batch_stats_s
+{
+    int inputs;                   /* Inputs converted or failed */
+    int failed;
+    int outputs;
+    long long frames;             /* Frames read from all inputs */
+    long long lines;              /* Lines written to all outputs */
+    double seconds;               /* Time taken by avs2sup_batch_run */
+} avs2sup_batch_stats_t;
+
+/* threads < 1 selects the CPU count, png_threads like in new_png_pool */
+avs2sup_batch_t *avs2sup_batch_new(int threads, int png_threads);
+
+/* Queue avsFile to be converted into n_out files, with the settings of job,
+ * or the defaults if it is NULL. The strings and settings are copied.
+ */
+int avs2sup_batch_add(avs2sup_batch_t *batch, const avs2sup_job_t *settings, const char *avsFile, const char *const *outFileNames, int n_out);
+
+/* Queue the inputs listed in a manifest file, one per line, followed by
+ * their outputs and settings named like in avs2sup_job_set:
+ *
+ *   # Settings on a line of their own apply to all lines below
+ *   fps=23.976 video-format=1080p
+ *   ep01.avs ep01_eng.sup ep01_eng.xml language=eng
+ *   "ep 02.avs" "ep 02.sup" language=eng trackname="English Subtitles"
+ *
+ * Words containing a '=' are settings, defaults supplies those in effect
+ * at the start and may be NULL. Reports problems with their line number.
+ */
+int avs2sup_batch_add_manifest(avs2sup_batch_t *batch, const avs2sup_job_t *defaults, const char *filename);
+
+/* Convert all queued inputs. Prints a line per input and a throughput
+ * report, which is also stored in stats if that is not NULL. Returns
+ * AVS2SUP_ERROR if any input failed.
+ */
+int avs2sup_batch_run(avs2sup_batch_t *batch, avs2sup_batch_stats_t *stats);
+
+/* Make a running batch skip the remaining inputs and stop the running ones */
+void avs2sup_batch_stop(avs2sup_batch_t *batch);
+
+void avs2sup_batch_free(avs2sup_batch_t *batch);
+
+/* Older single job interface, kept for existing hosts. It is not
+ * reentrant, use the job functions above to run conversions in parallel.
+ */
 typedef void (*ProgressCallback)(int progress);
 
 // 注册回调函数
@@ -0,0 +1,494 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <ctype.h>
+#include <png.h>
+#include "bdn_input.h"
+#include "auto_split.h"
+#include "abstract_vectors.h"
+
+STATIC_VECTOR(bdn_event, bdn_event_t)
+STATIC_VECTOR(bdn_png, bdn_png_t)
+
+typedef struct video_format_s
+{
+	char *name;
+	int w;
+	int h;
+} video_format_t;
+
+static video_format_t video_formats[] =
+	{ {"1080p", 1920, 1080}
+	, {"1080i", 1920, 1080}
+	, {"720p", 1280, 720}
+	, {"576p", 720, 576}
+	, {"576i", 720, 576}
+	, {"480p", 720, 480}
+	, {"480i", 720, 480}
+	, {NULL, 0, 0}
+	};
+
+int bdn_video_size (char *video_format, int *w, int *h)
+{
+	int i;
+
+	for (i = 0; video_formats[i].name != NULL; i++)
+		if (!strcmp(video_formats[i].name, video_format))
+		{
+			*w = video_formats[i].w;
+			*h = video_formats[i].h;
+			return 1;
+		}
+
+	return 0;
+}
+
+/* Find a tag by name, not matching longer names like Events for Event */
+static char *find_tag (char *p, char *end, char *name)
+{
+	int len = strlen(name);
+
+	while ((p = strstr(p, name)) != NULL && p < end)
+	{
+		p += len;
+		if (isspace((unsigned char)*p) || *p == '>' || *p == '/')
+			return p;
+	}
+
+	return NULL;
+}
+
+/* Copy the value of an attribute within the tag ending at end */
+static int get_attr (char *tag, char *end, char *name, char *out, int size)
+{
+	int len = strlen(name), i;
+	char *p = tag;
+
+	while ((p = strstr(p, name)) != NULL && p < end)
+	{
+		if (isspace((unsigned char)p[-1]) && p[len] == '=' && p[len + 1] == '"')
+		{
+			p += len + 2;
+			for (i = 0; i < size - 1 && p[i] && p[i] != '"'; i++)
+				out[i] = p[i];
+			out[i] = 0;
+			return 1;
+		}
+		p += len;
+	}
+
+	return 0;
+}
+
+static int parse_bdn_tc (char *tc, int fps, int *frame)
+{
+	int h, m, s, f;
+
+	if (sscanf(tc, "%d:%d:%d:%d", &h, &m, &s, &f) != 4)
+		return 0;
+	*frame = ((h * 60 + m) * 60 + s) * fps + f;
+
+	return 1;
+}
+
+static unsigned int hash_name (char *name)
+{
+	unsigned int h = 2166136261u;
+
+	for (; *name; name++)
+		h = (h ^ (unsigned char)*name) * 16777619u;
+
+	return h % BDN_HASH_SIZE;
+}
+
+/* Index of the PNG file, added on first use */
+static int intern_png (bdn_input_t *b, char *filename)
+{
+	unsigned int h = hash_name(filename);
+	bdn_png_t *p;
+	int i;
+
+	for (i = b->hash[h]; i >= 0; i = p->next)
+	{
+		p = bdn_png_vec_get(b->pngs, i);
+		if (!strcmp(p->filename, filename))
+		{
+			p->refs++;
+			return i;
+		}
+	}
+
+	p = bdn_png_vec_append(b->pngs);
+	p->filename = strdup(filename);
+	p->refs = 1;
+	p->next = b->hash[h];
+	b->hash[h] = b->pngs->tail - 1;
+
+	return b->hash[h];
+}
+
+static int compare_events (const void *a, const void *b)
+{
+	return ((bdn_event_t *)a)->start - ((bdn_event_t *)b)->start;
+}
+
+static char *read_file (char *filename)
+{
+	FILE *fh;
+	char *buf;
+	long size;
+
+	if ((fh = fopen(filename, "rb")) == NULL)
+		return NULL;
+	fseek(fh, 0, SEEK_END);
+	size = ftell(fh);
+	fseek(fh, 0, SEEK_SET);
+	buf = malloc(size + 1);
+	if (fread(buf, 1, size, fh) != (size_t)size)
+	{
+		free(buf);
+		fclose(fh);
+		return NULL;
+	}
+	buf[size] = 0;
+	fclose(fh);
+
+	return buf;
+}
+
+static int parse_events (bdn_input_t *b, char *xml, char *dir, int fps)
+{
+	char path[4096], value[32], *p, *end, *tag_end, *ev_end, *g, *name, *name_end;
+	bdn_event_t *ev;
+	int len;
+
+	p = xml;
+	end = xml + strlen(xml);
+	while ((p = find_tag(p, end, "<Event")) != NULL)
+	{
+		if ((tag_end = strchr(p, '>')) == NULL || (ev_end = strstr(tag_end, "</Event>")) == NULL)
+			return 0;
+
+		ev = bdn_event_vec_append(b->events);
+		if (!get_attr(p, tag_end, "InTC", value, sizeof(value)) || !parse_bdn_tc(value, fps, &(ev->start)))
+			return 0;
+		if (!get_attr(p, tag_end, "OutTC", value, sizeof(value)) || !parse_bdn_tc(value, fps, &(ev->end)))
+			return 0;
+		ev->forced = get_attr(p, tag_end, "Forced", value, sizeof(value)) && !strcasecmp(value, "True");
+
+		/* Graphics of this event */
+		g = tag_end;
+		while ((g = find_tag(g, ev_end, "<Graphic")) != NULL && g < ev_end)
+		{
+			if ((tag_end = strchr(g, '>')) == NULL || (name_end = strstr(tag_end, "</Graphic>")) == NULL)
+				return 0;
+			if (ev->graphics == 2)
+			{
+				fprintf(stderr, "Warning: Ignoring more than two graphics in event at frame %d.\n", ev->start);
+				break;
+			}
+			if (!get_attr(g, tag_end, "X", value, sizeof(value)))
+				return 0;
+			ev->g[ev->graphics].x = atoi(value);
+			if (!get_attr(g, tag_end, "Y", value, sizeof(value)))
+				return 0;
+			ev->g[ev->graphics].y = atoi(value);
+
+			for (name = tag_end + 1; isspace((unsigned char)*name); name++)
+				;
+			while (name_end > name && isspace((unsigned char)name_end[-1]))
+				name_end--;
+			len = name_end - name;
+			if (strlen(dir) + len + 1 > sizeof(path))
+				return 0;
+			strcpy(path, dir);
+			strncat(path, name, len);
+			ev->g[ev->graphics].png = intern_png(b, path);
+			ev->graphics++;
+			g = tag_end;
+		}
+
+		b->frames = MAX(b->frames, ev->end + 1);
+		p = ev_end;
+	}
+
+	return 1;
+}
+
+bdn_input_t *open_bdn_input (char *filename)
+{
+	char value[32], dir[4096], *xml, *p, *tag_end, *slash;
+	bdn_input_t *b;
+	int fps, i;
+
+	if ((xml = read_file(filename)) == NULL)
+	{
+		fprintf(stderr, "Couldn't read BDN XML file (%s): ", filename);
+		perror(NULL);
+		return NULL;
+	}
+
+	b = calloc(1, sizeof(bdn_input_t));
+	b->events = bdn_event_vec_new();
+	b->pngs = bdn_png_vec_new();
+	for (i = 0; i < BDN_HASH_SIZE; i++)
+		b->hash[i] = -1;
+
+	/* Frame rate and video format */
+	if ((p = find_tag(xml, xml + strlen(xml), "<Format")) == NULL || (tag_end = strchr(p, '>')) == NULL)
+	{
+		fprintf(stderr, "No Format tag found in BDN XML file (%s).\n", filename);
+		goto fail;
+	}
+	if (!get_attr(p, tag_end, "FrameRate", b->frame_rate, sizeof(b->frame_rate)) || (fps = (int)(atof(b->frame_rate) + 0.5)) <= 0)
+	{
+		fprintf(stderr, "Invalid FrameRate in BDN XML file (%s).\n", filename);
+		goto fail;
+	}
+	value[0] = 0;
+	get_attr(p, tag_end, "VideoFormat", value, sizeof(value));
+	if (!bdn_video_size(value, &(b->im_w), &(b->im_h)))
+	{
+		fprintf(stderr, "Invalid VideoFormat in BDN XML file (%s).\n", filename);
+		goto fail;
+	}
+
+	/* PNG files are relative to the XML file */
+	strncpy(dir, filename, sizeof(dir) - 1);
+	dir[sizeof(dir) - 1] = 0;
+	if ((slash = strrchr(dir, '/')) == NULL || (strrchr(dir, '\\') != NULL && strrchr(dir, '\\') > slash))
+		slash = strrchr(dir, '\\');
+	if (slash != NULL)
+		slash[1] = 0;
+	else
+		dir[0] = 0;
+
+	if (!parse_events(b, xml, dir, fps))
+	{
+		fprintf(stderr, "Broken event in BDN XML file (%s).\n", filename);
+		goto fail;
+	}
+	qsort(b->events->items + b->events->head, bdn_event_vec_len(b->events), sizeof(bdn_event_t), compare_events);
+
+	free(xml);
+	return b;
+
+fail:
+	free(xml);
+	close_bdn_input(b);
+	return NULL;
+}
+
+int bdn_input_events (bdn_input_t *b)
+{
+	return bdn_event_vec_len(b->events);
+}
+
+static void load_png (bdn_png_t *p)
+{
+	FILE *fh;
+	png_structp png_ptr;
+	png_infop info_ptr;
+	png_bytep *row_pointers;
+	int color_type, depth, i;
+
+	if ((fh = fopen(p->filename, "rb")) == NULL)
+	{
+		fprintf(stderr, "Cannot open PNG file (%s): ", p->filename);
+		perror(NULL);
+		exit(1);
+	}
+
+	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (png_ptr == NULL)
+	{
+		fprintf(stderr, "Cannot create png_ptr.\n");
+		exit(1);
+	}
+	info_ptr = png_create_info_struct(png_ptr);
+	if (info_ptr == NULL)
+	{
+		png_destroy_read_struct(&png_ptr, NULL, NULL);
+		fprintf(stderr, "Cannot create info_ptr.\n");
+		exit(1);
+	}
+	if (setjmp(png_jmpbuf(png_ptr)))
+	{
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		fprintf(stderr, "Error while reading PNG file (%s).\n", p->filename);
+		exit(1);
+	}
+
+	png_init_io(png_ptr, fh);
+	png_read_info(png_ptr, info_ptr);
+	p->w = png_get_image_width(png_ptr, info_ptr);
+	p->h = png_get_image_height(png_ptr, info_ptr);
+	color_type = png_get_color_type(png_ptr, info_ptr);
+	depth = png_get_bit_depth(png_ptr, info_ptr);
+
+	/* Convert everything to 8bit B, G, R, A */
+	if (color_type == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb(png_ptr);
+	if (color_type == PNG_COLOR_TYPE_GRAY && depth < 8)
+		png_set_expand_gray_1_2_4_to_8(png_ptr);
+	if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+		png_set_tRNS_to_alpha(png_ptr);
+	if (depth == 16)
+		png_set_strip_16(png_ptr);
+	if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+		png_set_gray_to_rgb(png_ptr);
+	png_set_filler(png_ptr, 0xff, PNG_FILLER_AFTER);
+	png_set_bgr(png_ptr);
+	png_read_update_info(png_ptr, info_ptr);
+
+	p->im = malloc(p->w * p->h * 4);
+	row_pointers = malloc(p->h * sizeof(png_bytep));
+	for (i = 0; i < p->h; i++)
+		row_pointers[i] = p->im + i * p->w * 4;
+	png_read_image(png_ptr, row_pointers);
+	png_read_end(png_ptr, NULL);
+
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+	free(row_pointers);
+	fclose(fh);
+}
+
+/* Draw n B, G, R, A pixels over dst, so what lies under transparent and
+ * translucent pixels of src still shows.
+ */
+static void blend_row (uint8_t *dst, const uint8_t *src, int n)
+{
+	int a, da, oa, c;
+
+	for (; n > 0; n--, dst += 4, src += 4)
+	{
+		a = src[3];
+		da = dst[3];
+		if (a == 0)
+			continue;
+		if (a == 255 || da == 0)
+		{
+			memcpy(dst, src, 4);
+			continue;
+		}
+
+		/* Source over destination, both with straight alpha */
+		da = da * (255 - a);
+		oa = a * 255 + da;
+		for (c = 0; c < 3; c++)
+			dst[c] = (src[c] * a * 255 + dst[c] * da + oa / 2) / oa;
+		dst[3] = (oa + 127) / 255;
+	}
+}
+
+static void render_event (bdn_input_t *b, uint8_t *im, bdn_event_t *ev)
+{
+	bdn_png_t *p;
+	int i, y, x0, x1;
+
+	for (i = 0; i < ev->graphics; i++)
+	{
+		p = bdn_png_vec_get(b->pngs, ev->g[i].png);
+		if (p->im == NULL)
+		{
+			load_png(p);
+			b->loaded++;
+		}
+
+		x0 = MAX(0, -ev->g[i].x);
+		x1 = MIN(p->w, b->im_w - ev->g[i].x);
+		if (x1 <= x0)
+			continue;
+		for (y = MAX(0, -ev->g[i].y); y < p->h && ev->g[i].y + y < b->im_h; y++)
+			blend_row(im + ((ev->g[i].y + y) * b->im_w + ev->g[i].x + x0) * 4, p->im + (y * p->w + x0) * 4, x1 - x0);
+	}
+}
+
+/* Free PNG files no later event needs */
+static void release_event (bdn_input_t *b, bdn_event_t *ev)
+{
+	bdn_png_t *p;
+	int i;
+
+	for (i = 0; i < ev->graphics; i++)
+	{
+		p = bdn_png_vec_get(b->pngs, ev->g[i].png);
+		if (!--(p->refs))
+		{
+			free(p->im);
+			p->im = NULL;
+		}
+	}
+}
+
+int bdn_input_frame (bdn_input_t *b, uint8_t *im, int frame)
+{
+	bdn_event_t *ev;
+	int i, next = INT_MAX;
+
+	/* Events may overlap, so the ones started so far can end in any order */
+	while ((ev = bdn_event_vec_get(b->events, b->next)) != NULL && ev->start <= frame)
+		b->next++;
+	if (ev != NULL)
+		next = ev->start;
+
+	memset(im, 0, b->im_w * b->im_h * 4);
+	b->forced = 0;
+	for (i = b->cur; i < b->next; i++)
+	{
+		ev = bdn_event_vec_get(b->events, i);
+		if (ev->over)
+			continue;
+		if (ev->end <= frame)
+		{
+			release_event(b, ev);
+			ev->over = 1;
+			continue;
+		}
+
+		/* Later events are drawn on top */
+		render_event(b, im, ev);
+		b->forced |= ev->forced;
+		next = MIN(next, ev->end);
+	}
+	while ((ev = bdn_event_vec_get(b->events, b->cur)) != NULL && ev->over)
+		b->cur++;
+
+	return next;
+}
+
+void close_bdn_input (bdn_input_t *b)
+{
+	bdn_png_t *p;
+	int i;
+
+	for (i = b->pngs->head; i < b->pngs->tail; i++)
+	{
+		p = bdn_png_vec_get(b->pngs, i);
+		free(p->filename);
+		free(p->im);
+	}
+	bdn_png_vec_destroy(b->pngs);
+	bdn_event_vec_destroy(b->events);
+	free(b);
+}
@@ -0,0 +1,95 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef BDN_INPUT_H
+#define BDN_INPUT_H
+
+#include <stdint.h>
+
+#define BDN_HASH_SIZE 4096
+
+typedef struct bdn_graphic_s
+{
+	int x;
+	int y;
+	int png;            /* Index into pngs */
+} bdn_graphic_t;
+
+typedef struct bdn_event_s
+{
+	int start;          /* InTC and OutTC in frames */
+	int end;
+	int forced;
+	int over;           /* Ended and released */
+	int graphics;
+	bdn_graphic_t g[2];
+} bdn_event_t;
+
+/* Every PNG file is decoded once, when it is first shown, and freed after
+ * the last event referencing it.
+ */
+typedef struct bdn_png_s
+{
+	char *filename;
+	int refs;           /* Events not yet shown */
+	int next;           /* Hash chain, -1 terminated */
+	int w;
+	int h;
+	uint8_t *im;        /* B, G, R, A, NULL if not loaded */
+} bdn_png_t;
+
+struct bdn_event_vec_s;
+struct bdn_png_vec_s;
+
+/* Reads a BDN XML file and its PNG files, for use in place of an AviSynth
+ * clip. Only frames on which an event starts or ends are rendered.
+ */
+typedef struct bdn_input_s
+{
+	int im_w;
+	int im_h;
+	char frame_rate[16];
+	int frames;         /* One past the end of the last event */
+	int cur;            /* First event not over yet */
+	int next;           /* First event not started yet */
+	int loaded;         /* PNG files decoded so far */
+	int forced;         /* An event currently shown is forced */
+	struct bdn_event_vec_s *events;
+	struct bdn_png_vec_s *pngs;
+	int hash[BDN_HASH_SIZE];
+} bdn_input_t;
+
+/* Parse a BDN XML file. Returns NULL and prints the reason on failure. */
+bdn_input_t *open_bdn_input (char *filename);
+
+/* Frame size for a BDN VideoFormat like 1080p. Returns 0 if unknown. */
+int bdn_video_size (char *video_format, int *w, int *h);
+
+/* Number of events */
+int bdn_input_events (bdn_input_t *b);
+
+/* Render the picture shown at frame into im, as B, G, R, A bytes like
+ * AviSynth RGB32 frames. All events shown at frame are blended by alpha, in
+ * order of their InTC. Frames must be requested in increasing order.
+ * Returns the next frame on which the picture may change, or INT_MAX.
+ */
+int bdn_input_frame (bdn_input_t *b, uint8_t *im, int frame);
+
+void close_bdn_input (bdn_input_t *b);
+
+#endif
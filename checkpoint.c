@@ -0,0 +1,168 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checkpoint.h"
+
+static void put32 (FILE *fh, uint32_t x)
+{
+	uint8_t b[4] = {x, x >> 8, x >> 16, x >> 24};
+
+	fwrite(b, 1, 4, fh);
+}
+
+static void put64 (FILE *fh, uint64_t x)
+{
+	put32(fh, x);
+	put32(fh, x >> 32);
+}
+
+static uint32_t get32 (FILE *fh, int *bad)
+{
+	uint8_t b[4];
+
+	if (fread(b, 1, 4, fh) != 4)
+	{
+		*bad = 1;
+		return 0;
+	}
+	return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static uint64_t get64 (FILE *fh, int *bad)
+{
+	uint64_t x = get32(fh, bad);
+
+	return x | (uint64_t)get32(fh, bad) << 32;
+}
+
+int write_checkpoint (const char *filename, const char *identity, checkpoint_t *cp)
+{
+	char *tmp = malloc(strlen(filename) + 5);
+	FILE *fh;
+	int r = 0;
+
+	/* Written next to it first, so a crash leaves the last one intact */
+	sprintf(tmp, "%s.tmp", filename);
+	if ((fh = fopen(tmp, "wb")) == NULL)
+	{
+		perror("Error opening checkpoint");
+		free(tmp);
+		return -1;
+	}
+	fwrite(CHECKPOINT_MAGIC, 1, 4, fh);
+	put32(fh, CHECKPOINT_VERSION);
+	put32(fh, strlen(identity));
+	fwrite(identity, 1, strlen(identity), fh);
+	put32(fh, cp->frame);
+	put32(fh, cp->first_frame);
+	put32(fh, cp->end_frame);
+	put32(fh, cp->num_of_events);
+	put64(fh, cp->xml_size);
+	put64(fh, cp->sup.offset);
+	put32(fh, cp->sup.comp_num);
+	put32(fh, cp->sup.end);
+	put32(fh, cp->sup.follower_end);
+	put32(fh, cp->sup.epochs);
+	put32(fh, cp->sup.epoch_end_ts);
+	put32(fh, cp->sup.index_len);
+	if (cp->sup.index_len)
+		fwrite(cp->sup.index, 1, cp->sup.index_len, fh);
+	if (ferror(fh) | fclose(fh))
+	{
+		perror("Error writing checkpoint");
+		r = -1;
+	}
+	else
+	{
+#ifdef _WIN32
+		remove(filename);
+#endif
+		if (rename(tmp, filename))
+		{
+			perror("Error replacing checkpoint");
+			r = -1;
+		}
+	}
+	if (r)
+		remove(tmp);
+	free(tmp);
+
+	return r;
+}
+
+int read_checkpoint (const char *filename, const char *identity, checkpoint_t *cp)
+{
+	FILE *fh;
+	char magic[4], *id;
+	int len, bad = 0;
+
+	memset(cp, 0, sizeof(checkpoint_t));
+	if ((fh = fopen(filename, "rb")) == NULL)
+	{
+		fprintf(stderr, "No checkpoint %s to resume from.\n", filename);
+		return -1;
+	}
+	if (fread(magic, 1, 4, fh) != 4 || memcmp(magic, CHECKPOINT_MAGIC, 4) || get32(fh, &bad) != CHECKPOINT_VERSION)
+	{
+		fprintf(stderr, "%s is not a checkpoint of this version.\n", filename);
+		fclose(fh);
+		return -1;
+	}
+	len = get32(fh, &bad);
+	id = malloc(strlen(identity) + 1);
+	if (bad || len != (int)strlen(identity) || fread(id, 1, len, fh) != (size_t)len || memcmp(id, identity, len))
+	{
+		fprintf(stderr, "Checkpoint %s is for other input, output or settings.\n", filename);
+		free(id);
+		fclose(fh);
+		return -1;
+	}
+	free(id);
+
+	cp->frame = get32(fh, &bad);
+	cp->first_frame = get32(fh, &bad);
+	cp->end_frame = get32(fh, &bad);
+	cp->num_of_events = get32(fh, &bad);
+	cp->xml_size = get64(fh, &bad);
+	cp->sup.offset = get64(fh, &bad);
+	cp->sup.comp_num = get32(fh, &bad);
+	cp->sup.end = get32(fh, &bad);
+	cp->sup.follower_end = get32(fh, &bad);
+	cp->sup.epochs = get32(fh, &bad);
+	cp->sup.epoch_end_ts = get32(fh, &bad);
+	cp->sup.index_len = get32(fh, &bad);
+	if (!bad && cp->sup.index_len > 0)
+	{
+		cp->sup.index = malloc(cp->sup.index_len);
+		bad = fread(cp->sup.index, 1, cp->sup.index_len, fh) != (size_t)cp->sup.index_len;
+	}
+	fclose(fh);
+	if (bad || cp->sup.index_len < 0 || cp->frame < 0)
+	{
+		fprintf(stderr, "Checkpoint %s is damaged.\n", filename);
+		free(cp->sup.index);
+		cp->sup.index = NULL;
+		return -1;
+	}
+
+	return 0;
+}
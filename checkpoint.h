@@ -0,0 +1,57 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include "sup.h"
+
+/* Progress of a run between two lines, from which --resume continues. All
+ * numbers are little-endian.
+ *
+ *   "A2BR", uint32 version, uint32 identity length, identity,
+ *   uint32 frame, first frame, end frame, number of events,
+ *   uint64 XML size, uint64 SUP size,
+ *   uint32 composition number, SUP end, follower end, epochs, epoch end,
+ *   uint32 seek index length, seek index entries
+ */
+#define CHECKPOINT_MAGIC "A2BR"
+#define CHECKPOINT_VERSION 1
+
+typedef struct checkpoint_s
+{
+	int frame;          /* Next input frame */
+	int first_frame;    /* First frame of the first line, or -1 */
+	int end_frame;      /* End of the last line */
+	int num_of_events;
+	uint64_t xml_size;  /* 0 without XML output */
+	sup_state_t sup;    /* All 0 without SUP output */
+} checkpoint_t;
+
+/* Replace filename with cp, for a run described by identity. Returns -1
+ * and prints the reason on failure.
+ */
+int write_checkpoint (const char *filename, const char *identity, checkpoint_t *cp);
+
+/* Read cp back, with a malloced seek index. Returns -1 and prints the
+ * reason if there is no checkpoint for identity.
+ */
+int read_checkpoint (const char *filename, const char *identity, checkpoint_t *cp);
+
+#endif
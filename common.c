@@ -1,5 +1,13 @@
+#include <zlib.h>
 #include "common.h"
 
+#if defined(LINUX)
+static uint32_t read_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+#endif
+
 int open_file_avis(char *psz_filename, avis_input_t **p_handle, stream_info_t *p_param)
 {
     avis_input_t *h = malloc(sizeof(avis_input_t));
@@ -13,6 +21,8 @@ int open_file_avis(char *psz_filename, avis_input_t **p_handle, stream_info_t *p
     if( AVIStreamOpenFromFile( &h->p_avi, psz_filename, streamtypeVIDEO, 0, OF_READ, NULL ) )
     {
         AVIFileExit();
+        free(h);
+        *p_handle = NULL;
         return -1;
     }
 
@@ -20,6 +30,8 @@ int open_file_avis(char *psz_filename, avis_input_t **p_handle, stream_info_t *p
     {
         AVIStreamRelease(h->p_avi);
         AVIFileExit();
+        free(h);
+        *p_handle = NULL;
         return -1;
     }
 
@@ -32,6 +44,8 @@ int open_file_avis(char *psz_filename, avis_input_t **p_handle, stream_info_t *p
 
         AVIStreamRelease(h->p_avi);
         AVIFileExit();
+        free(h);
+        *p_handle = NULL;
 
         return -1;
     }
@@ -51,17 +65,36 @@ int open_file_avis(char *psz_filename, avis_input_t **p_handle, stream_info_t *p
 
     return 0;
 #else
+    uint8_t hdr[RAW_HEADER_SIZE];
+
     *p_handle = h;
     p_param->i_width = 1920;
     p_param->i_height = 1080;
     p_param->i_fps_den = 30000;
     p_param->i_fps_num = 1001;
+    if ((h->fh = fopen(psz_filename, "rb")) == NULL)
+    {
+        free(h);
+        *p_handle = NULL;
+        return -1;
+    }
+    h->frames = 15000;
+    h->offset = 0;
+    /* Streams written by debug/subgen start with their size, others are
+     * headerless 1080p frames. */
+    if (fread(hdr, 1, RAW_HEADER_SIZE, h->fh) == RAW_HEADER_SIZE && !memcmp(hdr, RAW_HEADER_MAGIC, 4))
+    {
+        p_param->i_width = read_le32(hdr + 4);
+        p_param->i_height = read_le32(hdr + 8);
+        p_param->i_fps_num = read_le32(hdr + 12);
+        p_param->i_fps_den = read_le32(hdr + 16);
+        h->frames = read_le32(hdr + 20);
+        h->offset = RAW_HEADER_SIZE;
+    }
     h->width = p_param->i_width;
     h->height = p_param->i_height;
     h->fps_den = p_param->i_fps_den;
     h->fps_num = p_param->i_fps_num;
-    h->fh = fopen(psz_filename, "r");
-    h->frames = 15000;
     return 0;
 #endif
 }
@@ -92,6 +125,8 @@ int read_frame_avis(char *p_pic, avis_input_t *handle, int i_frame)
 
     return 0;
 #else
+    if (fseeko(handle->fh, handle->offset + (off_t)i_frame * handle->width * handle->height * 4, SEEK_SET))
+        return -1;
     fread(p_pic, 4, handle->width * handle->height, handle->fh);
     return 0;
 #endif
@@ -107,12 +142,13 @@ int close_file_avis(avis_input_t *handle)
     free(h);
     return 0;
 #else
-    fclose((FILE *)handle);
+    fclose(handle->fh);
+    free(handle);
     return 0;
 #endif
 }
 
-void get_dir_path(char *filename, char *dir_path)
+int get_dir_path(char *filename, char *dir_path)
 {
     char abs_path[MAX_PATH + 1] = {0};
     char drive[3] = {0};
@@ -122,7 +158,7 @@ void get_dir_path(char *filename, char *dir_path)
     if (_fullpath(abs_path, filename, MAX_PATH) == NULL)
     {
         fprintf(stderr, "Cannot determine absolute path for: %s\n", filename);
-        exit(1);
+        return -1;
     }
 
     /* Split absolute path into components */
@@ -133,41 +169,69 @@ void get_dir_path(char *filename, char *dir_path)
     if (strlen(dir_path) > MAX_PATH - 16)
     {
         fprintf(stderr, "Path for PNG files too long.\n");
-        exit(1);
+        return -1;
     }
+
+    return 0;
+}
+
+/* "fast" is meant for intermediate files, "max" for archival deliverables.
+ * The zlib strategy is left to libpng, which uses Z_FILTERED when rows are
+ * filtered. Z_RLE was slower than level 1 and larger on dithered content.
+ */
+static png_profile_t png_profiles[] = { {"fast",    1, PNG_FILTER_VALUE_NONE}
+                                      , {"default", 5, PNG_FILTER_VALUE_SUB}
+                                      , {"max",     9, PNG_ALL_FILTERS}
+                                      , {NULL, 0, 0}
+                                      };
+
+png_profile_t *get_png_profile(char *name)
+{
+    int i;
+
+    for (i = 0; png_profiles[i].name != NULL; i++)
+        if (!strcasecmp(png_profiles[i].name, name))
+            return &(png_profiles[i]);
+
+    return NULL;
+}
+
+static void png_sink_write(png_structp png_ptr, png_bytep data, png_size_t len)
+{
+    if (sink_write(png_get_io_ptr(png_ptr), data, len))
+        png_error(png_ptr, "write failed");
+}
+
+static void png_sink_flush(png_structp png_ptr)
+{
 }
 
-void write_png(char *dir, int file_id, uint8_t *image, int w, int h, int graphic, uint32_t *pal, crop_t c)
+int write_png(const sink_dir_t *dest, int file_id, uint8_t *image, int w, int h, int graphic, uint32_t *pal, crop_t c, png_profile_t *profile)
 {
-    FILE *fh;
+    sink_t *sink;
     png_structp png_ptr;
     png_infop info_ptr;
     png_bytep *row_pointers;
     png_colorp palette = NULL;
     png_bytep trans = NULL;
-    char tmp[16] = {0};
-    char filename[MAX_PATH + 1] = {0};
+    char filename[16] = {0};
     char *col;
     int step = pal == NULL ? 4 : 1;
     int colors = 0;
     int i;
 
-    snprintf(tmp, 15, "%08d_%d.png", file_id, graphic);
-    strncpy(filename, dir, MAX_PATH);
-    strncat(filename, tmp, 15);
+    snprintf(filename, 15, "%08d_%d.png", file_id, graphic);
 
-    if ((fh = fopen(filename, "wb")) == NULL)
-    {
-        perror("Cannot open PNG file for writing");
-        exit(1);
-    }
+    if ((sink = sink_dir_open(dest, filename)) == NULL)
+        return -1;
 
     /* Initialize png struct */
     png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (png_ptr == NULL)
     {
+        discard_sink(sink);
         fprintf(stderr, "Cannot create png_ptr.\n");
-        exit(1);
+        return -1;
     }
 
     /* Initialize info struct */
@@ -175,21 +239,33 @@ void write_png(char *dir, int file_id, uint8_t *image, int w, int h, int graphic
     if (info_ptr == NULL)
     {
         png_destroy_write_struct(&png_ptr, (png_infopp)NULL);
+        discard_sink(sink);
         fprintf(stderr, "Cannot create info_ptr.\n");
-        exit(1);
+        return -1;
+    }
+
+    /* Allocated before setjmp, so the error handler sees them */
+    row_pointers = calloc(c.h, sizeof(png_bytep));
+    if (pal != NULL)
+    {
+        palette = calloc(256, sizeof(png_color));
+        trans = calloc(256, sizeof(png_byte));
     }
 
     /* Set long jump stuff (weird..?) */
     if (setjmp(png_jmpbuf(png_ptr)))
     {
         png_destroy_write_struct(&png_ptr, &info_ptr);
-        fclose(fh);
+        free(row_pointers);
+        free(palette);
+        free(trans);
+        discard_sink(sink);
         fprintf(stderr, "Error while writing PNG file: %s\n", filename);
-        exit(1);
+        return -1;
     }
 
     /* Initialize IO */
-    png_init_io(png_ptr, fh);
+    png_set_write_fn(png_ptr, sink, png_sink_write, png_sink_flush);
 
     /* Set file info */
     if (pal == NULL)
@@ -197,8 +273,6 @@ void write_png(char *dir, int file_id, uint8_t *image, int w, int h, int graphic
     else
     {
         png_set_IHDR(png_ptr, info_ptr, c.w, c.h, 8, PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-        palette = calloc(256, sizeof(png_color));
-        trans = calloc(256, sizeof(png_byte));
         colors = 1;
         for (i = 1; i < 256 && pal[i]; i++)
         {
@@ -213,9 +287,6 @@ void write_png(char *dir, int file_id, uint8_t *image, int w, int h, int graphic
         png_set_tRNS(png_ptr, info_ptr, trans, colors, NULL);
     }
 
-    /* Allocate row pointer memory */
-    row_pointers = calloc(c.h, sizeof(png_bytep));
-
     /* Set row pointers */
     image = image + step * (c.x + w * c.y);
     for (i = 0; i < c.h; i++)
@@ -225,8 +296,10 @@ void write_png(char *dir, int file_id, uint8_t *image, int w, int h, int graphic
     png_set_rows(png_ptr, info_ptr, row_pointers);
 
     /* Set compression */
-    png_set_filter(png_ptr, 0, PNG_FILTER_VALUE_SUB);
-    png_set_compression_level(png_ptr, 5);
+    if (profile == NULL)
+        profile = get_png_profile("default");
+    png_set_filter(png_ptr, 0, profile->filter);
+    png_set_compression_level(png_ptr, profile->level);
 
     /* Write image */
     png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
@@ -234,13 +307,17 @@ void write_png(char *dir, int file_id, uint8_t *image, int w, int h, int graphic
     /* Free memory */
     png_destroy_write_struct(&png_ptr, &info_ptr);
     free(row_pointers);
-    if (palette != NULL)
-        free(palette);
-    if (trans != NULL)
-        free(trans);
+    free(palette);
+    free(trans);
 
     /* Close file handle */
-    fclose(fh);
+    if (close_sink(sink))
+    {
+        perror("Error closing PNG file");
+        return -1;
+    }
+
+    return 0;
 }
 
 int is_identical_c(stream_info_t *s_info, char *img, char *img_old)
@@ -283,7 +360,7 @@ void zero_transparent_c(stream_info_t *s_info, char *img)
     while (im < max)
     {
         if (!im[3])
-            *(uint32_t *)img = 0;
+            *(uint32_t *)im = 0;
         im += 4;
     }
 }
@@ -323,7 +400,65 @@ void swap_rb(stream_info_t *s_info, char *img, char *out)
     return swap_rb_c(s_info, img, out);
 }
 
-void mk_timecode(int frame, int fps, char *buf)
+int is_empty_stride(int w, int h, const char *img, int stride)
+{
+    const char *im, *max;
+    int y;
+
+    for (y = 0; y < h; y++, img += stride)
+        for (im = img, max = img + w * 4; im < max; im += 4)
+            if (im[3])
+                return 0;
+
+    return 1;
+}
+
+int is_identical_stride(int w, int h, const char *img, int stride, const char *img_old)
+{
+    const char *im, *max;
+    int y;
+
+    for (y = 0; y < h; y++, img += stride)
+        for (im = img, max = img + w * 4; im < max; im += 4, img_old += 4)
+        {
+            if (im[3] ? memcmp(im, img_old, 4) : *(uint32_t *)img_old)
+                return 0;
+        }
+
+    return 1;
+}
+
+void copy_zero_transparent(int w, int h, const char *img, int stride, char *out)
+{
+    const char *im, *max;
+    int y;
+
+    for (y = 0; y < h; y++, img += stride)
+    {
+        memcpy(out, img, w * 4);
+        for (im = img, max = img + w * 4; im < max; im += 4, out += 4)
+            if (!im[3])
+                *(uint32_t *)out = 0;
+    }
+}
+
+double wall_clock()
+{
+#if !defined(LINUX)
+    LARGE_INTEGER now, freq;
+
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return (double)now.QuadPart / freq.QuadPart;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+int mk_timecode(int frame, int fps, char *buf)
 {
     int frames, s, m, h;
     int tc = frame;
@@ -340,22 +475,29 @@ void mk_timecode(int frame, int fps, char *buf)
     if (h > 99)
     {
         fprintf(stderr, "Timecodes above 99:59:59:99 not supported: %u:%02u:%02u:%02u\n", h, m, s, frames);
-        exit(1);
+        return -1;
     }
 
     if (snprintf(buf, 12, "%02d:%02d:%02d:%02d", h, m, s, frames) != 11)
     {
         fprintf(stderr, "Timecode lead to invalid format: %s\n", buf);
-        exit(1);
+        return -1;
     }
+
+    return 0;
 }
 
 void print_usage()
 {
     fprintf(stderr,
             "avs2bdnxml 2.09\n\n"
-            "Usage: avs2bdnxml [options] -o output input\n\n"
-            "Input has to be an AviSynth script with RGBA as output colorspace\n\n"
+            "Usage: avs2bdnxml [options] -o output input\n"
+            "       avs2bdnxml [options] -B manifest\n\n"
+            "Input has to be an AviSynth script with RGBA as output colorspace,\n"
+            "a SUP file to be re-optimized, a BDN XML file with PNG images, or\n"
+            "an ASS/SSA file, if built with libass. The frame rate of SUP and\n"
+            "ASS/SSA input is taken from --fps, that of BDN XML input from the\n"
+            "XML file. ASS/SSA files are rendered at the size of --video-format.\n\n"
             "  -o, --output <string>        Output file in BDN XML format\n"
             "                               For SUP/PGS output, use a .sup extension\n"
             "  -j, --seek <integer>         Start processing at this frame, first is 0\n"
@@ -384,7 +526,34 @@ void print_usage()
             "                               [on=1, off=0]\n"
             "  -b, --buffer-opt <integer>   Optimize PG buffer size by image\n"
             "                               splitting. [on=1, off=0]\n"
-            "  -F, --forced <integer>       mark all subtitles as forced [on=1, off=0]\n\n"
+            "  -F, --forced <integer>       mark all subtitles as forced [on=1, off=0]\n"
+            "  -T, --threads <integer>      Number of PNG writer threads. Use 0 for one\n"
+            "                               per CPU, 1 to write on the main thread.\n"
+            "  -D, --dedup <integer>        Write identical graphics only once and\n"
+            "                               reference the same PNG file. [on=1, off=0]\n"
+            "  -P, --png-profile <string>   PNG compression. Either of: fast, default,\n"
+            "                               max\n"
+            "  -E, --epoch-stats <integer>  Print decoder buffer use per SUP epoch.\n"
+            "                               [on=1, off=0]\n"
+            "  -I, --sup-index <integer>    Write a seek index for the SUP file to\n"
+            "                               FILE.sup.idx. [on=1, off=0]\n"
+            "  -A, --ass <string>           ASS file rendered by the script. Only frames\n"
+            "                               during its Dialogue lines are read, and lines\n"
+            "                               with a '!' after the style are forced.\n"
+            "  -S, --stats <integer>        Print time spent per stage, and counts of\n"
+            "                               frames, epochs and bytes. [on=1, off=0]\n"
+            "  -R, --stats-json <string>    Write the same as JSON to this file, or to\n"
+            "                               stdout for -.\n"
+            "  -K, --cache <string>         Keep results per line in this file, and reuse\n"
+            "                               them for unchanged lines in the next run.\n"
+            "  -C, --checkpoint <integer>   Save progress between lines after every this\n"
+            "                               many frames, to OUTPUT.ckpt. Disabled when 0.\n"
+            "  -r, --resume <integer>       Continue an interrupted run from its\n"
+            "                               checkpoint. [on=1, off=0]\n"
+            "  -B, --batch <string>         Convert the inputs listed in a manifest file,\n"
+            "                               with the other options as default settings.\n"
+            "  -J, --jobs <integer>         Inputs converted at once in batch mode. Use 0\n"
+            "                               for one per CPU.\n\n"
             "Example:\n"
             "  avs2bdnxml -t Undefined -l und -v 1080p -f 23.976 -a1 -p1 -b0 -m3 \\\n"
             "    -u0 -e0 -n0 -z0 -o output.xml input.avs\n"
@@ -422,18 +591,22 @@ int parse_int(char *in, char *name, int *error)
         if (name != NULL)
         {
             fprintf(stderr, "Error: Failed to parse integer (%s): %s\n", name, in);
-            exit(1);
+            if (error == NULL)
+                exit(1);
         }
     }
     return r;
 }
 
-int parse_tc(char *in, int fps)
+int parse_tc(char *in, int fps, int *error)
 {
     int r = 0;
-    int e;
+    int e, bad = 0;
     int h, m, s, f;
 
+    if (error != NULL)
+        *error = 0;
+
     /* Test for raw frame number. */
     r = parse_int(in, NULL, &e);
     if (!e)
@@ -442,15 +615,30 @@ int parse_tc(char *in, int fps)
     if (strlen(in) != 2 * 4 + 3 || in[2] != ':' || in[5] != ':' || in[8] != ':')
     {
         fprintf(stderr, "Error: Invalid timecode offset. Expected FRAMENUMBER or HH:MM:SS:FF, but got: %s\n", in);
+        if (error != NULL)
+        {
+            *error = 1;
+            return 0;
+        }
         exit(1);
     }
     in[2] = 0;
     in[5] = 0;
     in[8] = 0;
-    h = parse_int(in,     "t-offset hours",   NULL);
-    m = parse_int(in + 3, "t-offset minutes", NULL);
-    s = parse_int(in + 6, "t-offset seconds", NULL);
-    f = parse_int(in + 9, "t-offset frames",  NULL);
+    e = 0;
+    h = parse_int(in,     "t-offset hours",   error != NULL ? &e : NULL);
+    bad |= e;
+    m = parse_int(in + 3, "t-offset minutes", error != NULL ? &e : NULL);
+    bad |= e;
+    s = parse_int(in + 6, "t-offset seconds", error != NULL ? &e : NULL);
+    bad |= e;
+    f = parse_int(in + 9, "t-offset frames",  error != NULL ? &e : NULL);
+    bad |= e;
+    if (bad)
+    {
+        *error = 1;
+        return 0;
+    }
     r = f;
     r += s * fps;
     fps *= 60;
@@ -460,36 +648,37 @@ int parse_tc(char *in, int fps)
     return r;
 }
 
-void add_event_xml_real(event_list_t *events, int image, int start, int end, int graphics, crop_t *crops, int forced)
+void add_event_xml_real(event_vec_t *events, int image, int start, int end, int graphics, crop_t *crops, png_ref_t *pngs, int forced)
 {
-    event_t *new = calloc(1, sizeof(event_t));
+    event_t *new = event_vec_append(events);
     new->image_number = image;
     new->start_frame = start;
     new->end_frame = end;
     new->graphics = graphics;
     new->c[0] = crops[0];
     new->c[1] = crops[1];
+    new->png[0] = pngs[0];
+    new->png[1] = pngs[1];
     new->forced = forced;
-    event_list_insert_after(events, new);
 }
 
-void add_event_xml(event_list_t *events, int split_at, int min_split, int start, int end, int graphics, crop_t *crops, int forced)
+void add_event_xml(event_vec_t *events, int split_at, int min_split, int start, int end, int graphics, crop_t *crops, png_ref_t *pngs, int forced)
 {
     int image = start;
     int d = end - start;
 
     if (!split_at)
-        add_event_xml_real(events, image, start, end, graphics, crops, forced);
+        add_event_xml_real(events, image, start, end, graphics, crops, pngs, forced);
     else
     {
         while (d >= split_at + min_split)
         {
             d -= split_at;
-            add_event_xml_real(events, image, start, start + split_at, graphics, crops, forced);
+            add_event_xml_real(events, image, start, start + split_at, graphics, crops, pngs, forced);
             start += split_at;
         }
         if (d)
-            add_event_xml_real(events, image, start, start + d, graphics, crops, forced);
+            add_event_xml_real(events, image, start, start + d, graphics, crops, pngs, forced);
     }
 }
 
@@ -511,3 +700,22 @@ void write_sup_wrapper(sup_writer_t *sw, uint8_t *im, int num_crop, crop_t *crop
             write_sup(sw, im, num_crop, crops, pal, start, start + d, stricter, forced);
     }
 }
+
+void write_sup_rle_wrapper(sup_writer_t *sw, int num_crop, crop_t *crops, uint8_t **rle, int *rle_len, uint32_t *pal, int start, int end, int split_at, int min_split, int stricter, int forced)
+{
+    int d = end - start;
+
+    if (!split_at)
+        write_sup_rle(sw, num_crop, crops, rle, rle_len, pal, start, end, stricter, forced);
+    else
+    {
+        while (d >= split_at + min_split)
+        {
+            d -= split_at;
+            write_sup_rle(sw, num_crop, crops, rle, rle_len, pal, start, start + split_at, stricter, forced);
+            start += split_at;
+        }
+        if (d)
+            write_sup_rle(sw, num_crop, crops, rle, rle_len, pal, start, start + d, stricter, forced);
+    }
+}
@@ -15,8 +15,19 @@ extern "C" {
 #include "auto_split.h"
 #include "palletize.h"
 #include "sup.h"
+#include "sink.h"
+#include "sup_decode.h"
+#include "bdn_input.h"
+#include "libass_input.h"
+#include "png_pool.h"
+#include "png_index.h"
+#include "frame_cache.h"
+#include "checkpoint.h"
+#include "stats.h"
+#include "xml_writer.h"
 #include "ass.h"
 #include "abstract_lists.h"
+#include "abstract_vectors.h"
 
 /* AVIS input code taken from muxers.c from the x264 project (GPLv2 or later).
  * Authors: Laurent Aimar <fenrir@via.ecp.fr>
@@ -42,6 +53,13 @@ static int64_t gcd( int64_t a, int64_t b )
 }
 #endif
 
+/* Raw streams read on Linux may start with this header, followed by
+ * little endian 32 bit width, height, fps numerator, fps denominator and
+ * frame count. debug/subgen writes them.
+ */
+#define RAW_HEADER_MAGIC "RGBA"
+#define RAW_HEADER_SIZE 24
+
 typedef struct {
 #if !defined(LINUX)
     PAVISTREAM p_avi;
@@ -49,6 +67,7 @@ typedef struct {
     int fps_den;
     int fps_num;
     int frames;
+    int offset;      /* Size of the stream header, if there is one */
     FILE *fh;
 #endif
     int width, height;
@@ -71,9 +90,24 @@ int close_file_avis( avis_input_t *handle );
 
 /* Main avs2bdnxml code starts here, too */
 
-void get_dir_path(char *filename, char *dir_path);
+/* Returns -1 and prints the reason on failure */
+int get_dir_path(char *filename, char *dir_path);
 
-void write_png(char *dir, int file_id, uint8_t *image, int w, int h, int graphic, uint32_t *pal, crop_t c);
+/* zlib level and libpng row filter, used for PNG output */
+typedef struct png_profile_s
+{
+    char *name;
+    int level;
+    int filter;
+} png_profile_t;
+
+/* Returns NULL for unknown profile names */
+png_profile_t *get_png_profile(char *name);
+
+/* A NULL profile selects the "default" profile. Returns -1 and prints the
+ * reason on failure.
+ */
+int write_png(const sink_dir_t *dest, int file_id, uint8_t *image, int w, int h, int graphic, uint32_t *pal, crop_t c, png_profile_t *profile);
 
 int is_identical_c (stream_info_t *s_info, char *img, char *img_old);
 
@@ -91,16 +125,32 @@ void zero_transparent (stream_info_t *s_info, char *img);
 
 void swap_rb (stream_info_t *s_info, char *img, char *out);
 
+/* Versions of the checks above for frames owned by someone else, with rows
+ * stride bytes apart. img is only read, pixels with zero alpha compare as
+ * zero against img_old, which is w * 4 bytes per row.
+ */
+int is_empty_stride (int w, int h, const char *img, int stride);
+
+int is_identical_stride (int w, int h, const char *img, int stride, const char *img_old);
+
+/* Copy img into out, w * 4 bytes per row, zeroing transparent pixels */
+void copy_zero_transparent (int w, int h, const char *img, int stride, char *out);
+
+/* Seconds since some fixed point, for measuring elapsed time across threads */
+double wall_clock ();
+
 /* SMPTE non-drop time code */
-void mk_timecode (int frame, int fps, char *buf); /* buf must have length 12 (incl. trailing \0) */
+int mk_timecode (int frame, int fps, char *buf); /* buf must have length 12 (incl. trailing \0), returns -1 if out of range */
 
 void print_usage ();
 
 // extern char *rindex(const char *s, int c);
 int is_extension(const char *filename, char *check_ext);
+/* With name set, failures are reported, and exit unless error is given */
 int parse_int(char *in, char *name, int *error);
 
-int parse_tc(char *in, int fps);
+/* Exits on invalid input, unless error is given */
+int parse_tc(char *in, int fps, int *error);
 
 typedef struct event_s
 {
@@ -110,16 +160,19 @@ typedef struct event_s
     int graphics;
     int forced;
     crop_t c[2];
+    png_ref_t png[2];
 } event_t;
 
-STATIC_LIST(event, event_t)
+STATIC_VECTOR(event, event_t)
 
-void add_event_xml_real (event_list_t *events, int image, int start, int end, int graphics, crop_t *crops, int forced);
+void add_event_xml_real (event_vec_t *events, int image, int start, int end, int graphics, crop_t *crops, png_ref_t *pngs, int forced);
 
-void add_event_xml (event_list_t *events, int split_at, int min_split, int start, int end, int graphics, crop_t *crops, int forced);
+void add_event_xml (event_vec_t *events, int split_at, int min_split, int start, int end, int graphics, crop_t *crops, png_ref_t *pngs, int forced);
 
 void write_sup_wrapper (sup_writer_t *sw, uint8_t *im, int num_crop, crop_t *crops, uint32_t *pal, int start, int end, int split_at, int min_split, int stricter, int forced);
 
+void write_sup_rle_wrapper (sup_writer_t *sw, int num_crop, crop_t *crops, uint8_t **rle, int *rle_len, uint32_t *pal, int start, int end, int split_at, int min_split, int stricter, int forced);
+
 
 struct framerate_entry_s
 {
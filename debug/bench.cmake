@@ -0,0 +1,99 @@
+# End to end benchmark, run by the bench target:
+#
+#   cmake --build build --target bench
+#
+# Generates a synthetic stream per resolution and workload with subgen,
+# converts it to SUP, and prints the throughput measured by avs2bdnxml and
+# the output size. Streams are deleted after use. Override the defaults
+# with -D, e.g. -DRESOLUTIONS="720p;1080p" -DWORKLOADS="karaoke;signs"
+# -DFRAMES=500 -DBENCH_ARGS="-b;1".
+
+if(NOT SUBGEN OR NOT AVS2BDNXML OR NOT WORK_DIR)
+    message(FATAL_ERROR "Run through the bench target, or pass SUBGEN, AVS2BDNXML and WORK_DIR")
+endif()
+if(NOT RESOLUTIONS)
+    set(RESOLUTIONS 480p 720p 1080p 2160p)
+endif()
+if(NOT WORKLOADS)
+    set(WORKLOADS mixed)
+endif()
+if(NOT SEED)
+    set(SEED 1)
+endif()
+
+# Frames per resolution, about 1 GB of RGBA data each
+set(FRAMES_480p 720)
+set(FRAMES_576p 600)
+set(FRAMES_720p 270)
+set(FRAMES_1080p 120)
+set(FRAMES_1440p 68)
+set(FRAMES_2160p 30)
+
+# AVIFile reads uncompressed AVI on Windows, the -DLINUX build raw streams
+if(WIN32)
+    set(ext avi)
+else()
+    set(ext raw)
+endif()
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+message("Resolution Workload     Frames    Frames/s      MB/s    SUP bytes")
+foreach(res ${RESOLUTIONS})
+    foreach(workload ${WORKLOADS})
+        if(FRAMES)
+            set(frames ${FRAMES})
+        elseif(FRAMES_${res})
+            set(frames ${FRAMES_${res}})
+        else()
+            set(frames 100)
+        endif()
+        # BD video formats end at 1080p, larger frames are encoded as is
+        if(res MATCHES "^(480|576|720|1080)p$")
+            set(format ${res})
+        else()
+            set(format 1080p)
+        endif()
+        set(stream ${WORK_DIR}/${res}_${workload}.${ext})
+        set(json ${WORK_DIR}/${res}_${workload}.json)
+
+        execute_process(COMMAND ${SUBGEN} -r ${res} -n ${frames} -w ${workload} -s ${SEED} ${stream}
+            RESULT_VARIABLE r ERROR_QUIET)
+        if(r)
+            message(FATAL_ERROR "subgen failed for ${res} ${workload}")
+        endif()
+        execute_process(COMMAND ${AVS2BDNXML} -v ${format} -f 23.976 ${BENCH_ARGS} -R ${json} -o ${WORK_DIR}/${res}_${workload}.sup ${stream}
+            WORKING_DIRECTORY ${WORK_DIR} RESULT_VARIABLE r OUTPUT_QUIET ERROR_QUIET)
+        file(REMOVE ${stream})
+        if(r)
+            message(FATAL_ERROR "avs2bdnxml failed for ${res} ${workload}")
+        endif()
+
+        file(READ ${json} stats)
+        string(REGEX MATCH "\"frames_per_second\": ([0-9.]+)" m "${stats}")
+        set(fps ${CMAKE_MATCH_1})
+        string(REGEX MATCH "\"mb_per_second\": ([0-9.]+)" m "${stats}")
+        set(mbs ${CMAKE_MATCH_1})
+        string(REGEX MATCH "\"sup_bytes\": ([0-9]+)" m "${stats}")
+        set(bytes ${CMAKE_MATCH_1})
+
+        set(line "")
+        foreach(field "${res}:10" "${workload}:12" "${frames}:7" "${fps}:12" "${mbs}:10" "${bytes}:13")
+            string(REGEX MATCH "^(.*):([0-9]+)$" m "${field}")
+            set(text "${CMAKE_MATCH_1}")
+            string(LENGTH "${text}" len)
+            math(EXPR pad "${CMAKE_MATCH_2} - ${len}")
+            if(pad GREATER 0)
+                string(SUBSTRING "                " 0 ${pad} spaces)
+            else()
+                set(spaces "")
+            endif()
+            # Names to the left, numbers to the right
+            if(text MATCHES "^[0-9.]+$")
+                set(line "${line}${spaces}${text}")
+            else()
+                set(line "${line}${text}${spaces} ")
+            endif()
+        endforeach()
+        message("${line}")
+    endforeach()
+endforeach()
@@ -0,0 +1,563 @@
+/*----------------------------------------------------------------------------
+ * kbench - Times the kernels of avs2bdnxml on frames of a given input
+ * Copyright (C) 2010 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+/* Non-empty frames of the input are captured once, along with what the
+ * pipeline makes of them: swapped RGBA, crops, split rectangles, 8 bit
+ * images and palettes. Each kernel then runs on all of them for a number
+ * of warm-up and timed samples, and the median and percentiles of the
+ * time per pixel or per operation are reported.
+ */
+
+#include "../common.h"
+#include "../sort.h"
+
+/* write_palette is static, so sup.c is built into kbench */
+#include "../sup.c"
+
+#define SORT_RECTS 1024
+#define INNER_OPS 64
+
+typedef struct corpus_s
+{
+	stream_info_t s_info;
+	pic_t pic;
+	int n;
+	char **frames;       /* As read, with transparent pixels zeroed */
+	char **swapped;      /* After swap_rb */
+	uint8_t **indexed;   /* After palletize */
+	uint32_t **pals;
+	crop_t *crops;       /* auto_crop of each frame */
+	crop_t *rects;       /* auto_split of each frame, two per frame */
+	int *n_rects;
+	char *work;
+	char *zero;
+	quantizer_t *quant;
+	sup_writer_t *sw;
+	rect_t sort_rects[SORT_RECTS];
+	rect_t *sorted[SORT_RECTS];
+	uint64_t png_bytes;  /* Written by the PNG kernels */
+} corpus_t;
+
+typedef struct kernel_s
+{
+	const char *name;
+	const char *unit;
+	/* Time spent on frame i, with the pixels or operations done in units */
+	double (*run)(corpus_t *c, int i, double *units);
+} kernel_t;
+
+static int pixels (corpus_t *c)
+{
+	return c->s_info.i_width * c->s_info.i_height;
+}
+
+static char *new_frame (corpus_t *c)
+{
+	/* Over-allocated like the frame buffers of avs2bdnxml */
+	return calloc(pixels(c) * 4 + 16 * 2, 1);
+}
+
+static double run_is_identical (corpus_t *c, int i, double *units)
+{
+	double t;
+
+	/* Like in_img, the new frame gets its transparent pixels zeroed */
+	memcpy(c->work, c->frames[i], pixels(c) * 4);
+	t = wall_clock();
+	if (!is_identical(&c->s_info, c->work, c->frames[i]))
+		fprintf(stderr, "is_identical failed on a copy.\n");
+	*units = pixels(c);
+
+	return wall_clock() - t;
+}
+
+static double run_is_empty (corpus_t *c, int i, double *units)
+{
+	double t = wall_clock();
+
+	is_empty(&c->s_info, c->zero);
+	*units = pixels(c);
+
+	return wall_clock() - t;
+}
+
+static double run_swap_rb (corpus_t *c, int i, double *units)
+{
+	double t = wall_clock();
+
+	swap_rb(&c->s_info, c->frames[i], c->work);
+	*units = pixels(c);
+
+	return wall_clock() - t;
+}
+
+static double run_auto_crop (corpus_t *c, int i, double *units)
+{
+	pic_t p = c->pic;
+	crop_t crop = {0, 0, p.w, p.h};
+	double t;
+
+	p.b = c->swapped[i];
+	t = wall_clock();
+	auto_crop(p, &crop);
+	*units = pixels(c);
+
+	return wall_clock() - t;
+}
+
+static double run_auto_split (corpus_t *c, int i, double *units)
+{
+	pic_t p = c->pic;
+	crop_t crops[2] = {{0, 0, p.w, p.h}, {0, 0, 0, 0}};
+	double t;
+
+	p.b = c->swapped[i];
+	t = wall_clock();
+	auto_split(p, crops, 0, 0);
+	*units = pixels(c);
+
+	return wall_clock() - t;
+}
+
+/* Rectangles of up to eight frames, like those of an epoch */
+static double run_find_windows (corpus_t *c, int i, double *units)
+{
+	rect_t rects[16], windows[2];
+	int n = 0, j, k;
+	double t;
+
+	for (j = 0; j < 8 && j < c->n; j++)
+		for (k = 0; k < c->n_rects[(i + j) % c->n]; k++)
+			rects[n++] = c->rects[((i + j) % c->n) * 2 + k];
+	t = wall_clock();
+	for (j = 0; j < INNER_OPS; j++)
+		find_windows(rects, n, windows);
+	*units = INNER_OPS;
+
+	return wall_clock() - t;
+}
+
+static double run_palletize (corpus_t *c, int i, double *units)
+{
+	uint32_t *pal;
+	double t;
+
+	memcpy(c->work, c->swapped[i], pixels(c) * 4);
+	t = wall_clock();
+	pal = palletize_with(c->quant, c->work, c->s_info.i_width, c->s_info.i_height);
+	t = wall_clock() - t;
+	free(pal);
+	*units = pixels(c);
+
+	return t;
+}
+
+static double run_rl_encode (corpus_t *c, int i, double *units)
+{
+	uint8_t *rle;
+	double t = wall_clock();
+	int len;
+
+	rle = rl_encode(c->indexed[i], c->s_info.i_width, c->s_info.i_height, c->crops[i], &len);
+	free(rle);
+	*units = c->crops[i].w * c->crops[i].h;
+
+	return wall_clock() - t;
+}
+
+/* Palette definition segments, including the conversion to YCbCr */
+static double run_write_palette (corpus_t *c, int i, double *units)
+{
+	double t = wall_clock();
+	int j;
+
+	for (j = 0; j < INNER_OPS; j++)
+		write_palette(c->sw, 0, 0, c->pals[i]);
+	t = wall_clock() - t;
+	ds_flush(c->sw);
+	*units = INNER_OPS;
+
+	return t;
+}
+
+static int count_write (void *opaque, const void *data, size_t len)
+{
+	*(uint64_t *)opaque += len;
+
+	return 0;
+}
+
+static sink_t *open_counted (void *opaque, const char *name)
+{
+	return new_callback_sink(opaque, count_write, NULL, NULL);
+}
+
+/* The split rectangles of a frame as 8 bit PNG files, like XML output
+ * with --palette
+ */
+static double run_png (corpus_t *c, int i, double *units, char *profile)
+{
+	sink_dir_t dest = {NULL, open_counted, &c->png_bytes};
+	png_profile_t *p = get_png_profile(profile);
+	crop_t *r = &c->rects[i * 2];
+	double t = wall_clock();
+	int j;
+
+	*units = 0;
+	for (j = 0; j < c->n_rects[i]; j++)
+	{
+		write_png(&dest, i, c->indexed[i], c->s_info.i_width, c->s_info.i_height, j, c->pals[i], r[j], p);
+		*units += r[j].w * r[j].h;
+	}
+
+	return wall_clock() - t;
+}
+
+static double run_png_fast (corpus_t *c, int i, double *units)
+{
+	return run_png(c, i, units, "fast");
+}
+
+static double run_png_default (corpus_t *c, int i, double *units)
+{
+	return run_png(c, i, units, "default");
+}
+
+static double run_png_max (corpus_t *c, int i, double *units)
+{
+	return run_png(c, i, units, "max");
+}
+
+static int cmp_rect_left (rect_t *a, rect_t *b)
+{
+	return a->x > b->x || (a->x == b->x && a->w > b->w);
+}
+
+static double run_sort (corpus_t *c, int i, double *units)
+{
+	double t;
+	int j;
+
+	for (j = 0; j < SORT_RECTS; j++)
+		c->sorted[j] = &c->sort_rects[(j * 7 + i * 131) % SORT_RECTS];
+	t = wall_clock();
+	sort((sort_func_t)cmp_rect_left, (void **)c->sorted, SORT_RECTS);
+	*units = SORT_RECTS;
+
+	return wall_clock() - t;
+}
+
+static const kernel_t kernels[] =
+{
+	{"is_identical",  "pixel", run_is_identical},
+	{"is_empty",      "pixel", run_is_empty},
+	{"swap_rb",       "pixel", run_swap_rb},
+	{"auto_crop",     "pixel", run_auto_crop},
+	{"auto_split",    "pixel", run_auto_split},
+	{"find_windows",  "op",    run_find_windows},
+	{"palletize",     "pixel", run_palletize},
+	{"rl_encode",     "pixel", run_rl_encode},
+	{"write_palette", "op",    run_write_palette},
+	{"png_fast",      "pixel", run_png_fast},
+	{"png_default",   "pixel", run_png_default},
+	{"png_max",       "pixel", run_png_max},
+	{"sort",          "rect",  run_sort},
+	{NULL,            NULL,    NULL}
+};
+
+static int discard_write (void *opaque, const void *data, size_t len)
+{
+	return 0;
+}
+
+/* Read up to n non-empty frames, starting at frame seek */
+static int capture (corpus_t *c, char *filename, int n, int seek)
+{
+	avis_input_t *avis_hnd;
+	int frames, f, w, h, j, k;
+	uint32_t x;
+
+	if (open_file_avis(filename, &avis_hnd, &c->s_info))
+	{
+		fprintf(stderr, "Cannot open input: %s\n", filename);
+		return -1;
+	}
+	w = c->s_info.i_width;
+	h = c->s_info.i_height;
+	c->pic.w = w;
+	c->pic.h = h;
+	c->pic.s = w;
+	c->frames = calloc(n, sizeof(char *));
+	c->swapped = calloc(n, sizeof(char *));
+	c->indexed = calloc(n, sizeof(uint8_t *));
+	c->pals = calloc(n, sizeof(uint32_t *));
+	c->crops = calloc(n, sizeof(crop_t));
+	c->rects = calloc(n * 2, sizeof(crop_t));
+	c->n_rects = calloc(n, sizeof(int));
+	c->work = new_frame(c);
+	c->zero = new_frame(c);
+	c->quant = new_quantizer();
+
+	frames = get_frame_total_avis(avis_hnd);
+	for (f = seek; f < frames && c->n < n; f++)
+	{
+		if (read_frame_avis(c->work, avis_hnd, f))
+		{
+			fprintf(stderr, "Error reading frame %d.\n", f);
+			close_file_avis(avis_hnd);
+			return -1;
+		}
+		if (is_empty(&c->s_info, c->work))
+			continue;
+
+		k = c->n++;
+		zero_transparent(&c->s_info, c->work);
+		c->frames[k] = new_frame(c);
+		c->swapped[k] = new_frame(c);
+		memcpy(c->frames[k], c->work, w * h * 4);
+		swap_rb(&c->s_info, c->frames[k], c->swapped[k]);
+
+		c->pic.b = c->swapped[k];
+		c->crops[k].w = w;
+		c->crops[k].h = h;
+		auto_crop(c->pic, &c->crops[k]);
+		c->rects[k * 2] = (crop_t){0, 0, w, h};
+		c->n_rects[k] = auto_split(c->pic, &c->rects[k * 2], 0, 0);
+
+		memcpy(c->work, c->swapped[k], w * h * 4);
+		c->pals[k] = palletize_with(c->quant, c->work, w, h);
+		c->indexed[k] = malloc(w * h);
+		memcpy(c->indexed[k], c->work, w * h);
+	}
+	close_file_avis(avis_hnd);
+	if (!c->n)
+	{
+		fprintf(stderr, "No non-empty frames found.\n");
+		return -1;
+	}
+
+	/* Rectangles for sort, from a fixed sequence */
+	x = 1;
+	for (j = 0; j < SORT_RECTS; j++)
+	{
+		x = x * 1103515245 + 12345;
+		c->sort_rects[j] = (rect_t){(x >> 8) % w, (x >> 4) % h, 8 + (x >> 16) % 256, 8 + (x >> 24)};
+	}
+
+	c->sw = new_sup_writer_sink(new_callback_sink(NULL, discard_write, NULL, NULL), w, h, 24000, 1001);
+	for (j = k = 0; j < c->n; j++)
+		k += c->n_rects[j] == 2;
+	fprintf(stderr, "Captured %d frames of %dx%d, %d of them split in two.\n", c->n, w, h, k);
+
+	return 0;
+}
+
+static int cmp_double (const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double percentile (double *s, int n, double q)
+{
+	return s[(int)(q * (n - 1) + 0.5)];
+}
+
+typedef struct result_s
+{
+	char name[32];
+	char unit[16];
+	double median, p10, p90;
+} result_t;
+
+static int load_baseline (const char *filename, result_t *base, int max)
+{
+	FILE *fh;
+	int n = 0;
+
+	if ((fh = fopen(filename, "r")) == NULL)
+	{
+		perror("Error opening baseline");
+		return -1;
+	}
+	while (n < max && fscanf(fh, "%31s %15s %lf %lf %lf", base[n].name, base[n].unit, &base[n].median, &base[n].p10, &base[n].p90) == 5)
+		n++;
+	fclose(fh);
+
+	return n;
+}
+
+static int selected (const char *list, const char *name)
+{
+	const char *p = list;
+	size_t l = strlen(name);
+
+	if (list == NULL)
+		return 1;
+	while ((p = strstr(p, name)) != NULL)
+	{
+		if ((p == list || p[-1] == ',') && (p[l] == ',' || !p[l]))
+			return 1;
+		p += l;
+	}
+
+	return 0;
+}
+
+static void usage (void)
+{
+	fprintf(stderr,
+		"kbench 1.0\n"
+		"Usage: kbench [options] input\n"
+		"\n"
+		"Input is read like by avs2bdnxml, e.g. a stream from subgen.\n"
+		"\n"
+		"  -k, --kernels <string>   Comma separated kernels to run, default all:\n"
+		"                           is_identical, is_empty, swap_rb, auto_crop,\n"
+		"                           auto_split, find_windows, palletize,\n"
+		"                           rl_encode, write_palette, png_fast,\n"
+		"                           png_default, png_max, sort\n"
+		"  -n, --frames <integer>   Non-empty frames to capture. Default: 8\n"
+		"  -j, --seek <integer>     Start capturing at this frame\n"
+		"  -r, --runs <integer>     Timed runs over all frames. Default: 15\n"
+		"  -w, --warmup <integer>   Untimed runs before those. Default: 3\n"
+		"  -o, --save <string>      Save the results as a baseline\n"
+		"  -b, --baseline <string>  Compare medians against a saved baseline\n"
+		);
+}
+
+int main (int argc, char *argv[])
+{
+	struct option longopts[] = {
+		{"kernels", required_argument, NULL, 'k'},
+		{"frames", required_argument, NULL, 'n'},
+		{"seek", required_argument, NULL, 'j'},
+		{"runs", required_argument, NULL, 'r'},
+		{"warmup", required_argument, NULL, 'w'},
+		{"save", required_argument, NULL, 'o'},
+		{"baseline", required_argument, NULL, 'b'},
+		{NULL, 0, NULL, 0}
+	};
+	char *list = NULL, *save_fn = NULL, *base_fn = NULL;
+	int n_frames = 8, seek = 0, runs = 15, warmup = 3, n_base = 0;
+	result_t base[32], res;
+	const kernel_t *k;
+	corpus_t corpus;
+	double *samples, t, units, u;
+	FILE *save = NULL;
+	int c, i, j, r;
+
+	while ((c = getopt_long(argc, argv, "k:n:j:r:w:o:b:", longopts, NULL)) != -1)
+	{
+		switch (c)
+		{
+			case 'k':
+				list = optarg;
+				break;
+			case 'n':
+				n_frames = MAX(1, atoi(optarg));
+				break;
+			case 'j':
+				seek = MAX(0, atoi(optarg));
+				break;
+			case 'r':
+				runs = MAX(1, atoi(optarg));
+				break;
+			case 'w':
+				warmup = MAX(0, atoi(optarg));
+				break;
+			case 'o':
+				save_fn = optarg;
+				break;
+			case 'b':
+				base_fn = optarg;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if (optind != argc - 1)
+	{
+		usage();
+		return 1;
+	}
+
+	if (base_fn != NULL && (n_base = load_baseline(base_fn, base, 32)) < 0)
+		return 1;
+	memset(&corpus, 0, sizeof(corpus_t));
+	if (capture(&corpus, argv[optind], n_frames, seek))
+		return 1;
+	if (save_fn != NULL && (save = fopen(save_fn, "w")) == NULL)
+	{
+		perror("Error opening baseline for writing");
+		return 1;
+	}
+
+	samples = malloc(runs * sizeof(double));
+	printf("%-14s %-8s %10s %10s %10s%s\n", "Kernel", "Unit", "Median", "P10", "P90", n_base ? "     Change" : "");
+	for (k = kernels; k->name != NULL; k++)
+	{
+		if (!selected(list, k->name))
+			continue;
+		corpus.png_bytes = 0;
+		for (r = -warmup; r < runs; r++)
+		{
+			t = units = 0;
+			for (i = 0; i < corpus.n; i++)
+			{
+				t += k->run(&corpus, i, &u);
+				units += u;
+			}
+			if (r >= 0)
+				samples[r] = units > 0 ? t * 1e9 / units : 0;
+		}
+		qsort(samples, runs, sizeof(double), cmp_double);
+
+		snprintf(res.name, sizeof(res.name), "%s", k->name);
+		snprintf(res.unit, sizeof(res.unit), "ns/%s", k->unit);
+		res.median = percentile(samples, runs, 0.5);
+		res.p10 = percentile(samples, runs, 0.1);
+		res.p90 = percentile(samples, runs, 0.9);
+		printf("%-14s %-8s %10.3f %10.3f %10.3f", res.name, res.unit, res.median, res.p10, res.p90);
+		for (j = 0; j < n_base; j++)
+			if (!strcmp(base[j].name, res.name) && base[j].median > 0)
+				break;
+		if (j < n_base)
+			printf(" %+9.1f%%", 100 * (res.median - base[j].median) / base[j].median);
+		else if (n_base)
+			printf(" %10s", "-");
+		printf("\n");
+		if (corpus.png_bytes)
+			fprintf(stderr, "%s wrote %.1f kB of PNG files per frame.\n", k->name, corpus.png_bytes / 1000.0 / (warmup + runs) / corpus.n);
+		fflush(stdout);
+		if (save != NULL)
+			fprintf(save, "%s %s %.4f %.4f %.4f\n", res.name, res.unit, res.median, res.p10, res.p90);
+	}
+
+	free(samples);
+	if (save != NULL && fclose(save))
+	{
+		perror("Error writing baseline");
+		return 1;
+	}
+	close_sup_writer(corpus.sw);
+
+	return 0;
+}
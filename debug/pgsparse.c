@@ -21,32 +21,20 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include "sup_reader.h"
+#include "../sup_index.h"
 
-#ifdef BE_ARCH
-#define SWAP32(x) (x)
-#define SWAP16(x) (x)
-#endif
-#ifdef LE_ARCH
-#define SWAP32(x) ((int32_t)(((x & 0xff000000) >> 24) | ((x & 0xff0000) >> 8) | ((x & 0xff00) << 8) | ((x & 0xff) << 24)))
-#define SWAP16(x) ((int16_t)(((x & 0xff) << 8) | ((x & 0xff00) >> 8)))
-#endif
-#ifndef LE_ARCH
-#ifndef BE_ARCH
-#error "Please specify endian-ness with -DLE_ARCH or -DBE_ARCH."
-#endif
-#endif
-
-#define MAX(a,b) ((a) > (b) ? (a) : (b))
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
 
 typedef struct parser_state_s
 {
-	FILE *fh;
+	sup_reader_t *r;
 	int total_object_sizes;
 	int images;
 	int palettes;
 	int diff_palettes;
-	char last_pal[256 * 5];
+	uint8_t last_pal[256 * 5];
 } parser_state_t;
 
 void clear_palette (parser_state_t *ps)
@@ -62,57 +50,12 @@ void clear_stats (parser_state_t *ps)
 	ps->diff_palettes = 0;
 }
 
-parser_state_t *new_sup_parser (char *filename)
+void die (sup_segment_t *s, char *error)
 {
-	parser_state_t *ps = malloc(sizeof(parser_state_t));
-
-	if ((ps->fh = fopen(filename, "rb")) == NULL)
-	{
-		fprintf(stderr, "Couldn't open SUP file (%s): ", filename);
-		perror(NULL);
-		abort();
-	}
-
-	clear_stats(ps);
-	clear_palette(ps);
-
-	return ps;
-}
-
-void die (FILE *fh, int offset, char *error)
-{
-	fprintf(stderr, "Error at %08x: %s\n", (int)ftell(fh) - offset, error);
+	fprintf(stderr, "Error at %08x: %s\n", (unsigned int)s->offset, error);
 	exit(1);
 }
 
-void safe_read (void *p, int size, FILE *fh, char *desc)
-{
-	char *error;
-	int r;
-
-	if ((r = fread(p, 1, size, fh)) != size)
-	{
-		error = malloc(128);
-		error[127] = 0;
-		snprintf(error, 127, "Could not read all %uB of %s.", size, desc);
-		die(fh, r, error);
-	}
-}
-
-void safe_seek (FILE *fh, int pos, char *desc)
-{
-	char *error;
-
-	if (fseek(fh, pos, SEEK_CUR))
-	{
-		error = malloc(128);
-		error[127] = 0;
-		snprintf(error, 127, "Unexpected seek failure during %s.", desc);
-		perror(error);
-		abort();
-	}
-}
-
 typedef struct fps_id_s
 {
 	int num;
@@ -139,408 +82,500 @@ int get_fps (int id, int *fps_num, int *fps_den)
 	return 0;
 }
 
-typedef struct sup_header_s
-{
-	uint8_t m1;          /* 'P' */
-	uint8_t m2;          /* 'G' */
-	uint32_t start_time;
-	uint32_t dts;
-	uint8_t packet_type; /* 0x16 = pcs_start/end, 0x17 = wds, 0x14 = palette, 0x15 = ods_first, 0x80 = null */
-	uint16_t packet_len;
-} __attribute ((packed)) sup_header_t;
-
-void conv_sup_header (sup_header_t *h)
-{
-	h->start_time = SWAP32(h->start_time);
-	h->dts = SWAP32(h->dts);
-	h->packet_len = SWAP16(h->packet_len);
-}
-
 void print_ts (uint32_t ts)
 {
 	printf("%.7fs (%u/90000s)", ((double)ts) / 90000, ts);
 }
 
-typedef struct sup_palette_s
+/* Palette: uint16 palette, then 5 bytes per entry */
+void read_palette (parser_state_t *ps, sup_segment_t *s)
 {
-	uint16_t palette; /* FIXME */
-} __attribute ((packed)) sup_palette_t;
+	int p_size;
 
-void conv_sup_palette (sup_palette_t *p)
-{
-	p->palette = SWAP16(p->palette);
-}
-
-void read_palette (parser_state_t *ps, sup_header_t h)
-{
-	sup_palette_t p;
-	char *palette = malloc(5*256);
-	int i, p_size;
-
-	if (h.packet_len < 2+5)
-		die(ps->fh, sizeof(h), "Undersized palette packet.");
-	if (h.packet_len > 2+5*256)
-		die(ps->fh, sizeof(h), "Oversized palette packet.");
-
-	safe_read(&p, sizeof(p), ps->fh, "palette marker");
-	conv_sup_palette(&p);
+	if (s->len < 2+5)
+		die(s, "Undersized palette packet.");
+	if (s->len > 2+5*256)
+		die(s, "Oversized palette packet.");
 
 	printf("Palette\n");
-	printf("\tpalette = %u\n", p.palette);
+	printf("\tpalette = %u\n", seg_u16(s, 0));
 	(ps->palettes)++;
 
-	p_size = h.packet_len - 2;
-	safe_read(palette, p_size, ps->fh, "palette");
-	for (i = 0; i < p_size; i++)
-		if (palette[i] != ps->last_pal[i])
-		{
-			(ps->diff_palettes)++;
-			clear_palette(ps);
-			memcpy(ps->last_pal, palette, p_size);
-			break;
-		}
-	free(palette);
-}
-
-typedef struct sup_ods_next_s
-{
-	uint16_t picture;
-	uint8_t m; /* 0 */
-	uint8_t last; /* 0 if not, if 64 yes */
-} __attribute ((packed)) sup_ods_next_t;
-
-void conv_sup_ods_next (sup_ods_next_t *odsn)
-{
-	odsn->picture = SWAP16(odsn->picture);
+	p_size = s->len - 2;
+	if (memcmp(s->data + 2, ps->last_pal, p_size))
+	{
+		(ps->diff_palettes)++;
+		clear_palette(ps);
+		memcpy(ps->last_pal, s->data + 2, p_size);
+	}
 }
 
-void read_odsn (parser_state_t *ps, sup_header_t h)
+/* ODS next: uint16 picture, uint8 0, uint8 last (0 or 64) */
+void read_odsn (parser_state_t *ps, sup_segment_t *s)
 {
-	sup_ods_next_t odsn;
+	uint8_t last = seg_u8(s, 3);
 
-	if (h.packet_len < sizeof(odsn))
-		die(ps->fh, sizeof(h), "Undersized ODSN packet.");
+	if (s->len < 4)
+		die(s, "Undersized ODSN packet.");
+	if (seg_u8(s, 2) != 0 || (last != 0 && last != 64))
+		die(s, "Invalid ODSN magic.");
 
-	safe_read(&odsn, sizeof(odsn), ps->fh, "ODSN structure");
-	conv_sup_ods_next(&odsn);
-	if (odsn.m != 0 || (odsn.last != 0 && odsn.last != 64))
-		die(ps->fh, sizeof(odsn), "Invalid ODSN magic.");
 	printf("ODS next\n");
-	printf("\tpicture = %u\n", odsn.picture);
-	printf("\tlast    = %s (%u)\n", odsn.last ? "yes" : "no", odsn.last);
-
-	safe_seek(ps->fh, h.packet_len - sizeof(odsn), "ODSN data");
-}
-
-typedef struct sup_ods_first_s
-{
-	uint16_t picture;
-	uint8_t palette; /* FIXME */
-	uint32_t magic_len; /* (single_packet ? 0xc0000000 : 0x80000000) | (length + 4) */
-	uint16_t width;
-	uint16_t height;
-} __attribute ((packed)) sup_ods_first_t;
-
-void conv_sup_ods_first (sup_ods_first_t *odsf)
-{
-	odsf->picture = SWAP16(odsf->picture);
-	odsf->magic_len = SWAP32(odsf->magic_len);
-	odsf->width = SWAP16(odsf->width);
-	odsf->height = SWAP16(odsf->height);
+	printf("\tpicture = %u\n", seg_u16(s, 0));
+	printf("\tlast    = %s (%u)\n", last ? "yes" : "no", last);
 }
 
-void read_odsf (parser_state_t *ps, sup_header_t h)
+/* ODS first: uint16 picture, uint8 palette, uint32 magic_len, uint16 width,
+ * uint16 height, magic_len being (single_packet ? 0xc0000000 : 0x80000000) | (length + 4)
+ */
+void read_odsf (parser_state_t *ps, sup_segment_t *s)
 {
-	sup_ods_first_t odsf;
-
-	if (h.packet_len < sizeof(odsf))
-		die(ps->fh, sizeof(h), "Undersized ODSF packet.");
+	uint32_t magic_len = seg_u32(s, 3);
 
-	safe_read(&odsf, sizeof(odsf), ps->fh, "ODSF structure");
-	conv_sup_ods_first(&odsf);
+	if (s->len < 11)
+		die(s, "Undersized ODSF packet.");
 
-	if ((odsf.magic_len & 0x80000000) && (odsf.magic_len & 0x40000000))
+	if ((magic_len & 0x80000000) && (magic_len & 0x40000000))
 	{
 		printf("ODS first\n\todsf type = single\n");
 	}
-	else if (odsf.magic_len & 0x80000000)
+	else if (magic_len & 0x80000000)
 	{
 		printf("ODS first\n\todsf type = multi\n");
 	}
 	else
 	{
-		fseek(ps->fh, -sizeof(odsf), SEEK_CUR);
-		read_odsn(ps, h);
+		read_odsn(ps, s);
 		return;
 	}
 
-	ps->total_object_sizes += odsf.width * odsf.height;
+	ps->total_object_sizes += seg_u16(s, 7) * seg_u16(s, 9);
 	(ps->images)++;
-	printf("\tpicture   = %u\n", odsf.picture);
-	printf("\tpalette   = %u\n", odsf.palette);
-	printf("\tlength    = %u (incl. + 4)\n", odsf.magic_len & 0x3fffffff);
-	printf("\twidth     = %u\n", odsf.width);
-	printf("\theight    = %u\n", odsf.height);
 
-	safe_seek(ps->fh, h.packet_len - sizeof(odsf), "OSDF data");
+	printf("\tpicture   = %u\n", seg_u16(s, 0));
+	printf("\tpalette   = %u\n", seg_u8(s, 2));
+	printf("\tlength    = %u (incl. + 4)\n", magic_len & 0x3fffffff);
+	printf("\twidth     = %u\n", seg_u16(s, 7));
+	printf("\theight    = %u\n", seg_u16(s, 9));
 }
 
-typedef struct sup_wds_s
+/* WDS: uint8 objects, then per object uint8 id, uint16 x, y, width, height */
+void read_wds (parser_state_t *ps, sup_segment_t *s)
 {
-	uint8_t objects; /* 1 or 2 */
-} __attribute ((packed)) sup_wds_t;
+	int objects = seg_u8(s, 0);
+	int i, o;
 
-void conv_sup_wds (sup_wds_t *wds)
-{
-	/* Do nothing. */
-}
-
-typedef struct sup_wds_obj_s
-{
-	uint8_t object; /* 0 or 1 */
-	uint16_t x_off;
-	uint16_t y_off;
-	uint16_t width;
-	uint16_t height;
-} __attribute ((packed)) sup_wds_obj_t;
-
-void conv_sup_wds_obj (sup_wds_obj_t *wdso)
-{
-	wdso->x_off = SWAP16(wdso->x_off);
-	wdso->y_off = SWAP16(wdso->y_off);
-	wdso->width = SWAP16(wdso->width);
-	wdso->height = SWAP16(wdso->height);
-}
-
-void read_wds (parser_state_t *ps, sup_header_t h)
-{
-	sup_wds_t wds;
-	sup_wds_obj_t wdso;
-	int i;
-
-	if (h.packet_len != sizeof(wds) + sizeof(wdso) && h.packet_len != sizeof(wds) + 2 * sizeof(wdso))
-		die(ps->fh, sizeof(h), "Bad size for WDS packet.");
-
-	safe_read(&wds, sizeof(wds), ps->fh, "WDS structure");
-	conv_sup_wds(&wds);
-	if (wds.objects != 1 && wds.objects != 2)
-		die(ps->fh, sizeof(wds), "Invalid number of WDS objects.");
+	if (s->len != 1 + 9 && s->len != 1 + 2 * 9)
+		die(s, "Bad size for WDS packet.");
+	if (objects != 1 && objects != 2)
+		die(s, "Invalid number of WDS objects.");
 
 	printf("WDS\n");
-	printf("\tobjects = %u\n", wds.objects);
+	printf("\tobjects = %u\n", objects);
 
-	for (i = 0; i < wds.objects; i++)
+	for (i = 0; i < objects; i++)
 	{
-		safe_read(&wdso, sizeof(wdso), ps->fh, "WDS object structure");
-		conv_sup_wds_obj(&wdso);
-
-		if (wdso.object != 0 && wdso.object != 1)
-			die(ps->fh, sizeof(wdso), "Invalid object id in WDS object.");
-
-		printf("\tObject %u\n", wdso.object + 1);
-		printf("\t\tx offset = %u\n", wdso.x_off);
-		printf("\t\ty offset = %u\n", wdso.y_off);
-		printf("\t\twidth    = %u\n", wdso.width);
-		printf("\t\theight   = %u\n", wdso.height);
+		o = 1 + i * 9;
+		if (seg_u8(s, o) != 0 && seg_u8(s, o) != 1)
+			die(s, "Invalid object id in WDS object.");
+
+		printf("\tObject %u\n", seg_u8(s, o) + 1);
+		printf("\t\tx offset = %u\n", seg_u16(s, o + 1));
+		printf("\t\ty offset = %u\n", seg_u16(s, o + 3));
+		printf("\t\twidth    = %u\n", seg_u16(s, o + 5));
+		printf("\t\theight   = %u\n", seg_u16(s, o + 7));
 	}
 }
 
-typedef struct sup_pcs_start_s
-{
-	uint16_t width;
-	uint16_t height; /* height - 2 * Core.getCropOfsY */
-	uint8_t fps_id; /* getFpsId() */
-	uint16_t comp_num;
-	uint8_t follower;  /* 0x80 if first or single, 0x40 if follows directly (end = start) or the frame after */
-	uint16_t m; /* 0 */
-	uint8_t objects; /* 1 */
-} __attribute ((packed)) sup_pcs_start_t;
-
-void conv_sup_pcs_start (sup_pcs_start_t *pcss)
+/* PCS start: uint16 width, height, uint8 fps_id, uint16 comp_num,
+ * uint8 follower, uint16 0, uint8 objects, then per object uint16 picture,
+ * uint8 window, uint8 forced, uint16 x, y
+ */
+void read_pcs_start (parser_state_t *ps, sup_segment_t *s)
 {
-	pcss->width = SWAP16(pcss->width);
-	pcss->height = SWAP16(pcss->height);
-	pcss->comp_num = SWAP16(pcss->comp_num);
-	pcss->m = SWAP16(pcss->m);
-}
-
-typedef struct sup_pcs_start_obj_s
-{
-	uint16_t picture;
-	uint8_t window;
-	uint8_t forced; /* forced ? 64 : 0 */
-	uint16_t x_off;
-	uint16_t y_off;
-} __attribute ((packed)) sup_pcs_start_obj_t;
-
-void conv_sup_pcs_start_obj (sup_pcs_start_obj_t *pcsso)
-{
-	pcsso->picture = SWAP16(pcsso->picture);
-	pcsso->x_off = SWAP16(pcsso->x_off);
-	pcsso->y_off = SWAP16(pcsso->y_off);
-}
+	int fps_num, fps_den, i, o;
+	int objects = seg_u8(s, 10);
 
-void read_pcs_start (parser_state_t *ps, sup_header_t h)
-{
-	sup_pcs_start_t pcss;
-	sup_pcs_start_obj_t pcsso;
-	int fps_num, fps_den, i;
-
-	safe_read(&pcss, sizeof(pcss), ps->fh, "PCSS structure");
-	conv_sup_pcs_start(&pcss);
-
-	if (pcss.m != 0)
-		die(ps->fh, sizeof(pcss), "Invalid PCSS magic.");
+	if (seg_u16(s, 8) != 0)
+		die(s, "Invalid PCSS magic.");
 
 	printf("PCS start\n");
 
-	printf("\tframe width  = %u\n", pcss.width);
-	printf("\tframe height = %u\n", pcss.height);
-	if (!get_fps(pcss.fps_id, &fps_num, &fps_den))
-		die(ps->fh, sizeof(pcss), "Invalid FPS ID in PCSS.");
-	printf("\tfps id       = %u (%u/%u)\n", pcss.fps_id, fps_num, fps_den);
-	printf("\tcomposition  = %u\n", pcss.comp_num);
-	printf("\tfollower     = 0x%02X (%s)\n", pcss.follower, pcss.follower == 0x80 ? "no" : "within 2f");
-	printf("\tobjects      = %u\n", pcss.objects);
+	printf("\tframe width  = %u\n", seg_u16(s, 0));
+	printf("\tframe height = %u\n", seg_u16(s, 2));
+	if (!get_fps(seg_u8(s, 4), &fps_num, &fps_den))
+		die(s, "Invalid FPS ID in PCSS.");
+	printf("\tfps id       = %u (%u/%u)\n", seg_u8(s, 4), fps_num, fps_den);
+	printf("\tcomposition  = %u\n", seg_u16(s, 5));
+	printf("\tfollower     = 0x%02X (%s)\n", seg_u8(s, 7), seg_u8(s, 7) == 0x80 ? "no" : "within 2f");
+	printf("\tobjects      = %u\n", objects);
 
-	if (pcss.objects > 2)
-		die(ps->fh, sizeof(pcss), "Invalid number of objects (must be 1 or 2).");
+	if (objects > 2)
+		die(s, "Invalid number of objects (must be 1 or 2).");
 
-	for (i = 0; i < pcss.objects; i++)
+	for (i = 0; i < objects; i++)
 	{
-		safe_read(&pcsso, sizeof(pcsso), ps->fh, "PCSSO structure");
-		conv_sup_pcs_start_obj(&pcsso);
-
-		if (pcsso.window != 0 && pcsso.window != 1)
-			die(ps->fh, sizeof(pcsso), "Invalid window id in PCSS object.");
+		o = 11 + i * 8;
+		if (seg_u8(s, o + 2) != 0 && seg_u8(s, o + 2) != 1)
+			die(s, "Invalid window id in PCSS object.");
 		printf("\tObject %u\n", i + 1);
-		if (pcsso.forced && (pcsso.forced != 64))
-			die(ps->fh, sizeof(pcsso), "Invalid forced flag in PCSS object.");
-		printf("\t\tpicture  = %u\n", pcsso.picture);
-		printf("\t\twindow   = %u\n", pcsso.window);
-		printf("\t\tforced   = %u\n", pcsso.forced);
-		printf("\t\tx offset = %u\n", pcsso.x_off);
-		printf("\t\ty offset = %u\n", pcsso.y_off);
+		if (seg_u8(s, o + 3) && (seg_u8(s, o + 3) != 64))
+			die(s, "Invalid forced flag in PCSS object.");
+		printf("\t\tpicture  = %u\n", seg_u16(s, o));
+		printf("\t\twindow   = %u\n", seg_u8(s, o + 2));
+		printf("\t\tforced   = %u\n", seg_u8(s, o + 3));
+		printf("\t\tx offset = %u\n", seg_u16(s, o + 4));
+		printf("\t\ty offset = %u\n", seg_u16(s, o + 6));
 	}
 }
 
-typedef struct sup_pcs_end_s
-{
-	uint16_t width;
-	uint16_t height;
-	uint8_t fps_id;
-	uint16_t comp_num;
-	uint32_t m;
-} __attribute ((packed)) sup_pcs_end_t;
-
-void conv_sup_pcs_end (sup_pcs_end_t *pcse)
-{
-	pcse->width = SWAP16(pcse->width);
-	pcse->height = SWAP16(pcse->height);
-	pcse->comp_num = SWAP16(pcse->comp_num);
-	pcse->m = SWAP32(pcse->m);
-}
-
-void read_pcs_end (parser_state_t *ps, sup_header_t h)
+/* PCS end: uint16 width, height, uint8 fps_id, uint16 comp_num, uint32 0 */
+void read_pcs_end (parser_state_t *ps, sup_segment_t *s)
 {
-	sup_pcs_end_t pcse;
 	int fps_num, fps_den;
 
-	safe_read(&pcse, sizeof(pcse), ps->fh, "PCSE structure");
-	conv_sup_pcs_end(&pcse);
-
-	if (pcse.m != 0)
-		die(ps->fh, sizeof(pcse), "Invalid PCSE magic.");
+	if (seg_u32(s, 7) != 0)
+		die(s, "Invalid PCSE magic.");
 
 	printf("PCS end\n");
 
-	printf("\tsubtitle width  = %u\n", pcse.width);
-	printf("\tsubtitle height = %u\n", pcse.height);
-	if (!get_fps(pcse.fps_id, &fps_num, &fps_den))
-		die(ps->fh, sizeof(pcse), "Invalid FPS ID in PCSE.");
-	printf("\tfps id          = %u (%u/%u)\n", pcse.fps_id, fps_num, fps_den);
-	printf("\tcomposition     = %u\n", pcse.comp_num);
+	printf("\tsubtitle width  = %u\n", seg_u16(s, 0));
+	printf("\tsubtitle height = %u\n", seg_u16(s, 2));
+	if (!get_fps(seg_u8(s, 4), &fps_num, &fps_den))
+		die(s, "Invalid FPS ID in PCSE.");
+	printf("\tfps id          = %u (%u/%u)\n", seg_u8(s, 4), fps_num, fps_den);
+	printf("\tcomposition     = %u\n", seg_u16(s, 5));
 	printf("\tStats\n\t\ttot_ob_size   = %u\n\t\timages        = %u\n\t\tpalettes      = %u\n\t\tdiff_palettes = %u\n", ps->total_object_sizes, ps->images, ps->palettes, ps->diff_palettes);
+
 	clear_stats(ps);
 	clear_palette(ps);
 }
 
-void read_sup (parser_state_t *ps)
+int print_segment (sup_segment_t *s, void *arg)
 {
-	sup_header_t h;
-
-	safe_read(&h, sizeof(h), ps->fh, "PG header");
-	conv_sup_header(&h);
-
-	if (h.m1 != 80 || h.m2 != 71)
-		die(ps->fh, sizeof(h), "Invalid PG header.");
+	parser_state_t *ps = arg;
 
-	printf("Packet at 0x%08x:\nstart_time = ", (unsigned int)(ftell(ps->fh) - sizeof(h)));
-	print_ts(h.start_time);
+	printf("Packet at 0x%08x:\nstart_time = ", (unsigned int)s->offset);
+	print_ts(s->pts);
 	printf("\ndts        = ");
-	print_ts(h.dts);
-	printf("\ntype       = 0x%02X\n", h.packet_type);
-	printf("length     = %u\n", h.packet_len);
-	switch (h.packet_type)
+	print_ts(s->dts);
+	printf("\ntype       = 0x%02X\n", s->type);
+	printf("length     = %u\n", s->len);
+
+	switch (s->type)
 	{
-		case 0x14:
-			read_palette(ps, h);
+		case SUP_PDS:
+			read_palette(ps, s);
 			break;
-		case 0x15:
-			read_odsf(ps, h);
+		case SUP_ODS:
+			read_odsf(ps, s);
 			break;
-		case 0x16:
-			switch (h.packet_len)
+		case SUP_PCS:
+			switch (s->len)
 			{
 				case 11:
-					read_pcs_end(ps, h);
+					read_pcs_end(ps, s);
 					break;
 				case 19:
 				case 27:
-					read_pcs_start(ps, h);
+					read_pcs_start(ps, s);
 					break;
 				default:
-					die(ps->fh, sizeof(h), "Invalid PCS size.");
+					die(s, "Invalid PCS size.");
 			}
 			break;
-		case 0x17:
-			read_wds(ps, h);
+		case SUP_WDS:
+			read_wds(ps, s);
 			break;
-		case 0x80:
-			if (h.packet_len == 0)
+		case SUP_END:
+			if (s->len == 0)
 				printf("Marker\n");
 			else
-				die(ps->fh, sizeof(h), "Marker with payload.");
+				die(s, "Marker with payload.");
 			break;
 		default:
-			die(ps->fh, sizeof(h), "Unknown packet type.");
+			die(s, "Unknown packet type.");
 	}
 
 	printf("\n");
+
+	return 0;
+}
+
+/* Statistics mode */
+
+#define MAX_IDS 256
+
+typedef struct epoch_stats_s
+{
+	uint32_t start;
+	uint32_t end;
+	uint64_t bytes;
+	int display_sets;
+	int palette_updates;
+	int n_objects;
+	int n_palettes;
+	int object_id[MAX_IDS];
+	int object_size[MAX_IDS];
+	int palette_id[MAX_IDS];
+	int64_t buffer;
+	int64_t peak_buffer;
+} epoch_stats_t;
+
+typedef struct stats_state_s
+{
+	uint64_t bytes;
+	int segments;
+	int epochs;
+	int cleared;         /* Last PCS removed all objects */
+	epoch_stats_t e;
+} stats_state_t;
+
+static void print_epoch (stats_state_t *st)
+{
+	epoch_stats_t *e = &(st->e);
+
+	if (!e->display_sets)
+		return;
+	printf("%s{\"start_pts\": %u, \"end_pts\": %u, \"bytes\": %llu, \"display_sets\": %d, \"objects\": %d, \"palettes\": %d, \"palette_updates\": %d, \"peak_buffer\": %lld}",
+		st->epochs ? ", " : "", e->start, e->end, (unsigned long long)e->bytes, e->display_sets, e->n_objects, e->n_palettes, e->palette_updates, (long long)e->peak_buffer);
+	(st->epochs)++;
+}
+
+static void add_id (int *ids, int *n, int id)
+{
+	int i;
+
+	for (i = 0; i < *n; i++)
+		if (ids[i] == id)
+			return;
+	if (*n < MAX_IDS)
+		ids[(*n)++] = id;
+}
+
+int stats_segment (sup_segment_t *s, void *arg)
+{
+	stats_state_t *st = arg;
+	epoch_stats_t *e = &(st->e);
+	int i, id, size;
+
+	if (s->type == SUP_PCS)
+	{
+		/* Epoch start, or first composition after the screen was cleared */
+		if (seg_u8(s, 7) == 0x80 || st->cleared)
+		{
+			print_epoch(st);
+			memset(e, 0, sizeof(epoch_stats_t));
+			e->start = s->pts;
+		}
+		st->cleared = s->len <= 11 || !seg_u8(s, 10);
+		(e->display_sets)++;
+		e->end = s->pts;
+	}
+
+	st->bytes += SUP_HEADER_SIZE + s->len;
+	(st->segments)++;
+	e->bytes += SUP_HEADER_SIZE + s->len;
+
+	if (s->type == SUP_PDS)
+	{
+		/* Byte 0 is the palette id, byte 1 its version */
+		(e->palette_updates)++;
+		add_id(e->palette_id, &(e->n_palettes), seg_u8(s, 0));
+	}
+	else if (s->type == SUP_ODS && (seg_u8(s, 3) & 0x80))
+	{
+		/* First fragment of an object, which defines its size */
+		id = seg_u16(s, 0);
+		size = seg_u16(s, 7) * seg_u16(s, 9);
+		for (i = 0; i < e->n_objects && e->object_id[i] != id; i++)
+			;
+		if (i == e->n_objects)
+		{
+			add_id(e->object_id, &(e->n_objects), id);
+			e->object_size[i] = 0;
+		}
+		if (i < MAX_IDS)
+		{
+			e->buffer += size - e->object_size[i];
+			e->object_size[i] = size;
+		}
+		e->peak_buffer = MAX(e->peak_buffer, e->buffer);
+	}
+
+	return 0;
+}
+
+static void print_json_string (const char *str)
+{
+	putchar('"');
+	for (; *str; str++)
+	{
+		if (*str == '"' || *str == '\\')
+			printf("\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			printf("\\u%04x", *str);
+		else
+			putchar(*str);
+	}
+	putchar('"');
+}
+
+/* Print one JSON object per file and line */
+int print_stats (char *filename)
+{
+	stats_state_t st;
+	sup_reader_t *r;
+	int ret;
+
+	if ((r = open_sup_reader(filename)) == NULL)
+		return 1;
+
+	memset(&st, 0, sizeof(st));
+	printf("{\"file\": ");
+	print_json_string(filename);
+	printf(", \"epochs\": [");
+	ret = sup_reader_walk(r, stats_segment, &st);
+	print_epoch(&st);
+	printf("], \"segments\": %d, \"bytes\": %llu", st.segments, (unsigned long long)st.bytes);
+	if (ret < 0)
+	{
+		printf(", \"error\": ");
+		print_json_string(r->error);
+		fprintf(stderr, "Error at %08x in %s: %s\n", (unsigned int)r->pos, filename, r->error);
+	}
+	printf("}\n");
+
+	close_sup_reader(r);
+
+	return ret < 0;
+}
+
+typedef struct index_entry_s
+{
+	uint32_t pts;
+	uint32_t dts;
+	uint64_t offset;
+	int flags;
+	int comp_num;
+} index_entry_t;
+
+uint32_t get_be32 (uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+index_entry_t *read_index (char *filename, int *n)
+{
+	FILE *fh;
+	uint8_t header[SUP_INDEX_HEADER_SIZE], e[SUP_INDEX_ENTRY_SIZE];
+	index_entry_t *idx;
+	int i;
+
+	if ((fh = fopen(filename, "rb")) == NULL)
+	{
+		fprintf(stderr, "Couldn't open index file (%s): ", filename);
+		perror(NULL);
+		exit(1);
+	}
+
+	if (fread(header, sizeof(header), 1, fh) != 1 || memcmp(header, SUP_INDEX_MAGIC, 4) || get_be32(header + 4) != SUP_INDEX_VERSION)
+	{
+		fprintf(stderr, "Invalid index header.\n");
+		exit(1);
+	}
+	*n = get_be32(header + 8);
+
+	idx = malloc(*n * sizeof(index_entry_t));
+	for (i = 0; i < *n; i++)
+	{
+		if (fread(e, sizeof(e), 1, fh) != 1)
+		{
+			fprintf(stderr, "Could not read all %u index entries.\n", *n);
+			exit(1);
+		}
+		idx[i].pts = get_be32(e);
+		idx[i].dts = get_be32(e + 4);
+		idx[i].offset = ((uint64_t)get_be32(e + 8) << 32) | get_be32(e + 12);
+		idx[i].flags = e[16];
+		idx[i].comp_num = (e[18] << 8) | e[19];
+	}
+	fclose(fh);
+
+	return idx;
+}
+
+/* Last display set starting at or before pts, or the first one */
+int find_index (index_entry_t *idx, int n, uint32_t pts)
+{
+	int lo = 0, hi = n - 1, mid;
+
+	while (lo < hi)
+	{
+		mid = (lo + hi + 1) / 2;
+		if (idx[mid].pts <= pts)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return lo;
 }
 
 int main (int argc, char *argv[])
 {
-	parser_state_t *ps;
-	size_t last;
+	parser_state_t ps;
+	sup_segment_t seg;
+	index_entry_t *idx;
+	uint64_t last = UINT64_MAX;
+	int n, i, ret = 0;
 
-	if (argc != 2)
+	if (argc >= 3 && !strcmp(argv[1], "--stats"))
 	{
-		printf("Usage: pgsparse SUPFILE\n");
+		for (i = 2, ret = 0; i < argc; i++)
+			ret |= print_stats(argv[i]);
+		return ret;
+	}
+
+	if (argc != 2 && argc != 4)
+	{
+		printf("Usage: pgsparse SUPFILE [INDEXFILE SECONDS]\n");
+		printf("       pgsparse --stats SUPFILE...\n");
+		printf("With an index, only the display set shown at SECONDS is parsed.\n");
+		printf("With --stats, per epoch totals are printed as one JSON object per file.\n");
 		return 0;
 	}
 
-	ps = new_sup_parser(argv[1]);
+	if ((ps.r = open_sup_reader(argv[1])) == NULL)
+		return 1;
+	clear_stats(&ps);
+	clear_palette(&ps);
 
-	fseek(ps->fh, 0, SEEK_END);
-	last = ftell(ps->fh);
-	fseek(ps->fh, 0, SEEK_SET);
+	if (argc == 4)
+	{
+		idx = read_index(argv[2], &n);
+		if (!n)
+		{
+			printf("Index is empty.\n");
+			return 0;
+		}
+		i = find_index(idx, n, (uint32_t)floor(atof(argv[3]) * 90000 + 0.5));
+		printf("Display set %d of %d, composition %d%s\n\n", i + 1, n, idx[i].comp_num, (idx[i].flags & SUP_INDEX_EPOCH_START) ? ", epoch start" : "");
+		sup_reader_seek(ps.r, idx[i].offset);
+		if (i + 1 < n)
+			last = idx[i + 1].offset;
+		free(idx);
+	}
 
-	while (!feof(ps->fh) && ftell(ps->fh) < last)
-		read_sup(ps);
-	
-	fclose(ps->fh);
+	while (ps.r->pos < last && (ret = sup_reader_next(ps.r, &seg)) == 1)
+		print_segment(&seg, &ps);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Error at %08x: %s\n", (unsigned int)ps.r->pos, ps.r->error);
+		return 1;
+	}
+
+	close_sup_reader(ps.r);
 
 	return 0;
 }
-
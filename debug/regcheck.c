@@ -0,0 +1,387 @@
+/*----------------------------------------------------------------------------
+ * regcheck - Digests avs2bdnxml output for comparison with golden files
+ * Copyright (C) 2010 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+/* Every SUP, XML and index file of a directory is described by a few lines
+ * of text: its size and CRC, the result of the same structural checks as
+ * pgsparse for SUP files, and the CRC of every picture decoded from it.
+ * SUP files are decoded with sup_decode, XML files with bdn_input, which
+ * reads their PNG files, so PNG compression does not matter. XML text is
+ * compared without carriage returns.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <zlib.h>
+#include "../sup_reader.h"
+#include "../sup_decode.h"
+#include "../bdn_input.h"
+
+#define MAX_DIFFS 10
+
+typedef struct check_state_s
+{
+	FILE *out;
+	const char *error;
+	uint64_t error_offset;
+	int in_display_set;
+	uint32_t last_pts;
+	int w, h;
+	int fps_id;
+	int display_sets;
+	int epochs;
+	int objects;
+	int palettes;
+} check_state_t;
+
+static int fps_ids[][3] = {{24000, 1001, 16}, {24, 1, 32}, {25, 1, 48}, {30000, 1001, 64}, {50, 1, 96}, {60000, 1001, 112}, {0, 0, 0}};
+
+static const char *check_pcs (check_state_t *st, sup_segment_t *s)
+{
+	int objects = seg_u8(s, 10), i, o;
+
+	if (s->len != 11 && s->len != 19 && s->len != 27)
+		return "Invalid PCS size.";
+	if (s->len > 11 && (objects < 1 || objects > 2 || s->len != 11 + 8 * objects))
+		return "Invalid number of PCS objects.";
+	for (i = 0; fps_ids[i][2] && fps_ids[i][2] != seg_u8(s, 4); i++)
+		;
+	if (!fps_ids[i][2])
+		return "Invalid FPS ID in PCS.";
+	if (!st->display_sets)
+	{
+		st->w = seg_u16(s, 0);
+		st->h = seg_u16(s, 2);
+		st->fps_id = i;
+	}
+	else if (st->w != seg_u16(s, 0) || st->h != seg_u16(s, 2) || st->fps_id != i)
+		return "PCS frame size or rate changed.";
+	if (st->display_sets && s->pts < st->last_pts)
+		return "PCS time went backwards.";
+	for (i = 0; s->len > 11 && i < objects; i++)
+	{
+		o = 11 + i * 8;
+		if (seg_u8(s, o + 2) > 1)
+			return "Invalid window id in PCS object.";
+		if (seg_u8(s, o + 3) && seg_u8(s, o + 3) != 64)
+			return "Invalid forced flag in PCS object.";
+	}
+	if (seg_u8(s, 7) == 0x80)
+		st->epochs++;
+	st->last_pts = s->pts;
+	st->display_sets++;
+
+	return NULL;
+}
+
+static int check_segment (sup_segment_t *s, void *arg)
+{
+	check_state_t *st = arg;
+	const char *err = NULL;
+
+	if (s->type != SUP_PCS && !st->in_display_set)
+		err = "Segment outside of a display set.";
+	else switch (s->type)
+	{
+		case SUP_PCS:
+			if (st->in_display_set)
+				err = "PCS before the end of the display set.";
+			else
+				err = check_pcs(st, s);
+			st->in_display_set = 1;
+			break;
+		case SUP_WDS:
+			if ((s->len != 1 + 9 && s->len != 1 + 2 * 9) || s->len != 1 + 9 * seg_u8(s, 0))
+				err = "Bad size for WDS.";
+			break;
+		case SUP_PDS:
+			if (s->len < 2 + 5 || s->len > 2 + 5 * 256 || (s->len - 2) % 5)
+				err = "Bad size for palette.";
+			st->palettes++;
+			break;
+		case SUP_ODS:
+			if (s->len < 4)
+				err = "Undersized ODS.";
+			else if (seg_u8(s, 3) & 0x80)
+			{
+				if (s->len < 11 || !seg_u16(s, 7) || !seg_u16(s, 9))
+					err = "Bad first ODS.";
+				st->objects++;
+			}
+			break;
+		case SUP_END:
+			if (s->len)
+				err = "Marker with payload.";
+			st->in_display_set = 0;
+			break;
+		default:
+			err = "Unknown segment type.";
+	}
+
+	if (err != NULL)
+	{
+		st->error = err;
+		st->error_offset = s->offset;
+		return 1;
+	}
+
+	return 0;
+}
+
+static uint32_t crc_file (const char *filename, long *size, int text)
+{
+	uint8_t buf[65536], *p, *q;
+	uint32_t crc = crc32(0, NULL, 0);
+	size_t n;
+	FILE *fh;
+
+	*size = -1;
+	if ((fh = fopen(filename, "rb")) == NULL)
+		return 0;
+	*size = 0;
+	while ((n = fread(buf, 1, sizeof(buf), fh)) > 0)
+	{
+		/* Drop carriage returns of text files written on Windows */
+		if (text)
+		{
+			for (p = q = buf; p < buf + n; p++)
+				if (*p != '\r')
+					*q++ = *p;
+			n = q - buf;
+		}
+		crc = crc32(crc, buf, n);
+		*size += n;
+	}
+	fclose(fh);
+
+	return crc;
+}
+
+static void digest_sup (FILE *out, const char *path, const char *name)
+{
+	check_state_t st;
+	sup_reader_t *r;
+	sup_decoder_t *d;
+	uint8_t *im;
+	int frame, next, ret;
+
+	memset(&st, 0, sizeof(st));
+	if ((r = open_sup_reader(path)) == NULL)
+	{
+		fprintf(out, "%s unreadable\n", name);
+		return;
+	}
+	ret = sup_reader_walk(r, check_segment, &st);
+	if (ret < 0)
+		fprintf(out, "%s broken at %08x: %s\n", name, (unsigned int)r->pos, r->error);
+	else if (st.error != NULL)
+		fprintf(out, "%s invalid at %08x: %s\n", name, (unsigned int)st.error_offset, st.error);
+	else if (st.in_display_set)
+		fprintf(out, "%s invalid: last display set has no end\n", name);
+	else
+		fprintf(out, "%s structure ok, %d epochs, %d display sets, %d objects, %d palettes\n", name, st.epochs, st.display_sets, st.objects, st.palettes);
+	close_sup_reader(r);
+	if (ret < 0 || st.error != NULL || !st.display_sets)
+		return;
+
+	if ((d = open_sup_decoder((char *)path, fps_ids[st.fps_id][0], fps_ids[st.fps_id][1])) == NULL)
+	{
+		fprintf(out, "%s undecodable\n", name);
+		return;
+	}
+	im = malloc(d->im_w * d->im_h * 4);
+	for (frame = 0; frame < INT_MAX; frame = next)
+	{
+		next = sup_decode_frame(d, im, frame);
+		fprintf(out, "%s frame %d crc %08x\n", name, frame, (unsigned int)crc32(0, im, d->im_w * d->im_h * 4));
+	}
+	free(im);
+	close_sup_decoder(d);
+}
+
+static void digest_xml (FILE *out, const char *path, const char *name)
+{
+	bdn_input_t *b;
+	uint8_t *im;
+	int frame, next;
+
+	if ((b = open_bdn_input((char *)path)) == NULL)
+	{
+		fprintf(out, "%s unreadable\n", name);
+		return;
+	}
+	fprintf(out, "%s %dx%d at %s, %d events\n", name, b->im_w, b->im_h, b->frame_rate, bdn_input_events(b));
+	im = malloc(b->im_w * b->im_h * 4);
+	for (frame = 0; frame < INT_MAX && bdn_input_events(b); frame = next)
+	{
+		next = bdn_input_frame(b, im, frame);
+		fprintf(out, "%s frame %d crc %08x\n", name, frame, (unsigned int)crc32(0, im, b->im_w * b->im_h * 4));
+	}
+	free(im);
+	close_bdn_input(b);
+}
+
+static int has_suffix (const char *s, const char *suffix)
+{
+	size_t l = strlen(s), m = strlen(suffix);
+
+	return l >= m && !strcmp(s + l - m, suffix);
+}
+
+static int cmp_names (const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int digest_dir (FILE *out, const char *dir)
+{
+	char **names = NULL, *path;
+	struct dirent *e;
+	int n = 0, size = 0, i;
+	uint32_t crc;
+	long bytes;
+	DIR *dh;
+
+	if ((dh = opendir(dir)) == NULL)
+	{
+		fprintf(stderr, "Cannot open directory: %s\n", dir);
+		return -1;
+	}
+	while ((e = readdir(dh)) != NULL)
+	{
+		if (!has_suffix(e->d_name, ".sup") && !has_suffix(e->d_name, ".xml") && !has_suffix(e->d_name, ".idx"))
+			continue;
+		if (n == size)
+		{
+			size = size ? size * 2 : 16;
+			names = realloc(names, size * sizeof(char *));
+		}
+		names[n++] = strdup(e->d_name);
+	}
+	closedir(dh);
+	/* Directory order differs between systems */
+	qsort(names, n, sizeof(char *), cmp_names);
+
+	for (i = 0; i < n; i++)
+	{
+		path = malloc(strlen(dir) + strlen(names[i]) + 2);
+		sprintf(path, "%s/%s", dir, names[i]);
+		crc = crc_file(path, &bytes, has_suffix(names[i], ".xml"));
+		fprintf(out, "%s bytes %ld crc %08x\n", names[i], bytes, (unsigned int)crc);
+		if (has_suffix(names[i], ".sup"))
+			digest_sup(out, path, names[i]);
+		else if (has_suffix(names[i], ".xml"))
+			digest_xml(out, path, names[i]);
+		free(path);
+		free(names[i]);
+	}
+	free(names);
+
+	return 0;
+}
+
+static char *read_line (FILE *fh, char *buf, int size)
+{
+	if (fgets(buf, size, fh) == NULL)
+		return NULL;
+	buf[strcspn(buf, "\r\n")] = 0;
+	return buf;
+}
+
+/* Compare two digests line by line. Returns the number of differences. */
+static int compare (const char *golden_fn, const char *digest_fn)
+{
+	char a[512], b[512], *la, *lb;
+	FILE *ga, *gb;
+	int line = 0, diffs = 0;
+
+	if ((ga = fopen(golden_fn, "r")) == NULL)
+	{
+		fprintf(stderr, "Cannot open golden file: %s\n", golden_fn);
+		return 1;
+	}
+	gb = fopen(digest_fn, "r");
+	while (1)
+	{
+		la = read_line(ga, a, sizeof(a));
+		lb = read_line(gb, b, sizeof(b));
+		if (la == NULL && lb == NULL)
+			break;
+		line++;
+		if (la != NULL && lb != NULL && !strcmp(la, lb))
+			continue;
+		if (diffs++ < MAX_DIFFS)
+			printf("Line %d\n  golden: %s\n  output: %s\n", line, la ? la : "(end)", lb ? lb : "(end)");
+	}
+	if (diffs > MAX_DIFFS)
+		printf("... %d more lines differ\n", diffs - MAX_DIFFS);
+	fclose(ga);
+	fclose(gb);
+
+	return diffs;
+}
+
+int main (int argc, char *argv[])
+{
+	char *out_fn = NULL, *golden_fn = NULL, *dir = NULL;
+	FILE *out;
+	int bad = 0, i;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			out_fn = argv[++i];
+		else if (!strcmp(argv[i], "-g") && i + 1 < argc)
+			golden_fn = argv[++i];
+		else if (dir == NULL && argv[i][0] != '-')
+			dir = argv[i];
+		else
+			bad = 1;
+	}
+	if (bad || dir == NULL || (golden_fn != NULL && out_fn == NULL))
+	{
+		printf("Usage: regcheck [-o DIGEST [-g GOLDEN]] DIRECTORY\n");
+		printf("Describes the SUP, XML and index files in DIRECTORY, on stdout or in\n");
+		printf("DIGEST. With -g, DIGEST is compared against GOLDEN and differences are\n");
+		printf("printed.\n");
+		return 1;
+	}
+
+	if (out_fn == NULL)
+		out = stdout;
+	else if ((out = fopen(out_fn, "w")) == NULL)
+	{
+		perror("Error opening digest file");
+		return 1;
+	}
+	if (digest_dir(out, dir))
+		return 1;
+	if (out != stdout && fclose(out))
+	{
+		perror("Error writing digest file");
+		return 1;
+	}
+
+	if (golden_fn != NULL && compare(golden_fn, out_fn))
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,91 @@
+# Golden output regression run, by the regress target:
+#
+#   cmake --build build --target regress
+#
+# Converts every case of debug/golden/cases.txt and compares the regcheck
+# digest of its output, SUP bytes, XML text and the pictures decoded from
+# both, against debug/golden/NAME.txt. Changes in output that are intended
+# are recorded by the regress-update target, which passes -DUPDATE=1, and
+# committing the new digests.
+# Single cases can be run with -DCASES="name;name".
+
+if(NOT SUBGEN OR NOT AVS2BDNXML OR NOT REGCHECK OR NOT GOLDEN_DIR OR NOT WORK_DIR)
+    message(FATAL_ERROR "Run through the regress target, or pass SUBGEN, AVS2BDNXML, REGCHECK, GOLDEN_DIR and WORK_DIR")
+endif()
+
+if(WIN32)
+    set(ext avi)
+else()
+    set(ext raw)
+endif()
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+file(STRINGS ${GOLDEN_DIR}/cases.txt lines)
+set(failed "")
+set(ran 0)
+foreach(line ${lines})
+    if(line MATCHES "^#" OR NOT line MATCHES "\\|")
+        continue()
+    endif()
+    if(NOT line MATCHES "^([^|]*)\\|([^|]*)\\|(.*)$")
+        message(FATAL_ERROR "Bad line in cases.txt: ${line}")
+    endif()
+    string(STRIP "${CMAKE_MATCH_1}" name)
+    string(STRIP "${CMAKE_MATCH_2}" source)
+    string(STRIP "${CMAKE_MATCH_3}" options)
+    list(FIND CASES ${name} i)
+    if(CASES AND i LESS 0)
+        continue()
+    endif()
+    separate_arguments(options UNIX_COMMAND "${options}")
+
+    set(dir ${WORK_DIR}/${name})
+    file(REMOVE_RECURSE ${dir})
+    file(MAKE_DIRECTORY ${dir})
+    if(source MATCHES "^file=(.*)$")
+        get_filename_component(input "${CMAKE_MATCH_1}" ABSOLUTE BASE_DIR ${GOLDEN_DIR})
+        set(generated 0)
+    else()
+        separate_arguments(source UNIX_COMMAND "${source}")
+        set(input ${WORK_DIR}/${name}.${ext})
+        set(generated 1)
+        execute_process(COMMAND ${SUBGEN} ${source} ${input} RESULT_VARIABLE r ERROR_QUIET)
+        if(r)
+            message(FATAL_ERROR "subgen failed for ${name}")
+        endif()
+    endif()
+
+    execute_process(COMMAND ${AVS2BDNXML} ${options} -o ${dir}/out.sup -o ${dir}/out.xml ${input}
+        WORKING_DIRECTORY ${dir} RESULT_VARIABLE r OUTPUT_QUIET ERROR_VARIABLE err)
+    if(generated)
+        file(REMOVE ${input})
+    endif()
+    if(r)
+        message("${name}: avs2bdnxml failed\n${err}")
+        list(APPEND failed ${name})
+        continue()
+    endif()
+
+    if(UPDATE)
+        execute_process(COMMAND ${REGCHECK} -o ${GOLDEN_DIR}/${name}.txt ${dir} RESULT_VARIABLE r)
+        message("${name}: updated")
+    else()
+        execute_process(COMMAND ${REGCHECK} -o ${dir}.txt -g ${GOLDEN_DIR}/${name}.txt ${dir} RESULT_VARIABLE r)
+        if(r)
+            message("${name}: FAILED")
+            list(APPEND failed ${name})
+        else()
+            message("${name}: ok")
+        endif()
+    endif()
+    math(EXPR ran "${ran} + 1")
+endforeach()
+
+if(failed)
+    message(FATAL_ERROR "Output differs from the golden files for: ${failed}")
+endif()
+if(UPDATE)
+    message("${ran} golden files updated")
+else()
+    message("${ran} cases passed")
+endif()
@@ -0,0 +1,662 @@
+/*----------------------------------------------------------------------------
+ * subgen - Generates synthetic RGBA subtitle streams for benchmarking
+ * Copyright (C) 2010 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+/* Output is either a raw stream, as read by avs2bdnxml built with -DLINUX,
+ * or an uncompressed AVI file, which avs2bdnxml opens through AVIFile on
+ * Windows. Frames are B, G, R, A bytes with straight alpha, rows stored top
+ * first, like avs2bdnxml reads them. The same seed and options always give
+ * the same stream.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+/* Same layout as RAW_HEADER_MAGIC in common.h */
+#define RAW_MAGIC "RGBA"
+#define RAW_HEADER_SIZE 24
+
+#define GLYPHS 64
+#define MAX_STROKES 4
+#define MAX_TEXT 96
+
+enum
+{
+	EV_DIALOGUE,  /* Static text, one or two rows at the bottom */
+	EV_FADE,      /* Dialogue fading in and out */
+	EV_KARAOKE,   /* Dialogue with a colour sweep from left to right */
+	EV_SIGN,      /* Larger text moving across the upper half */
+	EV_TYPES
+};
+
+typedef struct stroke_s
+{
+	float x0, y0, x1, y1;  /* In units of the glyph size */
+} stroke_t;
+
+typedef struct glyph_s
+{
+	stroke_t s[MAX_STROKES];
+	int n;
+	float advance;
+} glyph_t;
+
+typedef struct event_s
+{
+	int type;
+	int start;
+	int len;
+	int size;              /* Glyph size in pixels */
+	int rows;
+	int cols;
+	int x, y;              /* Top left corner at the start */
+	int dx, dy;            /* Movement per frame */
+	uint8_t text[MAX_TEXT];
+	uint8_t fill[3];       /* B, G, R */
+	uint8_t outline[3];
+	uint8_t sweep[3];      /* Karaoke colour */
+} event_t;
+
+typedef struct workload_s
+{
+	const char *name;
+	int types[EV_TYPES];   /* Share of each event type */
+} workload_t;
+
+static const workload_t workloads[] =
+{
+	{"mixed",    {4, 2, 2, 2}},
+	{"dialogue", {1, 0, 0, 0}},
+	{"fades",    {0, 1, 0, 0}},
+	{"karaoke",  {0, 0, 1, 0}},
+	{"signs",    {0, 0, 0, 1}},
+	{NULL,       {0, 0, 0, 0}}
+};
+
+typedef struct resolution_s
+{
+	const char *name;
+	int w, h;
+} resolution_t;
+
+static const resolution_t resolutions[] =
+{
+	{"480p",   720,  480},
+	{"576p",   720,  576},
+	{"720p",  1280,  720},
+	{"1080p", 1920, 1080},
+	{"1440p", 2560, 1440},
+	{"2160p", 3840, 2160},
+	{NULL,       0,    0}
+};
+
+typedef struct fps_s
+{
+	const char *name;
+	int num, den;
+} fps_t;
+
+static const fps_t frame_rates[] =
+{
+	{"23.976", 24000, 1001},
+	{"24",        24,    1},
+	{"25",        25,    1},
+	{"29.97",  30000, 1001},
+	{"50",        50,    1},
+	{"59.94",  60000, 1001},
+	{NULL,         0,    0}
+};
+
+/* xorshift64*, so streams do not depend on the C library */
+static uint64_t rng_state;
+
+static uint32_t rnd (void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (uint32_t)((rng_state * 2685821657736338717ULL) >> 32);
+}
+
+/* Uniform in [lo, hi] */
+static int rnd_range (int lo, int hi)
+{
+	if (hi <= lo)
+		return lo;
+	return lo + (int)(rnd() % (uint32_t)(hi - lo + 1));
+}
+
+static float rnd_float (float lo, float hi)
+{
+	return lo + (hi - lo) * (rnd() >> 8) / (float)(1 << 24);
+}
+
+/* A made up font of a few strokes per glyph. Glyph 0 is a space. */
+static void make_font (glyph_t *font)
+{
+	glyph_t *g;
+	stroke_t *s;
+	int i, j;
+
+	memset(font, 0, sizeof(glyph_t) * GLYPHS);
+	font[0].advance = 0.35;
+	for (i = 1; i < GLYPHS; i++)
+	{
+		g = &font[i];
+		g->n = rnd_range(2, MAX_STROKES);
+		g->advance = rnd_float(0.5, 0.8);
+		for (j = 0; j < g->n; j++)
+		{
+			s = &g->s[j];
+			s->x0 = rnd_float(0.1, g->advance - 0.1);
+			s->x1 = rnd_float(0.1, g->advance - 0.1);
+			s->y0 = rnd_float(0.15, 0.9);
+			s->y1 = rnd_float(0.15, 0.9);
+			/* Mostly straight strokes, like Latin letters */
+			if (rnd() & 1)
+				s->x1 = s->x0;
+			else if (rnd() & 1)
+				s->y1 = s->y0;
+		}
+	}
+}
+
+static float text_width (glyph_t *font, event_t *e, int row)
+{
+	float w = 0;
+	int i;
+
+	for (i = 0; i < e->cols; i++)
+		w += font[e->text[row * e->cols + i]].advance;
+
+	return w * e->size;
+}
+
+static void pick_colour (uint8_t *c, int lo, int hi)
+{
+	c[0] = rnd_range(lo, hi);
+	c[1] = rnd_range(lo, hi);
+	c[2] = rnd_range(lo, hi);
+}
+
+static void make_event (event_t *e, glyph_t *font, int type, int start, int w, int h, int fps)
+{
+	int i, max_cols;
+	float width;
+
+	memset(e, 0, sizeof(event_t));
+	e->type = type;
+	e->start = start;
+	if (type == EV_SIGN)
+	{
+		e->len = rnd_range(fps, fps * 5);
+		e->size = h / rnd_range(9, 14);
+		e->rows = 1;
+		e->cols = rnd_range(3, 12);
+	}
+	else
+	{
+		e->len = rnd_range(fps, fps * 4);
+		e->size = h / 18;
+		e->rows = rnd_range(1, 2);
+		e->cols = rnd_range(12, 40);
+	}
+
+	/* Keep lines inside 90% of the width */
+	max_cols = (int)(w * 0.9 / (e->size * 0.8));
+	e->cols = MAX(1, MIN(e->cols, MIN(max_cols, MAX_TEXT / e->rows)));
+	for (i = 0; i < e->rows * e->cols; i++)
+		e->text[i] = (rnd() % 6) ? rnd_range(1, GLYPHS - 1) : 0;
+
+	width = text_width(font, e, 0);
+	if (type == EV_SIGN)
+	{
+		e->x = rnd_range(0, MAX(0, w - (int)width));
+		e->y = rnd_range(h / 20, h / 2);
+		e->dx = rnd_range(-4, 4);
+		e->dy = rnd_range(-1, 1);
+		pick_colour(e->fill, 0, 255);
+		pick_colour(e->outline, 0, 255);
+	}
+	else
+	{
+		e->x = (int)((w - width) / 2);
+		e->y = h - h / 12 - e->rows * e->size * 5 / 4;
+		pick_colour(e->fill, 200, 255);
+		pick_colour(e->outline, 0, 40);
+		pick_colour(e->sweep, 0, 255);
+	}
+}
+
+static float seg_dist (stroke_t *s, float ox, float oy, float size, float px, float py)
+{
+	float x0 = ox + s->x0 * size, y0 = oy + s->y0 * size;
+	float vx = (s->x1 - s->x0) * size, vy = (s->y1 - s->y0) * size;
+	float wx = px - x0, wy = py - y0;
+	float l = vx * vx + vy * vy;
+	float t = l > 0 ? (wx * vx + wy * vy) / l : 0;
+
+	t = t < 0 ? 0 : (t > 1 ? 1 : t);
+	wx -= t * vx;
+	wy -= t * vy;
+
+	return sqrtf(wx * wx + wy * wy);
+}
+
+/* Straight alpha "over", colour c with coverage a in [0, 1] */
+static void blend (uint8_t *p, const uint8_t *c, float a)
+{
+	float da = p[3] / 255.0, oa = a + da * (1 - a);
+	int i;
+
+	if (a <= 0 || oa <= 0)
+		return;
+	for (i = 0; i < 3; i++)
+		p[i] = (uint8_t)((c[i] * a + p[i] * da * (1 - a)) / oa + 0.5);
+	p[3] = (uint8_t)(oa * 255 + 0.5);
+}
+
+/* Anti-aliased strokes with an outline. Karaoke fill left of sweep_x. */
+static void draw_glyph (uint8_t *im, int w, int h, glyph_t *g, event_t *e, float ox, float oy, float alpha, float sweep_x)
+{
+	float rf = MAX(1.0, e->size * 0.05), ro = rf + MAX(1.5, e->size * 0.04);
+	float d, df, fill_a, line_a, k;
+	uint8_t fill[3], *p;
+	int x, y, x0, x1, y0, y1, i, j;
+
+	x0 = MAX(0, (int)(ox - ro - 1));
+	x1 = MIN(w - 1, (int)(ox + g->advance * e->size + ro + 1));
+	y0 = MAX(0, (int)(oy - ro - 1));
+	y1 = MIN(h - 1, (int)(oy + e->size + ro + 1));
+	for (y = y0; y <= y1; y++)
+	{
+		p = im + ((size_t)y * w + x0) * 4;
+		for (x = x0; x <= x1; x++, p += 4)
+		{
+			d = 1e9;
+			for (i = 0; i < g->n; i++)
+			{
+				df = seg_dist(&g->s[i], ox, oy, e->size, x + 0.5, y + 0.5);
+				d = MIN(d, df);
+			}
+			line_a = ro + 0.5 - d;
+			if (line_a <= 0)
+				continue;
+			fill_a = rf + 0.5 - d;
+			line_a = MIN(line_a, 1);
+			fill_a = fill_a < 0 ? 0 : MIN(fill_a, 1);
+
+			memcpy(fill, e->fill, 3);
+			if (e->type == EV_KARAOKE)
+			{
+				k = sweep_x - x;
+				k = k < 0 ? 0 : MIN(k, 1);
+				for (j = 0; j < 3; j++)
+					fill[j] = (uint8_t)(e->sweep[j] * k + e->fill[j] * (1 - k));
+			}
+			blend(p, e->outline, line_a * alpha);
+			blend(p, fill, fill_a * alpha);
+		}
+	}
+}
+
+static void draw_event (uint8_t *im, int w, int h, glyph_t *font, event_t *e, int frame)
+{
+	int t = frame - e->start, fade = MAX(1, e->len / 4), row, i;
+	float alpha = 1, x, y, sweep_x = 0, width;
+	glyph_t *g;
+
+	if (e->type == EV_FADE)
+		alpha = MIN(1, MIN((t + 1) / (float)fade, (e->len - t) / (float)fade));
+
+	for (row = 0; row < e->rows; row++)
+	{
+		width = text_width(font, e, row);
+		x = e->type == EV_SIGN ? e->x : (w - width) / 2;
+		y = e->y + row * e->size * 5 / 4;
+		x += e->dx * t;
+		y += e->dy * t;
+		if (e->type == EV_KARAOKE)
+			sweep_x = x + width * (t + 1) / e->len;
+		for (i = 0; i < e->cols; i++)
+		{
+			g = &font[e->text[row * e->cols + i]];
+			if (g->n)
+				draw_glyph(im, w, h, g, e, x, y, alpha, sweep_x);
+			x += g->advance * e->size;
+		}
+	}
+}
+
+/* Some renderers leave colour in fully transparent pixels, which must not
+ * make frames differ
+ */
+static void tint_transparent (uint8_t *im, int n, int frame)
+{
+	int i;
+
+	for (i = 0; i < n; i++, im += 4)
+		if (!im[3])
+		{
+			im[0] = i * 7 + frame * 31;
+			im[1] = i * 13 + frame * 17;
+			im[2] = 255 - frame * 29;
+		}
+}
+
+static void put_le32 (uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static void put_le16 (uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+/* AVI 1.0 headers up to the first frame chunk. Returns the bytes used. */
+static int avi_header (uint8_t *b, int w, int h, int fps_num, int fps_den, int frames, uint32_t riff_size)
+{
+	uint32_t frame_size = (uint32_t)w * h * 4;
+
+	memset(b, 0, 224);
+	memcpy(b, "RIFF", 4); put_le32(b + 4, riff_size); memcpy(b + 8, "AVI ", 4);
+	memcpy(b + 12, "LIST", 4); put_le32(b + 16, 192); memcpy(b + 20, "hdrl", 4);
+	memcpy(b + 24, "avih", 4); put_le32(b + 28, 56);
+	put_le32(b + 32, (uint32_t)(1000000.0 * fps_den / fps_num));
+	put_le32(b + 36, (uint32_t)((double)frame_size * fps_num / fps_den));
+	put_le32(b + 44, 0x10);               /* AVIF_HASINDEX */
+	put_le32(b + 48, frames);
+	put_le32(b + 56, 1);                  /* Streams */
+	put_le32(b + 60, frame_size);
+	put_le32(b + 64, w);
+	put_le32(b + 68, h);
+	memcpy(b + 88, "LIST", 4); put_le32(b + 92, 116); memcpy(b + 96, "strl", 4);
+	memcpy(b + 100, "strh", 4); put_le32(b + 104, 56);
+	memcpy(b + 108, "vids", 4); memcpy(b + 112, "DIB ", 4);
+	put_le32(b + 128, fps_den);
+	put_le32(b + 132, fps_num);
+	put_le32(b + 140, frames);
+	put_le32(b + 144, frame_size);
+	put_le32(b + 148, 0xffffffff);        /* Quality */
+	put_le16(b + 160, w);
+	put_le16(b + 162, h);
+	memcpy(b + 164, "strf", 4); put_le32(b + 168, 40);
+	put_le32(b + 172, 40);
+	put_le32(b + 176, w);
+	put_le32(b + 180, h);
+	put_le16(b + 184, 1);                 /* Planes */
+	put_le16(b + 186, 32);                /* Bits per pixel */
+	put_le32(b + 192, frame_size);
+	memcpy(b + 212, "LIST", 4); put_le32(b + 216, 4 + frames * (8 + frame_size)); memcpy(b + 220, "movi", 4);
+
+	return 224;
+}
+
+static int write_index (FILE *fh, int frames, uint32_t frame_size)
+{
+	uint8_t e[16];
+	int i;
+
+	memcpy(e, "idx1", 4);
+	put_le32(e + 4, frames * 16);
+	if (fwrite(e, 8, 1, fh) != 1)
+		return -1;
+	memcpy(e, "00db", 4);
+	put_le32(e + 4, 0x10);                /* AVIIF_KEYFRAME */
+	put_le32(e + 12, frame_size);
+	for (i = 0; i < frames; i++)
+	{
+		put_le32(e + 8, 4 + i * (8 + frame_size));
+		if (fwrite(e, 16, 1, fh) != 1)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int is_avi (const char *filename)
+{
+	size_t l = strlen(filename);
+
+	return l > 4 && (!strcmp(filename + l - 4, ".avi") || !strcmp(filename + l - 4, ".AVI"));
+}
+
+static void print_usage (void)
+{
+	fprintf(stderr,
+		"subgen 1.0\n"
+		"Usage: subgen [options] output\n"
+		"\n"
+		"Writes a raw RGBA stream for avs2bdnxml built with -DLINUX, or an\n"
+		"uncompressed AVI file if output ends in .avi. Use - for stdout.\n"
+		"\n"
+		"  -r, --resolution <string>  Either of: 480p, 576p, 720p, 1080p, 1440p,\n"
+		"                             2160p, or WIDTHxHEIGHT. Default: 1080p\n"
+		"  -n, --frames <integer>     Number of frames. Default: 1000\n"
+		"  -f, --fps <float>          Either of: 23.976, 24, 25, 29.97, 50, 59.94\n"
+		"  -w, --workload <string>    Either of: mixed, dialogue, fades, karaoke,\n"
+		"                             signs. Default: mixed\n"
+		"  -g, --gaps <integer>       Longest empty gap between lines, in frames.\n"
+		"                             Default: 48\n"
+		"  -s, --seed <integer>       Seed of the generator. Default: 1\n"
+		"  -t, --tint <integer>       Leave colour in transparent pixels, changing\n"
+		"                             every frame. [on=1, off=0] Default: 0\n"
+		);
+}
+
+int main (int argc, char *argv[])
+{
+	struct option longopts[] = {
+		{"resolution", required_argument, NULL, 'r'},
+		{"frames", required_argument, NULL, 'n'},
+		{"fps", required_argument, NULL, 'f'},
+		{"workload", required_argument, NULL, 'w'},
+		{"gaps", required_argument, NULL, 'g'},
+		{"seed", required_argument, NULL, 's'},
+		{"tint", required_argument, NULL, 't'},
+		{NULL, 0, NULL, 0}
+	};
+	const workload_t *wl = &workloads[0];
+	const fps_t *fps = &frame_rates[0];
+	glyph_t font[GLYPHS];
+	event_t *events = NULL, *e;
+	uint8_t *im, hdr[224], chunk[8];
+	char *filename;
+	FILE *fh;
+	int w = 1920, h = 1080, frames = 1000, gaps = 48, tint = 0, avi;
+	int n_events = 0, size_events = 0, shares = 0;
+	int c, i, j, t, type;
+	uint64_t total;
+	uint32_t frame_size;
+
+	rng_state = 1;
+	while ((c = getopt_long(argc, argv, "r:n:f:w:g:s:t:", longopts, NULL)) != -1)
+	{
+		switch (c)
+		{
+			case 'r':
+				for (i = 0; resolutions[i].name != NULL && strcmp(resolutions[i].name, optarg); i++)
+					;
+				if (resolutions[i].name != NULL)
+				{
+					w = resolutions[i].w;
+					h = resolutions[i].h;
+				}
+				else if (sscanf(optarg, "%dx%d", &w, &h) != 2 || w < 64 || h < 64)
+				{
+					fprintf(stderr, "Invalid resolution: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'n':
+				frames = atoi(optarg);
+				break;
+			case 'f':
+				for (fps = frame_rates; fps->name != NULL && strcmp(fps->name, optarg); fps++)
+					;
+				if (fps->name == NULL)
+				{
+					fprintf(stderr, "Invalid frame rate: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'w':
+				for (wl = workloads; wl->name != NULL && strcmp(wl->name, optarg); wl++)
+					;
+				if (wl->name == NULL)
+				{
+					fprintf(stderr, "Invalid workload: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'g':
+				gaps = MAX(0, atoi(optarg));
+				break;
+			case 's':
+				rng_state = strtoull(optarg, NULL, 10);
+				break;
+			case 't':
+				tint = atoi(optarg);
+				break;
+			default:
+				print_usage();
+				return 1;
+		}
+	}
+	if (optind != argc - 1 || frames < 1)
+	{
+		print_usage();
+		return 1;
+	}
+	filename = argv[optind];
+	/* A zero state would stay zero */
+	rng_state = rng_state * 0x9e3779b97f4a7c15ULL + 1;
+
+	/* Dialogue and signs are on separate tracks, which may overlap */
+	make_font(font);
+	for (type = 0; type < EV_TYPES; type++)
+		shares += wl->types[type];
+	for (i = 0; i < 2; i++)
+	{
+		if (!(i ? wl->types[EV_SIGN] : shares - wl->types[EV_SIGN]))
+			continue;
+		t = rnd_range(0, gaps);
+		while (t < frames)
+		{
+			do
+			{
+				j = rnd_range(1, shares);
+				for (type = 0; j > wl->types[type]; type++)
+					j -= wl->types[type];
+			}
+			while ((type == EV_SIGN) != i);
+			if (n_events == size_events)
+			{
+				size_events = size_events ? size_events * 2 : 64;
+				if ((events = realloc(events, size_events * sizeof(event_t))) == NULL)
+				{
+					fprintf(stderr, "Out of memory.\n");
+					return 1;
+				}
+			}
+			e = &events[n_events++];
+			make_event(e, font, type, t, w, h, (fps->num + fps->den - 1) / fps->den);
+			t += e->len + rnd_range(0, gaps);
+		}
+	}
+
+	frame_size = (uint32_t)w * h * 4;
+	total = (uint64_t)frames * (8 + frame_size) + 224 + 8 + frames * 16;
+	avi = is_avi(filename);
+	if (avi && total > 0x7fffffff)
+	{
+		fprintf(stderr, "AVI output is limited to 2 GB, use fewer frames or raw output.\n");
+		return 1;
+	}
+
+	if ((im = malloc(frame_size)) == NULL)
+	{
+		fprintf(stderr, "Out of memory.\n");
+		return 1;
+	}
+	if (!strcmp(filename, "-"))
+		fh = stdout;
+	else if ((fh = fopen(filename, "wb")) == NULL)
+	{
+		perror("Error opening output file");
+		return 1;
+	}
+
+	if (avi)
+		i = avi_header(hdr, w, h, fps->num, fps->den, frames, (uint32_t)(total - 8));
+	else
+	{
+		memcpy(hdr, RAW_MAGIC, 4);
+		put_le32(hdr + 4, w);
+		put_le32(hdr + 8, h);
+		put_le32(hdr + 12, fps->num);
+		put_le32(hdr + 16, fps->den);
+		put_le32(hdr + 20, frames);
+		i = RAW_HEADER_SIZE;
+	}
+	if (fwrite(hdr, i, 1, fh) != 1)
+		goto write_error;
+
+	memcpy(chunk, "00db", 4);
+	put_le32(chunk + 4, frame_size);
+	for (t = 0; t < frames; t++)
+	{
+		memset(im, 0, frame_size);
+		for (i = 0; i < n_events; i++)
+		{
+			e = &events[i];
+			if (t >= e->start && t < e->start + e->len)
+				draw_event(im, w, h, font, e, t);
+		}
+		if (tint)
+			tint_transparent(im, w * h, t);
+		if (avi && fwrite(chunk, 8, 1, fh) != 1)
+			goto write_error;
+		if (fwrite(im, frame_size, 1, fh) != 1)
+			goto write_error;
+	}
+	if (avi && write_index(fh, frames, frame_size))
+		goto write_error;
+	if (fh != stdout && fclose(fh))
+		goto write_error;
+
+	fprintf(stderr, "%dx%d, %d frames, %d events, %s workload\n", w, h, frames, n_events, wl->name);
+	free(im);
+	free(events);
+	return 0;
+
+write_error:
+	perror("Error writing output");
+	return 1;
+}
@@ -0,0 +1,523 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frame_cache.h"
+#include "abstract_vectors.h"
+
+STATIC_VECTOR(line, cached_line_t)
+
+struct recent_lines_s
+{
+	cached_line_t lines[RECENT_LINES];
+	crop_t box[RECENT_LINES];      /* Non-zero part of the first frame */
+	uint8_t *pixels[RECENT_LINES]; /* Its rows */
+	int n;     /* Lines filled */
+	int next;  /* Line replaced next */
+};
+
+struct frame_cache_s
+{
+	char *filename;
+	char *identity;
+	int first, last;
+	char *png_dir;
+	int need_rle;
+	line_vec_t *old;  /* From the file, ordered by frame */
+	int next_old;     /* First old line not looked up yet */
+	line_vec_t *cur;  /* Lines of this run, ordered by frame */
+	char *reused;     /* Per line of cur, whether it came from the file */
+	int reused_size;
+};
+
+#define PRIME1 0x9e3779b185ebca87ULL
+#define PRIME2 0xc2b2ae3d27d4eb4fULL
+
+/* Four lanes of xxHash64 style rounds, so each multiplication does not wait
+ * for the previous one like in hash_bytes
+ */
+uint64_t hash_frame (const uint8_t *b, int len)
+{
+	uint64_t h[4] = {PRIME1, PRIME2, 0, -PRIME1}, k;
+	int i;
+
+	for (; len >= 32; len -= 32, b += 32)
+		for (i = 0; i < 4; i++)
+		{
+			memcpy(&k, b + 8 * i, 8);
+			h[i] += k * PRIME2;
+			h[i] = (h[i] << 31) | (h[i] >> 33);
+			h[i] *= PRIME1;
+		}
+
+	return hash_bytes(hash_bytes(0, (uint8_t *)h, sizeof(h)), b, len);
+}
+
+/* Bounds checked reading of the file contents */
+typedef struct reader_s
+{
+	uint8_t *p, *end;
+	int bad;
+} reader_t;
+
+static uint8_t *get_bytes (reader_t *r, int len)
+{
+	uint8_t *p = r->p;
+
+	if (r->bad || len < 0 || r->end - r->p < len)
+	{
+		r->bad = 1;
+		return NULL;
+	}
+	r->p += len;
+	return p;
+}
+
+static uint32_t get32 (reader_t *r)
+{
+	uint8_t *p = get_bytes(r, 4);
+
+	if (p == NULL)
+		return 0;
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put32 (FILE *fh, uint32_t x)
+{
+	uint8_t b[4] = {x, x >> 8, x >> 16, x >> 24};
+
+	fwrite(b, 1, 4, fh);
+}
+
+static void free_line (cached_line_t *line)
+{
+	int i;
+
+	for (i = 0; i < line->n_crop; i++)
+		free(line->rle[i]);
+}
+
+static int read_line (reader_t *r, cached_line_t *line)
+{
+	uint8_t *data;
+	int i;
+
+	line->frame = get32(r);
+	line->hash = get32(r);
+	line->hash |= (uint64_t)get32(r) << 32;
+	line->flags = get32(r);
+	line->n_crop = (line->flags >> 8) & 0xff;
+	line->flags &= 0xff;
+	if (line->n_crop < 1 || line->n_crop > 2)
+	{
+		line->n_crop = 0;
+		return -1;
+	}
+	for (i = 0; i < line->n_crop; i++)
+	{
+		line->crops[i].x = get32(r);
+		line->crops[i].y = get32(r);
+		line->crops[i].w = get32(r);
+		line->crops[i].h = get32(r);
+	}
+	if (line->flags & FRAME_CACHE_PAL)
+		for (i = 0; i < 256; i++)
+			line->pal[i] = get32(r);
+	if (line->flags & FRAME_CACHE_PNG)
+		for (i = 0; i < line->n_crop; i++)
+		{
+			line->png[i].file_id = get32(r);
+			line->png[i].graphic = get32(r);
+		}
+	if (line->flags & FRAME_CACHE_RLE)
+		for (i = 0; i < line->n_crop; i++)
+		{
+			line->rle_len[i] = get32(r);
+			if ((data = get_bytes(r, line->rle_len[i])) == NULL)
+				break;
+			line->rle[i] = malloc(line->rle_len[i]);
+			memcpy(line->rle[i], data, line->rle_len[i]);
+		}
+
+	return r->bad ? -1 : 0;
+}
+
+static void write_line (FILE *fh, cached_line_t *line)
+{
+	int i;
+
+	put32(fh, line->frame);
+	put32(fh, line->hash);
+	put32(fh, line->hash >> 32);
+	put32(fh, line->flags | (line->n_crop << 8));
+	for (i = 0; i < line->n_crop; i++)
+	{
+		put32(fh, line->crops[i].x);
+		put32(fh, line->crops[i].y);
+		put32(fh, line->crops[i].w);
+		put32(fh, line->crops[i].h);
+	}
+	if (line->flags & FRAME_CACHE_PAL)
+		for (i = 0; i < 256; i++)
+			put32(fh, line->pal[i]);
+	if (line->flags & FRAME_CACHE_PNG)
+		for (i = 0; i < line->n_crop; i++)
+		{
+			put32(fh, line->png[i].file_id);
+			put32(fh, line->png[i].graphic);
+		}
+	if (line->flags & FRAME_CACHE_RLE)
+		for (i = 0; i < line->n_crop; i++)
+		{
+			put32(fh, line->rle_len[i]);
+			fwrite(line->rle[i], 1, line->rle_len[i], fh);
+		}
+}
+
+/* Read the old file into fc->old. Anything unreadable or written for other
+ * input or settings is ignored.
+ */
+static void load_cache (frame_cache_t *fc)
+{
+	FILE *fh;
+	reader_t r;
+	uint8_t *buf, *id;
+	cached_line_t *line, tmp;
+	long size;
+	int n, len, last = -1;
+
+	if ((fh = fopen(fc->filename, "rb")) == NULL)
+		return;
+	fseek(fh, 0, SEEK_END);
+	size = ftell(fh);
+	fseek(fh, 0, SEEK_SET);
+	buf = malloc(size > 0 ? size : 1);
+	if (size <= 0 || fread(buf, 1, size, fh) != (size_t)size)
+	{
+		fprintf(stderr, "Cannot read frame cache %s, ignoring it.\n", fc->filename);
+		fclose(fh);
+		free(buf);
+		return;
+	}
+	fclose(fh);
+
+	r.p = buf;
+	r.end = buf + size;
+	r.bad = 0;
+	if ((id = get_bytes(&r, 4)) == NULL || memcmp(id, FRAME_CACHE_MAGIC, 4) || get32(&r) != FRAME_CACHE_VERSION)
+	{
+		fprintf(stderr, "%s is not a frame cache of this version, ignoring it.\n", fc->filename);
+		free(buf);
+		return;
+	}
+	len = get32(&r);
+	if ((id = get_bytes(&r, len)) == NULL || len != (int)strlen(fc->identity) || memcmp(id, fc->identity, len))
+	{
+		fprintf(stderr, "Frame cache %s is for other input or settings, ignoring it.\n", fc->filename);
+		free(buf);
+		return;
+	}
+
+	for (n = get32(&r); n > 0; n--)
+	{
+		line = line_vec_append(fc->old);
+		if (read_line(&r, line) || line->frame <= last)
+		{
+			fprintf(stderr, "Frame cache %s is damaged, ignoring it.\n", fc->filename);
+			while (line_vec_pop(fc->old, &tmp))
+				free_line(&tmp);
+			break;
+		}
+		last = line->frame;
+	}
+	free(buf);
+}
+
+frame_cache_t *open_frame_cache (char *filename, char *identity, int first, int last, const char *png_dir, int need_rle)
+{
+	frame_cache_t *fc = calloc(1, sizeof(frame_cache_t));
+
+	fc->filename = strdup(filename);
+	fc->identity = strdup(identity);
+	fc->first = first;
+	fc->last = last;
+	fc->png_dir = png_dir != NULL ? strdup(png_dir) : NULL;
+	fc->need_rle = need_rle;
+	fc->old = line_vec_new();
+	fc->cur = line_vec_new();
+
+	load_cache(fc);
+	remove(filename);
+
+	return fc;
+}
+
+/* Index of the line of this run starting at frame, or -1 */
+static int find_cur (frame_cache_t *fc, int frame)
+{
+	int lo = fc->cur->head, hi = fc->cur->tail - 1, mid;
+
+	while (lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+		if (line_vec_get(fc->cur, mid)->frame < frame)
+			lo = mid + 1;
+		else if (line_vec_get(fc->cur, mid)->frame > frame)
+			hi = mid - 1;
+		else
+			return mid;
+	}
+
+	return -1;
+}
+
+/* PNG files are named after the first frame of the line that wrote them.
+ * One written by an earlier run is still valid, unless a line starting at
+ * that frame was processed again in this run.
+ */
+static int rewritten (frame_cache_t *fc, png_ref_t *png)
+{
+	int i;
+
+	return png->file_id >= fc->first && png->file_id < fc->last && (i = find_cur(fc, png->file_id)) != -1 && !fc->reused[i];
+}
+
+static int png_valid (frame_cache_t *fc, png_ref_t *ref)
+{
+	char *filename;
+	FILE *fh;
+
+	if (rewritten(fc, ref))
+		return 0;
+
+	filename = malloc(strlen(fc->png_dir) + 32);
+	sprintf(filename, "%s%08d_%d.png", fc->png_dir, ref->file_id, ref->graphic);
+	fh = fopen(filename, "rb");
+	free(filename);
+	if (fh == NULL)
+		return 0;
+	fclose(fh);
+
+	return 1;
+}
+
+static cached_line_t *append_cur (frame_cache_t *fc, int reused)
+{
+	int i = fc->cur->tail;
+
+	if (i >= fc->reused_size)
+	{
+		fc->reused_size = fc->reused_size ? 2 * fc->reused_size : 256;
+		fc->reused = realloc(fc->reused, fc->reused_size);
+	}
+	fc->reused[i] = reused;
+
+	return line_vec_append(fc->cur);
+}
+
+cached_line_t *frame_cache_find (frame_cache_t *fc, int frame, uint64_t hash)
+{
+	cached_line_t *line = NULL, *keep;
+	int i;
+
+	/* Lookups come in frame order */
+	while (fc->next_old < fc->old->tail && line_vec_get(fc->old, fc->next_old)->frame < frame)
+		fc->next_old++;
+	if (fc->next_old < fc->old->tail)
+		line = line_vec_get(fc->old, fc->next_old);
+	if (line == NULL || line->frame != frame || line->hash != hash)
+		return NULL;
+
+	if (fc->need_rle && !(line->flags & FRAME_CACHE_RLE))
+		return NULL;
+	if (fc->png_dir != NULL)
+	{
+		if (!(line->flags & FRAME_CACHE_PNG))
+			return NULL;
+		for (i = 0; i < line->n_crop; i++)
+			if (!png_valid(fc, &(line->png[i])))
+				return NULL;
+	}
+
+	/* Move it over, with its RLE data */
+	fc->next_old++;
+	keep = append_cur(fc, 1);
+	*keep = *line;
+	line->n_crop = 0;
+
+	return keep;
+}
+
+void frame_cache_add (frame_cache_t *fc, cached_line_t *line)
+{
+	*append_cur(fc, 0) = *line;
+}
+
+/* Old lines outside of this run are kept, unless their PNG files were
+ * overwritten
+ */
+static int keep_old (frame_cache_t *fc, cached_line_t *line)
+{
+	int i;
+
+	if (line->frame >= fc->first && line->frame < fc->last)
+		return 0;
+	if (line->flags & FRAME_CACHE_PNG)
+		for (i = 0; i < line->n_crop; i++)
+			if (rewritten(fc, &(line->png[i])))
+				return 0;
+
+	return 1;
+}
+
+int close_frame_cache (frame_cache_t *fc)
+{
+	cached_line_t line;
+	FILE *fh;
+	int i, j, n = 0, r = 0;
+
+	if ((fh = fopen(fc->filename, "wb")) == NULL)
+	{
+		perror("Error opening frame cache");
+		r = -1;
+	}
+	else
+	{
+		for (i = fc->old->head; i < fc->old->tail; i++)
+			n += keep_old(fc, line_vec_get(fc->old, i));
+		fwrite(FRAME_CACHE_MAGIC, 1, 4, fh);
+		put32(fh, FRAME_CACHE_VERSION);
+		put32(fh, strlen(fc->identity));
+		fwrite(fc->identity, 1, strlen(fc->identity), fh);
+		put32(fh, n + line_vec_len(fc->cur));
+		/* Old lines go before and after those of this run */
+		for (i = fc->old->head; i < fc->old->tail && line_vec_get(fc->old, i)->frame < fc->first; i++)
+			if (keep_old(fc, line_vec_get(fc->old, i)))
+				write_line(fh, line_vec_get(fc->old, i));
+		for (j = fc->cur->head; j < fc->cur->tail; j++)
+			write_line(fh, line_vec_get(fc->cur, j));
+		for (; i < fc->old->tail; i++)
+			if (keep_old(fc, line_vec_get(fc->old, i)))
+				write_line(fh, line_vec_get(fc->old, i));
+		if (ferror(fh) | fclose(fh))
+		{
+			perror("Error writing frame cache");
+			remove(fc->filename);
+			r = -1;
+		}
+	}
+
+	while (line_vec_pop(fc->old, &line))
+		free_line(&line);
+	while (line_vec_pop(fc->cur, &line))
+		free_line(&line);
+	line_vec_destroy(fc->old);
+	line_vec_destroy(fc->cur);
+	free(fc->reused);
+	free(fc->png_dir);
+	free(fc->identity);
+	free(fc->filename);
+	free(fc);
+
+	return r;
+}
+
+void copy_cached_line (cached_line_t *dst, cached_line_t *src)
+{
+	int i;
+
+	*dst = *src;
+	for (i = 0; i < src->n_crop; i++)
+		if (src->rle[i] != NULL)
+		{
+			dst->rle[i] = malloc(src->rle_len[i]);
+			memcpy(dst->rle[i], src->rle[i], src->rle_len[i]);
+		}
+}
+
+recent_lines_t *new_recent_lines ()
+{
+	return calloc(1, sizeof(recent_lines_t));
+}
+
+/* Everything outside of the box is zero */
+static crop_t bounding_box (pic_t frame)
+{
+	crop_t box = {0, 0, frame.w, frame.h};
+
+	auto_crop(frame, &box);
+	return box;
+}
+
+cached_line_t *recent_lines_find (recent_lines_t *rl, uint64_t hash, pic_t frame)
+{
+	crop_t box;
+	int i, y, found = 0;
+
+	for (i = 0; i < rl->n; i++)
+	{
+		if (rl->lines[i].hash != hash)
+			continue;
+		if (!found++)
+			box = bounding_box(frame);
+		if (memcmp(&box, &(rl->box[i]), sizeof(crop_t)))
+			continue;
+		for (y = 0; y < box.h; y++)
+			if (memcmp(rl->pixels[i] + y * box.w * 4, frame.b + 4 * (box.x + frame.s * (box.y + y)), box.w * 4))
+				break;
+		if (y == box.h)
+			return &(rl->lines[i]);
+	}
+
+	return NULL;
+}
+
+void recent_lines_add (recent_lines_t *rl, cached_line_t *line, pic_t frame)
+{
+	crop_t box = bounding_box(frame);
+	int i = rl->next, y;
+
+	if (rl->n < RECENT_LINES)
+		rl->n++;
+	else
+	{
+		free_line(&(rl->lines[i]));
+		free(rl->pixels[i]);
+	}
+	rl->lines[i] = *line;
+	rl->box[i] = box;
+	rl->pixels[i] = malloc(box.w * box.h * 4);
+	for (y = 0; y < box.h; y++)
+		memcpy(rl->pixels[i] + y * box.w * 4, frame.b + 4 * (box.x + frame.s * (box.y + y)), box.w * 4);
+	rl->next = (i + 1) % RECENT_LINES;
+}
+
+void destroy_recent_lines (recent_lines_t *rl)
+{
+	int i;
+
+	for (i = 0; i < rl->n; i++)
+	{
+		free_line(&(rl->lines[i]));
+		free(rl->pixels[i]);
+	}
+	free(rl);
+}
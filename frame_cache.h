@@ -0,0 +1,119 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <stdint.h>
+#include "auto_split.h"
+#include "png_index.h"
+
+/* Results of earlier runs on the same input, so lines starting at the same
+ * frame with the same picture skip cropping, palettizing and encoding.
+ * Lines are looked up by first frame and a hash of its zeroed RGBA data.
+ *
+ * The file is only written after a complete run, and removed when opened,
+ * since an interrupted run may have overwritten PNG files it refers to.
+ * All numbers are little-endian.
+ *
+ * Header:
+ *   "A2BC", uint32 version, uint32 identity length, identity,
+ *   uint32 number of entries
+ * Entry, ordered by frame:
+ *   uint32 frame, uint64 hash, uint8 flags, uint8 crops, uint16 0,
+ *   crops * uint32 x, y, w, h,
+ *   with FRAME_CACHE_PAL: 256 * uint32 palette,
+ *   with FRAME_CACHE_PNG: crops * uint32 file id, graphic,
+ *   with FRAME_CACHE_RLE: crops * (uint32 length, RLE data)
+ */
+#define FRAME_CACHE_MAGIC "A2BC"
+#define FRAME_CACHE_VERSION 1
+
+/* Entry flags */
+#define FRAME_CACHE_PAL 0x01
+#define FRAME_CACHE_PNG 0x02
+#define FRAME_CACHE_RLE 0x04
+
+typedef struct cached_line_s
+{
+	int frame;
+	uint64_t hash;
+	int flags;
+	int n_crop;
+	crop_t crops[2];  /* As found by cropping, before the SUP writer orders them */
+	uint32_t pal[256];
+	png_ref_t png[2];
+	int rle_len[2];
+	uint8_t *rle[2];
+} cached_line_t;
+
+typedef struct frame_cache_s frame_cache_t;
+
+/* Load filename, if it exists and was written for the same identity, a
+ * string naming the input and every setting the results depend on. Frames
+ * first to last - 1 are processed in this run. With png_dir set, hits need
+ * PNG files in that directory, with need_rle, RLE data.
+ */
+frame_cache_t *open_frame_cache (char *filename, char *identity, int first, int last, const char *png_dir, int need_rle);
+
+/* Returns the line cached for frame with this hash, and keeps it for the
+ * next cache file. The pointer is valid until the next call, but RLE data
+ * until the cache is closed. Returns NULL on a miss.
+ */
+cached_line_t *frame_cache_find (frame_cache_t *fc, int frame, uint64_t hash);
+
+/* Record a line processed in this run. The cache takes over its RLE data. */
+void frame_cache_add (frame_cache_t *fc, cached_line_t *line);
+
+/* Hash of len bytes of frame data, faster than hash_bytes on large blocks */
+uint64_t hash_frame (const uint8_t *b, int len);
+
+/* Write the lines of this run, and those of the old file outside of it, to
+ * the cache file and free fc. Returns -1 if the file could not be written.
+ */
+int close_frame_cache (frame_cache_t *fc);
+
+/* Copy of src with its own RLE data */
+void copy_cached_line (cached_line_t *dst, cached_line_t *src);
+
+/* The last lines of this run with different pictures, so a line coming back
+ * after others, like a sign switching between two states, is not cropped,
+ * palettized and encoded again. Looked up by the hash of the zeroed RGBA
+ * data of its first frame, and confirmed against a copy of its bounding
+ * box.
+ */
+#define RECENT_LINES 32
+
+typedef struct recent_lines_s recent_lines_t;
+
+recent_lines_t *new_recent_lines ();
+
+/* Returns the line whose zeroed first frame equals frame, which hashes to
+ * hash, or NULL. The pointer and its RLE data are valid until the next
+ * recent_lines_add.
+ */
+cached_line_t *recent_lines_find (recent_lines_t *rl, uint64_t hash, pic_t frame);
+
+/* Record a line with its zeroed first frame, replacing the oldest one.
+ * Takes over its RLE data.
+ */
+void recent_lines_add (recent_lines_t *rl, cached_line_t *line, pic_t frame);
+
+void destroy_recent_lines (recent_lines_t *rl);
+
+#endif
@@ -0,0 +1,208 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "libass_input.h"
+#include "auto_split.h"
+
+#ifdef HAVE_LIBASS
+#include <ass/ass.h>
+
+/* Start of a frame in milliseconds, which is when it is rendered */
+static long long frame_ms (libass_input_t *a, int frame)
+{
+	return (long long)frame * 1000 * a->fps_den / a->fps_num;
+}
+
+libass_input_t *open_libass_input (char *filename, int im_w, int im_h, int fps_num, int fps_den)
+{
+	libass_input_t *a;
+	ASS_Track *track;
+	ASS_Event *ev;
+	int i;
+
+	a = calloc(1, sizeof(libass_input_t));
+	a->im_w = im_w;
+	a->im_h = im_h;
+	a->fps_num = fps_num;
+	a->fps_den = fps_den;
+	a->img_frame = -1;
+
+	if ((a->lib = ass_library_init()) == NULL)
+	{
+		fprintf(stderr, "Cannot initialize libass.\n");
+		free(a);
+		return NULL;
+	}
+	ass_set_extract_fonts(a->lib, 1);
+	if ((a->track = track = ass_read_file(a->lib, filename, NULL)) == NULL)
+	{
+		fprintf(stderr, "Cannot read ASS/SSA file (%s).\n", filename);
+		ass_library_done(a->lib);
+		free(a);
+		return NULL;
+	}
+	a->renderer = ass_renderer_init(a->lib);
+	ass_set_frame_size(a->renderer, im_w, im_h);
+	ass_set_storage_size(a->renderer, im_w, im_h);
+	ass_set_fonts(a->renderer, NULL, "sans-serif", ASS_FONTPROVIDER_AUTODETECT, NULL, 1);
+
+	/* Event timing as parsed by libass, which also covers SSA files */
+	a->timing = new_ass_reader(fps_num, fps_den);
+	for (i = 0; i < track->n_events; i++)
+	{
+		ev = &(track->events[i]);
+		ass_reader_add(a->timing, ev->Start, ev->Start + ev->Duration, ev->Name != NULL && ev->Name[0] == '!');
+	}
+	ass_reader_finish(a->timing);
+	a->frames = ass_reader_frames(a->timing);
+
+	return a;
+}
+
+/* Clear what was drawn into this buffer before. Buffers not seen yet are
+ * cleared completely.
+ */
+static libass_dirty_t *clear_frame (libass_input_t *a, uint8_t *im)
+{
+	libass_dirty_t *d = NULL;
+	int i, y;
+
+	for (i = 0; i < 2; i++)
+		if (a->dirty[i].im == im)
+			d = &(a->dirty[i]);
+
+	if (d == NULL)
+	{
+		d = &(a->dirty[a->next_dirty]);
+		a->next_dirty ^= 1;
+		d->im = im;
+		memset(im, 0, a->im_w * a->im_h * 4);
+	}
+	else
+		for (y = d->y0; y < d->y1; y++)
+			memset(im + (y * a->im_w + d->x0) * 4, 0, (d->x1 - d->x0) * 4);
+
+	d->x0 = a->im_w;
+	d->y0 = a->im_h;
+	d->x1 = 0;
+	d->y1 = 0;
+
+	return d;
+}
+
+/* Alpha blend the glyph bitmaps over the frame, which has straight alpha */
+static void draw_images (libass_input_t *a, uint8_t *im, ASS_Image *img, libass_dirty_t *d)
+{
+	int x, y, x0, y0, x1, y1, k, ad, ao, i;
+	uint8_t c[3], *p;
+
+	for (; img != NULL; img = img->next)
+	{
+		x0 = MAX(img->dst_x, 0);
+		y0 = MAX(img->dst_y, 0);
+		x1 = MIN(img->dst_x + img->w, a->im_w);
+		y1 = MIN(img->dst_y + img->h, a->im_h);
+		if (x1 <= x0 || y1 <= y0)
+			continue;
+		d->x0 = MIN(d->x0, x0);
+		d->y0 = MIN(d->y0, y0);
+		d->x1 = MAX(d->x1, x1);
+		d->y1 = MAX(d->y1, y1);
+
+		/* Color is RRGGBBAA, with AA being transparency */
+		c[0] = (img->color >> 8) & 0xff;
+		c[1] = (img->color >> 16) & 0xff;
+		c[2] = (img->color >> 24) & 0xff;
+		for (y = y0; y < y1; y++)
+			for (x = x0; x < x1; x++)
+			{
+				k = img->bitmap[(y - img->dst_y) * img->stride + x - img->dst_x] * (255 - (img->color & 0xff)) / 255;
+				if (!k)
+					continue;
+				p = im + (y * a->im_w + x) * 4;
+				ad = p[3] * (255 - k) / 255;
+				ao = k + ad;
+				for (i = 0; i < 3; i++)
+					p[i] = (c[i] * k + p[i] * ad) / ao;
+				p[3] = ao;
+			}
+	}
+}
+
+int libass_input_frame (libass_input_t *a, uint8_t *im, int frame)
+{
+	libass_dirty_t *d = clear_frame(a, im);
+	int visible, change, next;
+
+	a->forced = 0;
+	if ((visible = ass_next_visible(a->timing, frame)) > frame)
+		return visible;
+
+	if (a->img_frame != frame)
+	{
+		a->img = ass_render_frame(a->renderer, a->track, frame_ms(a, frame), &change);
+		a->img_frame = frame;
+		a->rendered++;
+	}
+	draw_images(a, im, a->img, d);
+	a->forced = ass_forced_at(a->timing, frame);
+
+	/* Look ahead for the next frame that looks different. Its images are
+	 * kept for the next call.
+	 */
+	for (next = frame + 1; ass_next_visible(a->timing, next) == next; next++)
+	{
+		a->img = ass_render_frame(a->renderer, a->track, frame_ms(a, next), &change);
+		a->img_frame = next;
+		a->rendered++;
+		if (change)
+			break;
+	}
+
+	return next;
+}
+
+void close_libass_input (libass_input_t *a)
+{
+	close_ass_reader(a->timing);
+	ass_renderer_done(a->renderer);
+	ass_free_track(a->track);
+	ass_library_done(a->lib);
+	free(a);
+}
+#else
+libass_input_t *open_libass_input (char *filename, int im_w, int im_h, int fps_num, int fps_den)
+{
+	fprintf(stderr, "Cannot render %s, this build does not include libass.\n", filename);
+	return NULL;
+}
+
+int libass_input_frame (libass_input_t *a, uint8_t *im, int frame)
+{
+	return INT_MAX;
+}
+
+void close_libass_input (libass_input_t *a)
+{
+}
+#endif
@@ -0,0 +1,72 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef LIBASS_INPUT_H
+#define LIBASS_INPUT_H
+
+#include <stdint.h>
+#include "ass.h"
+
+/* Area of a frame buffer drawn into by the previous call */
+typedef struct libass_dirty_s
+{
+	uint8_t *im;
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+} libass_dirty_t;
+
+/* Renders ASS/SSA files with libass, for use in place of an AviSynth clip.
+ * Frames outside of the events are not rendered at all. Within events,
+ * libass reports whether a frame looks different from the one before, so
+ * only frames where the picture changes are drawn.
+ */
+typedef struct libass_input_s
+{
+	int im_w;
+	int im_h;
+	int fps_num;
+	int fps_den;
+	int frames;            /* One past the end of the last event */
+	int rendered;          /* Frames laid out by libass */
+	int forced;            /* An event shown is marked with '!' */
+	ass_reader_t *timing;
+	void *lib;             /* ASS_Library */
+	void *renderer;        /* ASS_Renderer */
+	void *track;           /* ASS_Track */
+	void *img;             /* ASS_Image list for img_frame */
+	int img_frame;
+	libass_dirty_t dirty[2];
+	int next_dirty;
+} libass_input_t;
+
+/* Load an ASS/SSA file, to be rendered at im_w x im_h. Returns NULL and
+ * prints the reason on failure, which includes builds without libass.
+ */
+libass_input_t *open_libass_input (char *filename, int im_w, int im_h, int fps_num, int fps_den);
+
+/* Render the picture shown at frame into im, as B, G, R, A bytes like
+ * AviSynth RGB32 frames. Frames must be requested in increasing order.
+ * Returns the next frame on which the picture may change, or INT_MAX.
+ */
+int libass_input_frame (libass_input_t *a, uint8_t *im, int frame);
+
+void close_libass_input (libass_input_t *a);
+
+#endif
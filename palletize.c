@@ -20,7 +20,8 @@
 
 #include <stdlib.h>
 #include <stdint.h>
-#include "abstract_lists.h"
+#include <string.h>
+#include "abstract_vectors.h"
 
 #define LEVELS 5
 #define COLORS 254 /* One reserved for 100% transparent */
@@ -36,67 +37,84 @@ struct hexnode_s
 	int index;
 };
 
-static hexnode_t *new_hexnode ()
+STATIC_VECTOR(pal, hexnode_t *)
+
+/* Nodes of merged colors and finished images go to spare, and are handed
+ * out again before new ones are allocated.
+ */
+typedef struct quantizer_s
 {
-	hexnode_t *n = calloc(1, sizeof(hexnode_t));
-	int i;
+	hexnode_t *root;
+	pal_vec_t *levels[LEVELS + 1];
+	pal_vec_t *spare;
+	int colors;
+	int nodes;
+} quantizer_t;
 
-	for (i = 0; i < 4; i++)
-	{
-		n->v[i] = 0;
-		n->nodes[i] = NULL;
-	}
-	for (i = 4; i < 16; i++)
-		n->nodes[i] = NULL;
-	n->children = 0;
-	n->leaf = 0;
-	n->count = 0;
-	n->index = 0;
+static hexnode_t *new_hexnode (quantizer_t *q)
+{
+	hexnode_t *n;
+
+	if (pal_vec_pop(q->spare, &n))
+		memset(n, 0, sizeof(hexnode_t));
+	else
+		n = calloc(1, sizeof(hexnode_t));
 
 	return n;
 }
 
-static void tree_destroy (hexnode_t *n)
+static void tree_destroy (quantizer_t *q, hexnode_t *n)
 {
 	int i;
 
 	for (i = 0; i < 16; i++)
 		if (n->nodes[i] != NULL)
-			tree_destroy(n->nodes[i]);
+			tree_destroy(q, n->nodes[i]);
 
-	free(n);
+	pal_vec_push(q->spare, n);
 }
 
-STATIC_LIST(pal, hexnode_t)
-
-typedef struct quantizer_s
-{
-	hexnode_t *root;
-	pal_list_t *levels[LEVELS + 1];
-	int colors;
-	int nodes;
-} quantizer_t;
-
-static quantizer_t *new_quantizer ()
+quantizer_t *new_quantizer ()
 {
 	quantizer_t *q = calloc(sizeof(quantizer_t), 1);
 	int i;
 
-	q->root = new_hexnode();
+	q->spare = pal_vec_new();
+	q->root = new_hexnode(q);
 	for (i = 0; i <= LEVELS; i++)
-		q->levels[i] = pal_list_new();
+		q->levels[i] = pal_vec_new();
 
 	return q;
 }
 
-static void destroy_quantizer (quantizer_t *q)
+/* Start over with an empty tree, keeping all nodes */
+static void reset_quantizer (quantizer_t *q)
 {
 	int i;
 
+	tree_destroy(q, q->root);
+	for (i = 0; i <= LEVELS; i++)
+		pal_vec_clear(q->levels[i]);
+	q->root = new_hexnode(q);
+	q->colors = 0;
+	q->nodes = 0;
+}
+
+void destroy_quantizer (quantizer_t *q)
+{
+	hexnode_t *n;
+	int i;
+
+	if (q == NULL)
+		return;
+
 	if (q->root != NULL)
-		tree_destroy(q->root);
+		tree_destroy(q, q->root);
 	for (i = 0; i <= LEVELS; i++)
-		pal_list_destroy(q->levels[i]);
+		pal_vec_destroy(q->levels[i]);
+	while (pal_vec_pop(q->spare, &n))
+		free(n);
+	pal_vec_destroy(q->spare);
 
 	free(q);
 }
@@ -158,11 +176,15 @@ static int get_color_index (quantizer_t *q, uint32_t color)
 		return l->index;
 }
 
+/* Levels are walked from the deepest up and, within a level, from the most
+ * recently inserted node, so merged children never have to be removed from
+ * their level vector: it is not looked at again.
+ */
 static void reduce (quantizer_t *q)
 {
-	pal_list_t *l;
+	pal_vec_t *l;
 	hexnode_t *n, *c;
-	int i, j, k;
+	int i, j, k, m;
 
 	if (q->colors <= COLORS)
 		return;
@@ -170,11 +192,9 @@ static void reduce (quantizer_t *q)
 	for (i = LEVELS - 1; i >= 0; i--)
 	{
 		l = q->levels[i];
-		if (pal_list_empty(l))
-			continue;
-		n = pal_list_first(l);
-		do
+		for (m = l->tail - 1; m >= l->head; m--)
 		{
+			n = *pal_vec_get(l, m);
 			if (!n->children)
 				continue;
 			for (j = 0; j < 16; j++)
@@ -194,14 +214,13 @@ static void reduce (quantizer_t *q)
 					n->nodes[j] = NULL;
 					q->colors--;
 					q->nodes--;
-					pal_list_remove(q->levels[i+1], c);
-					tree_destroy(c);
+					tree_destroy(q, c);
 				}
 			n->leaf = 1;
 			q->colors++;
 			if (q->colors <= COLORS)
 				return;
-		} while ((n = pal_list_next(l)) != NULL);
+		}
 	}
 }
 
@@ -227,13 +246,13 @@ static void insert_color (quantizer_t *q, uint32_t color)
 		}
 		else
 		{
-			f = new_hexnode();
+			f = new_hexnode(q);
 			l->children++;
 			l->nodes[i] = f;
 			level++;
 
 			q->nodes++;
-			pal_list_insert(q->levels[level], f);
+			pal_vec_push(q->levels[level], f);
 
 			if (level == LEVELS)
 			{
@@ -288,11 +307,10 @@ static void get_palette (quantizer_t *q, uint32_t pal[COLORS + 1])
 		pal[index] = 0xc0decafe;
 }
 
-uint32_t *palletize (uint8_t *im, int w, int h)
+uint32_t *palletize_with (quantizer_t *q, uint8_t *im, int w, int h)
 {
 	uint32_t *pal = calloc(256, sizeof(uint32_t));
 	uint32_t *i = (uint32_t *)im;
-	quantizer_t *q = new_quantizer();
 	int x, y;
 
 	for (y = 0; y < h; y++)
@@ -305,6 +323,16 @@ uint32_t *palletize (uint8_t *im, int w, int h)
 		for (x = 0; x < w; x++)
 			im[x + y * w] = get_color_index(q, i[x + y * w]);
 
+	reset_quantizer(q);
+
+	return pal;
+}
+
+uint32_t *palletize (uint8_t *im, int w, int h)
+{
+	quantizer_t *q = new_quantizer();
+	uint32_t *pal = palletize_with(q, im, w, h);
+
 	destroy_quantizer(q);
 
 	return pal;
@@ -22,5 +22,17 @@
 /* Return malloced palette and overwrite im with 8bpp data */
 uint32_t *palletize (char *im, int w, int h);
 
+/* A quantizer keeps the nodes of its color tree after each image, so
+ * palletizing many images with one of them does not allocate every time.
+ * It must not be used by two threads at once.
+ */
+typedef struct quantizer_s quantizer_t;
+
+quantizer_t *new_quantizer ();
+void destroy_quantizer (quantizer_t *q);
+
+/* Same as palletize, using the memory of q */
+uint32_t *palletize_with (quantizer_t *q, char *im, int w, int h);
+
 #endif
 
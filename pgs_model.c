@@ -0,0 +1,152 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "pgs_model.h"
+
+/* Per object overhead in the decoded object buffer */
+#define PGS_OBJECT_OVERHEAD 16
+
+/* Plane fill and object decoding times in 1/90000s, same as write_subtitle */
+#define PLANE_TS(w,h) (((w) * (h) * 9 + 3199) / 3200)
+#define DECODE_TS(w,h) (((w) * (h) * 9 + 1599) / 1600)
+
+static void reset_usage (pgs_model_t *m)
+{
+	memset(&(m->use), 0, sizeof(pgs_usage_t));
+	m->use.min_slack = INT_MAX;
+	m->num_crop = 0;
+	m->first = -1;
+	m->last = -1;
+}
+
+pgs_model_t *new_pgs_model (int im_w, int im_h, int fps_num, int fps_den)
+{
+	pgs_model_t *m = calloc(1, sizeof(pgs_model_t));
+
+	m->im_w = im_w;
+	m->im_h = im_h;
+	m->tick_fac = 90000.0 * ((double)fps_den) / ((double)fps_num);
+	m->report = NULL;
+	m->epochs = 0;
+	m->end_ts = 0;
+	reset_usage(m);
+
+	return m;
+}
+
+/* Whether the crops need new object ids and a new palette */
+static int new_layout (pgs_model_t *m, int num_crop, rect_t *crops, int strict)
+{
+	return strict || !m->num_crop || m->num_crop != num_crop || memcmp(m->crops, crops, num_crop * sizeof(rect_t));
+}
+
+static int object_bytes (int num_crop, rect_t *crops)
+{
+	int bytes = 0, i;
+
+	for (i = 0; i < num_crop; i++)
+		bytes += crops[i].w * crops[i].h + PGS_OBJECT_OVERHEAD;
+
+	return bytes;
+}
+
+/* write_composition only writes new versions of palette id 0. With strict
+ * set, every event is counted as a palette id of its own, as before.
+ */
+static int new_palette (pgs_model_t *m, int strict)
+{
+	return strict || !m->use.palettes;
+}
+
+int pgs_model_fits (pgs_model_t *m, int num_crop, rect_t *crops, int strict)
+{
+	if (!new_layout(m, num_crop, crops, strict))
+		return 1;
+
+	return m->use.objects + num_crop <= PGS_MAX_OBJECTS
+		&& m->use.palettes + new_palette(m, strict) <= PGS_MAX_PALETTES
+		&& m->use.db + object_bytes(num_crop, crops) < PGS_DB_SIZE;
+}
+
+void pgs_model_add (pgs_model_t *m, int num_crop, rect_t *crops, int *rle_len, int start, int end, int strict)
+{
+	int start_ts = (int)floor((double)start * m->tick_fac + 0.5);
+	int required = 0, coded = 0, slack, i;
+
+	if (new_layout(m, num_crop, crops, strict))
+	{
+		m->use.objects += num_crop;
+		m->use.palettes += new_palette(m, strict);
+		m->use.db += object_bytes(num_crop, crops);
+		for (i = 0; i < num_crop; i++)
+			required += DECODE_TS(crops[i].w, crops[i].h);
+	}
+	for (i = 0; i < num_crop; i++)
+	{
+		required += PLANE_TS(crops[i].w, crops[i].h);
+		coded += rle_len[i];
+	}
+
+	/* The first display set of an epoch clears the whole plane */
+	if (!m->use.display_sets)
+	{
+		required += PLANE_TS(m->im_w, m->im_h);
+		slack = start_ts - m->end_ts - required;
+		m->first = start;
+	}
+	else
+		slack = start_ts - m->last_ts - required;
+
+	m->use.cdb = MAX(m->use.cdb, coded);
+	m->use.min_slack = MIN(m->use.min_slack, slack);
+	m->use.display_sets++;
+	m->last_ts = start_ts;
+	m->last = end;
+	m->num_crop = num_crop;
+	memcpy(m->crops, crops, num_crop * sizeof(rect_t));
+}
+
+void pgs_model_end_epoch (pgs_model_t *m)
+{
+	if (!m->use.display_sets)
+		return;
+
+	m->epochs++;
+	if (m->report != NULL)
+	{
+		fprintf(m->report, "Epoch %d: frames %d-%d, %d display sets, object buffer %d%% (%dB), objects %d/%d, palettes %d/%d, coded data %d%% (%dB), decode slack %.1fms%s\n",
+			m->epochs, m->first, m->last, m->use.display_sets,
+			(int)((100.0 * m->use.db) / PGS_DB_SIZE), m->use.db,
+			m->use.objects, PGS_MAX_OBJECTS, m->use.palettes, PGS_MAX_PALETTES,
+			(int)((100.0 * m->use.cdb) / PGS_CDB_SIZE), m->use.cdb,
+			m->use.min_slack / 90.0, m->use.min_slack < 0 || m->use.cdb > PGS_CDB_SIZE ? " (overrun)" : "");
+	}
+
+	m->end_ts = (int)floor((double)(m->last) * m->tick_fac + 0.5);
+	reset_usage(m);
+}
+
+void close_pgs_model (pgs_model_t *m)
+{
+	free(m);
+}
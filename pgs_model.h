@@ -0,0 +1,79 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef PGS_MODEL_H
+#define PGS_MODEL_H
+
+#include <stdio.h>
+#include "auto_split.h"
+
+/* Decoder limits per epoch */
+#define PGS_DB_SIZE (4 * 1024 * 1024)  /* Decoded object buffer */
+#define PGS_CDB_SIZE (1024 * 1024)     /* Coded data buffer */
+#define PGS_MAX_OBJECTS 64
+#define PGS_MAX_PALETTES 8
+
+/* Resource use of an epoch */
+typedef struct pgs_usage_s
+{
+	int db;           /* Bytes of decoded objects */
+	int cdb;          /* Largest coded display set */
+	int objects;
+	int palettes;     /* Palette ids, not versions */
+	int display_sets;
+	int min_slack;    /* Least time left for decoding a display set, in 1/90000s */
+} pgs_usage_t;
+
+/* Tracks what a decoder has to hold and do for the epoch being collected by
+ * the SUP writer. Within an epoch, a display set reuses the object ids and
+ * palette of the previous one, if it has the same crops. Otherwise it takes
+ * new object ids and a new version of the palette, as write_composition
+ * does.
+ */
+typedef struct pgs_model_s
+{
+	int im_w;
+	int im_h;
+	double tick_fac;
+	FILE *report;     /* Print epoch statistics here, if not NULL */
+	int epochs;
+	int first;        /* First and last frame of the epoch */
+	int last;
+	int last_ts;      /* Presentation time of the previous display set */
+	int end_ts;       /* End of the previous epoch */
+	int num_crop;     /* Crops of the previous display set */
+	rect_t crops[2];
+	pgs_usage_t use;
+} pgs_model_t;
+
+pgs_model_t *new_pgs_model (int im_w, int im_h, int fps_num, int fps_den);
+
+/* Check whether an event with these crops still fits into the epoch. With
+ * strict set, every event is counted as new objects and a new palette id.
+ */
+int pgs_model_fits (pgs_model_t *m, int num_crop, rect_t *crops, int strict);
+
+/* Account for an event added to the epoch */
+void pgs_model_add (pgs_model_t *m, int num_crop, rect_t *crops, int *rle_len, int start, int end, int strict);
+
+/* Report and reset at the end of an epoch */
+void pgs_model_end_epoch (pgs_model_t *m);
+
+void close_pgs_model (pgs_model_t *m);
+
+#endif
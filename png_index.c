@@ -0,0 +1,198 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "png_index.h"
+#include "abstract_vectors.h"
+
+/* Graphics are looked up by size and a 64bit hash of pixels and palette,
+ * and a match is confirmed against a copy of both. Once the copies take
+ * more than PNG_INDEX_MEMORY, those of the oldest graphics are dropped, and
+ * these are not matched any more.
+ */
+#define PNG_INDEX_MEMORY (256 * 1024 * 1024)
+
+typedef struct png_entry_s
+{
+	uint64_t hash;
+	int w, h;
+	int step;      /* Bytes per pixel */
+	uint8_t *data; /* Rows of pixels, then the palette, if any */
+	int size;
+	png_ref_t ref;
+	int next; /* Next entry in bucket, -1 terminates */
+} png_entry_t;
+
+STATIC_VECTOR(png_entry, png_entry_t)
+
+struct png_index_s
+{
+	png_entry_vec_t *entries;
+	int *buckets;
+	int mask;
+	int oldest;    /* First entry still holding data */
+	size_t memory; /* Bytes of data held */
+};
+
+#define HASH_M1 0x9e3779b97f4a7c15ULL
+#define HASH_M2 0xbf58476d1ce4e5b9ULL
+
+static uint64_t mix (uint64_t h, uint64_t k)
+{
+	k *= HASH_M2;
+	k ^= k >> 31;
+	h = (h ^ k) * HASH_M1;
+	return h ^ (h >> 29);
+}
+
+uint64_t hash_bytes (uint64_t h, const uint8_t *b, int len)
+{
+	uint64_t k;
+
+	h = mix(h, (uint64_t)len);
+	for (; len >= 8; len -= 8, b += 8)
+	{
+		memcpy(&k, b, 8);
+		h = mix(h, k);
+	}
+	if (len)
+	{
+		k = 0;
+		memcpy(&k, b, len);
+		h = mix(h, k);
+	}
+
+	return h;
+}
+
+png_index_t *new_png_index ()
+{
+	png_index_t *idx = malloc(sizeof(png_index_t));
+
+	idx->entries = png_entry_vec_new();
+	idx->oldest = idx->entries->head;
+	idx->memory = 0;
+	idx->mask = 255;
+	idx->buckets = malloc((idx->mask + 1) * sizeof(int));
+	memset(idx->buckets, -1, (idx->mask + 1) * sizeof(int));
+
+	return idx;
+}
+
+static void rehash (png_index_t *idx)
+{
+	png_entry_t *e;
+	int i, b;
+
+	idx->mask = idx->mask * 2 + 1;
+	idx->buckets = realloc(idx->buckets, (idx->mask + 1) * sizeof(int));
+	memset(idx->buckets, -1, (idx->mask + 1) * sizeof(int));
+
+	for (i = idx->entries->head; i < idx->entries->tail; i++)
+	{
+		e = png_entry_vec_get(idx->entries, i);
+		b = e->hash & idx->mask;
+		e->next = idx->buckets[b];
+		idx->buckets[b] = i;
+	}
+}
+
+static int same_graphic (png_entry_t *e, uint8_t *image, int w, uint32_t *pal, crop_t c, int step)
+{
+	int row = c.w * step, y;
+
+	if (e->data == NULL || e->w != c.w || e->h != c.h || e->step != step)
+		return 0;
+	for (y = 0; y < c.h; y++)
+		if (memcmp(e->data + y * row, image + step * (c.x + w * (c.y + y)), row))
+			return 0;
+
+	return pal == NULL || !memcmp(e->data + c.h * row, pal, 256 * sizeof(uint32_t));
+}
+
+static void keep_data (png_index_t *idx, png_entry_t *e, uint8_t *image, int w, uint32_t *pal, crop_t c)
+{
+	png_entry_t *old;
+	int row = c.w * e->step, y;
+
+	e->size = c.h * row + (pal != NULL ? 256 * sizeof(uint32_t) : 0);
+	e->data = malloc(e->size);
+	for (y = 0; y < c.h; y++)
+		memcpy(e->data + y * row, image + e->step * (c.x + w * (c.y + y)), row);
+	if (pal != NULL)
+		memcpy(e->data + c.h * row, pal, 256 * sizeof(uint32_t));
+
+	for (idx->memory += e->size; idx->memory > PNG_INDEX_MEMORY && idx->oldest < idx->entries->tail - 1; idx->oldest++)
+	{
+		old = png_entry_vec_get(idx->entries, idx->oldest);
+		idx->memory -= old->size;
+		free(old->data);
+		old->data = NULL;
+	}
+}
+
+int png_index_find (png_index_t *idx, uint8_t *image, int w, uint32_t *pal, crop_t c, png_ref_t *ref)
+{
+	png_entry_t *e;
+	int step = pal == NULL ? 4 : 1;
+	uint64_t h = 0;
+	int i, y;
+
+	for (y = 0; y < c.h; y++)
+		h = hash_bytes(h, image + step * (c.x + w * (c.y + y)), c.w * step);
+	if (pal != NULL)
+		h = hash_bytes(h, (uint8_t *)pal, 256 * sizeof(uint32_t));
+
+	for (i = idx->buckets[h & idx->mask]; i != -1; i = e->next)
+	{
+		e = png_entry_vec_get(idx->entries, i);
+		if (e->hash == h && same_graphic(e, image, w, pal, c, step))
+		{
+			*ref = e->ref;
+			return 1;
+		}
+	}
+
+	if (png_entry_vec_len(idx->entries) > idx->mask)
+		rehash(idx);
+
+	e = png_entry_vec_append(idx->entries);
+	e->hash = h;
+	e->w = c.w;
+	e->h = c.h;
+	e->step = step;
+	e->ref = *ref;
+	e->next = idx->buckets[h & idx->mask];
+	idx->buckets[h & idx->mask] = idx->entries->tail - 1;
+	keep_data(idx, e, image, w, pal, c);
+
+	return 0;
+}
+
+void destroy_png_index (png_index_t *idx)
+{
+	int i;
+
+	for (i = idx->oldest; i < idx->entries->tail; i++)
+		free(png_entry_vec_get(idx->entries, i)->data);
+	png_entry_vec_destroy(idx->entries);
+	free(idx->buckets);
+	free(idx);
+}
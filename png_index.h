@@ -0,0 +1,47 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef PNG_INDEX_H
+#define PNG_INDEX_H
+
+#include <stdint.h>
+#include "auto_split.h"
+
+/* Names the PNG file %08d_%d.png holding a graphic */
+typedef struct png_ref_s
+{
+	int file_id;
+	int graphic;
+} png_ref_t;
+
+typedef struct png_index_s png_index_t;
+
+png_index_t *new_png_index ();
+
+/* Look up crop c of image (8bpp with pal, RGBA with a NULL pal) by content.
+ * Returns 1 and sets ref to the PNG already holding identical pixels and
+ * palette. Otherwise, the graphic is recorded under ref and 0 is returned.
+ */
+int png_index_find (png_index_t *idx, uint8_t *image, int w, uint32_t *pal, crop_t c, png_ref_t *ref);
+
+void destroy_png_index (png_index_t *idx);
+
+/* 64bit hash of len bytes, continuing from h (start with 0) */
+uint64_t hash_bytes (uint64_t h, const uint8_t *b, int len);
+
+#endif
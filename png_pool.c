@@ -0,0 +1,278 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <pthread.h>
+#include "common.h"
+#include "png_pool.h"
+#include "abstract_vectors.h"
+#include "stats.h"
+
+#ifdef LINUX
+#include <unistd.h>
+#endif
+
+/* A snapshot of a single crop, owning its image data and palette */
+typedef struct png_job_s
+{
+	const sink_dir_t *dest;
+	int file_id;
+	int graphic;
+	int size;
+	uint8_t *image;
+	uint32_t *pal;
+	crop_t c;
+	png_profile_t *profile;
+} png_job_t;
+
+STATIC_VECTOR(png_job, png_job_t)
+
+/* Images of one destination that are not written yet */
+typedef struct png_dest_s
+{
+	const sink_dir_t *dest;
+	int pending;
+	int failed;
+} png_dest_t;
+
+STATIC_VECTOR(png_dest, png_dest_t)
+
+struct png_pool_s
+{
+	pthread_mutex_t lock;
+	pthread_cond_t queued; /* Signalled when a job was added or on shutdown */
+	pthread_cond_t done;   /* Signalled when a job was finished */
+	pthread_t *threads;
+	int n_threads;
+	int bytes;             /* Image data queued or being written */
+	int stop;
+	int failed;            /* Set once any PNG file could not be written */
+	png_job_vec_t *jobs;
+	png_dest_vec_t *dests; /* Destinations with images queued or written */
+	stats_t *stats;        /* Timing of the writer threads, or NULL */
+};
+
+int get_cpu_count ()
+{
+#ifdef LINUX
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n < 1 ? 1 : (int)n;
+#else
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors < 1 ? 1 : (int)info.dwNumberOfProcessors;
+#endif
+}
+
+/* The entry of dest, which is added if missing. The lock must be held. */
+static png_dest_t *find_dest (png_pool_t *pool, const sink_dir_t *dest)
+{
+	png_dest_t *d;
+	int i;
+
+	for (i = pool->dests->head; i < pool->dests->tail; i++)
+		if ((d = png_dest_vec_get(pool->dests, i))->dest == dest)
+			return d;
+
+	d = png_dest_vec_append(pool->dests);
+	d->dest = dest;
+
+	return d;
+}
+
+static void *png_worker (void *arg)
+{
+	png_pool_t *pool = arg;
+	png_job_t job;
+	png_dest_t *d;
+	crop_t c;
+	double t, seconds = 0;
+	int r;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;)
+	{
+		while (png_job_vec_empty(pool->jobs) && !pool->stop)
+			pthread_cond_wait(&pool->queued, &pool->lock);
+		if (!png_job_vec_shift(pool->jobs, &job))
+			break;
+		pthread_mutex_unlock(&pool->lock);
+
+		/* The snapshot only holds the crop, so it starts at 0/0 */
+		c = job.c;
+		c.x = 0;
+		c.y = 0;
+		t = stats_now(pool->stats);
+		r = write_png(job.dest, job.file_id, job.image, job.c.w, job.c.h, job.graphic, job.pal, c, job.profile);
+		if (pool->stats != NULL)
+			seconds = wall_clock() - t;
+		free(job.image);
+		free(job.pal);
+
+		pthread_mutex_lock(&pool->lock);
+		if (pool->stats != NULL)
+		{
+			pool->stats->seconds[STAGE_PNG] += seconds;
+			pool->stats->calls[STAGE_PNG]++;
+			pool->stats->png_files++;
+		}
+		d = find_dest(pool, job.dest);
+		if (r)
+			pool->failed = d->failed = 1;
+		d->pending--;
+		pool->bytes -= job.size;
+		pthread_cond_broadcast(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+png_pool_t *new_png_pool (int threads)
+{
+	png_pool_t *pool = calloc(1, sizeof(png_pool_t));
+	int i;
+
+	if (threads < 1)
+		threads = get_cpu_count();
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->queued, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->jobs = png_job_vec_new();
+	pool->dests = png_dest_vec_new();
+	pool->threads = calloc(threads, sizeof(pthread_t));
+
+	for (i = 0; i < threads; i++)
+	{
+		if (pthread_create(&(pool->threads[i]), NULL, png_worker, pool))
+		{
+			fprintf(stderr, "Cannot start PNG writer thread, writing PNG files on the main thread.\n");
+			close_png_pool(pool);
+			return NULL;
+		}
+		pool->n_threads++;
+	}
+
+	return pool;
+}
+
+int png_pool_write (png_pool_t *pool, const sink_dir_t *dest, int file_id, uint8_t *image, int w, int h, int graphic, uint32_t *pal, crop_t c, png_profile_t *profile)
+{
+	png_job_t *job;
+	png_dest_t *d;
+	int step = pal == NULL ? 4 : 1;
+	int size = c.w * c.h * step;
+	uint8_t *snap;
+	int failed;
+	int y;
+
+	if (pool == NULL)
+		return write_png(dest, file_id, image, w, h, graphic, pal, c, profile);
+
+	/* Snapshot crop */
+	snap = malloc(size);
+	for (y = 0; y < c.h; y++)
+		memcpy(snap + y * c.w * step, image + step * (c.x + w * (c.y + y)), c.w * step);
+
+	pthread_mutex_lock(&pool->lock);
+
+	/* Bound memory use, but always allow a single image through */
+	while (pool->bytes && pool->bytes + size > PNG_POOL_MAX_BYTES)
+		pthread_cond_wait(&pool->done, &pool->lock);
+
+	job = png_job_vec_append(pool->jobs);
+	job->dest = dest;
+	job->file_id = file_id;
+	job->graphic = graphic;
+	job->size = size;
+	job->image = snap;
+	job->pal = NULL;
+	if (pal != NULL)
+	{
+		job->pal = malloc(256 * sizeof(uint32_t));
+		memcpy(job->pal, pal, 256 * sizeof(uint32_t));
+	}
+	job->c = c;
+	job->profile = profile;
+	pool->bytes += size;
+	d = find_dest(pool, dest);
+	d->pending++;
+	failed = d->failed;
+
+	pthread_cond_signal(&pool->queued);
+	pthread_mutex_unlock(&pool->lock);
+
+	return failed ? -1 : 0;
+}
+
+void png_pool_set_stats (png_pool_t *pool, stats_t *stats)
+{
+	if (pool != NULL)
+		pool->stats = stats;
+}
+
+int png_pool_wait (png_pool_t *pool, const sink_dir_t *dest)
+{
+	png_dest_t *d, last;
+	int failed;
+
+	if (pool == NULL)
+		return 0;
+
+	pthread_mutex_lock(&pool->lock);
+	while ((d = find_dest(pool, dest))->pending)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	failed = d->failed;
+
+	/* Forget dest, its pointer may be reused for another set of files */
+	png_dest_vec_pop(pool->dests, &last);
+	if (d != &(pool->dests->items[pool->dests->tail]))
+		*d = last;
+	pthread_mutex_unlock(&pool->lock);
+
+	return failed ? -1 : 0;
+}
+
+int close_png_pool (png_pool_t *pool)
+{
+	int failed;
+	int i;
+
+	if (pool == NULL)
+		return 0;
+
+	/* Workers drain the queue before they notice the stop flag */
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->queued);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->n_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+	failed = pool->failed;
+
+	png_job_vec_destroy(pool->jobs);
+	png_dest_vec_destroy(pool->dests);
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->queued);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->threads);
+	free(pool);
+
+	return failed ? -1 : 0;
+}
@@ -0,0 +1,67 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef PNG_POOL_H
+#define PNG_POOL_H
+
+#include <stdint.h>
+#include "auto_split.h"
+#include "sink.h"
+
+struct png_profile_s;
+struct stats_s;
+
+/* Upper limit for image data queued but not yet written */
+#define PNG_POOL_MAX_BYTES (64 * 1024 * 1024)
+
+typedef struct png_pool_s png_pool_t;
+
+/* Start a pool of PNG writer threads, threads < 1 selects the CPU count.
+ * Returns NULL if no thread could be started, which png_pool_write treats
+ * as writing on the calling thread.
+ */
+png_pool_t *new_png_pool (int threads);
+
+/* Queue crop c of image for writing. The crop and palette are copied, so the
+ * caller may reuse both buffers right away, but dest must stay valid until
+ * the pool is closed or waited for. Blocks while too much image data
+ * is in flight. With a NULL pool, the PNG is written on the calling thread.
+ * Returns -1 if this or an earlier PNG file of dest could not be written.
+ */
+int png_pool_write (png_pool_t *pool, const sink_dir_t *dest, int file_id, uint8_t *image, int w, int h, int graphic, uint32_t *pal, crop_t c, struct png_profile_s *profile);
+
+/* Add the time spent encoding to stats, which must stay valid until the
+ * pool is closed. Set before the first image is queued.
+ */
+void png_pool_set_stats (png_pool_t *pool, struct stats_s *stats);
+
+/* Wait for the images queued for dest, while other threads may keep using
+ * the pool for other destinations. Returns -1 if any PNG file of dest could
+ * not be written.
+ */
+int png_pool_wait (png_pool_t *pool, const sink_dir_t *dest);
+
+/* Wait for all queued images to be written and stop the threads. Returns -1
+ * if any PNG file could not be written.
+ */
+int close_png_pool (png_pool_t *pool);
+
+/* Number of online CPUs, at least 1 */
+int get_cpu_count ();
+
+#endif
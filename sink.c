@@ -0,0 +1,449 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "sink.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+#endif
+
+#ifndef MIN
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+
+int sink_writev (sink_t *s, const sink_buf_t *bufs, int n)
+{
+	return s->write(s, bufs, n);
+}
+
+int sink_write (sink_t *s, const void *data, size_t len)
+{
+	sink_buf_t buf;
+
+	buf.data = data;
+	buf.len = len;
+	return s->write(s, &buf, 1);
+}
+
+int sink_seek (sink_t *s, uint64_t offset)
+{
+	if (s->seek == NULL)
+		return -1;
+	return s->seek(s, offset);
+}
+
+int64_t sink_sync (sink_t *s)
+{
+	if (s->sync == NULL)
+		return -1;
+	return s->sync(s);
+}
+
+int close_sink (sink_t *s)
+{
+	return s->close(s, 0);
+}
+
+void discard_sink (sink_t *s)
+{
+	s->close(s, 1);
+}
+
+/* File descriptors */
+
+typedef struct fd_sink_s
+{
+	sink_t s;
+	int fd;
+	int close_fd;
+	FILE *fh;            /* Owner of fd for file sinks, or NULL */
+	char *filename;      /* Deleted when discarded, or NULL */
+} fd_sink_t;
+
+#ifdef _WIN32
+static int fd_write (sink_t *s, const sink_buf_t *bufs, int n)
+{
+	fd_sink_t *f = (fd_sink_t *)s;
+	int i;
+
+	/* File sinks go through stdio, to keep the text mode of XML files */
+	for (i = 0; i < n; i++)
+	{
+		if (!bufs[i].len)
+			continue;
+		if (f->fh != NULL)
+		{
+			if (fwrite(bufs[i].data, bufs[i].len, 1, f->fh) != 1)
+				return -1;
+		}
+		else if (_write(f->fd, bufs[i].data, bufs[i].len) != (int)bufs[i].len)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int fd_seek (sink_t *s, uint64_t offset)
+{
+	fd_sink_t *f = (fd_sink_t *)s;
+
+	if (f->fh != NULL)
+		return _fseeki64(f->fh, offset, SEEK_SET) ? -1 : 0;
+	return _lseeki64(f->fd, offset, SEEK_SET) < 0 ? -1 : 0;
+}
+
+/* In text mode, the position counts the bytes in the file */
+static int64_t fd_sync (sink_t *s)
+{
+	fd_sink_t *f = (fd_sink_t *)s;
+
+	if (f->fh != NULL)
+		return fflush(f->fh) ? -1 : _ftelli64(f->fh);
+	return _lseeki64(f->fd, 0, SEEK_CUR);
+}
+
+static int cut_file (FILE *fh, uint64_t offset)
+{
+	return fflush(fh) || _chsize_s(_fileno(fh), offset) || _fseeki64(fh, offset, SEEK_SET) ? -1 : 0;
+}
+#else
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+
+/* Write iovecs completely, advancing past partial writes */
+static int write_iov (int fd, struct iovec *iov, int n)
+{
+	ssize_t done;
+
+	while (n)
+	{
+		done = writev(fd, iov, MIN(n, IOV_MAX));
+		if (done < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		while (n && (size_t)done >= iov->iov_len)
+		{
+			done -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n)
+		{
+			iov->iov_base = (uint8_t *)iov->iov_base + done;
+			iov->iov_len -= done;
+		}
+	}
+
+	return 0;
+}
+
+/* The stdio buffer of file sinks is never used, so writing to the
+ * descriptor directly keeps the file in order.
+ */
+static int fd_write (sink_t *s, const sink_buf_t *bufs, int n)
+{
+	fd_sink_t *f = (fd_sink_t *)s;
+	struct iovec iov_buf[16], *iov = iov_buf;
+	int i, r;
+
+	if (n > 16 && (iov = malloc(n * sizeof(struct iovec))) == NULL)
+		return -1;
+	for (i = 0; i < n; i++)
+	{
+		iov[i].iov_base = (void *)bufs[i].data;
+		iov[i].iov_len = bufs[i].len;
+	}
+	r = write_iov(f->fd, iov, n);
+
+	if (iov != iov_buf)
+		free(iov);
+	return r;
+}
+
+static int fd_seek (sink_t *s, uint64_t offset)
+{
+	fd_sink_t *f = (fd_sink_t *)s;
+
+	return lseek(f->fd, (off_t)offset, SEEK_SET) < 0 ? -1 : 0;
+}
+
+/* Nothing is buffered, see fd_write */
+static int64_t fd_sync (sink_t *s)
+{
+	fd_sink_t *f = (fd_sink_t *)s;
+
+	return lseek(f->fd, 0, SEEK_CUR);
+}
+
+static int cut_file (FILE *fh, uint64_t offset)
+{
+	return fflush(fh) || ftruncate(fileno(fh), (off_t)offset) || lseek(fileno(fh), (off_t)offset, SEEK_SET) < 0 ? -1 : 0;
+}
+#endif
+
+static int fd_close (sink_t *s, int discard)
+{
+	fd_sink_t *f = (fd_sink_t *)s;
+	int r = 0;
+
+	if (f->fh != NULL)
+		r = fclose(f->fh);
+	else if (f->close_fd)
+#ifdef _WIN32
+		r = _close(f->fd);
+#else
+		r = close(f->fd);
+#endif
+	if (discard && f->filename != NULL)
+		remove(f->filename);
+	free(f->filename);
+	free(f);
+
+	return r ? -1 : 0;
+}
+
+static fd_sink_t *new_fd_sink_real (int fd, int close_fd)
+{
+	fd_sink_t *f = calloc(1, sizeof(fd_sink_t));
+
+	if (f == NULL)
+		return NULL;
+	f->s.write = fd_write;
+	f->s.seek = fd_seek;
+	f->s.close = fd_close;
+	f->s.sync = fd_sync;
+	f->fd = fd;
+	f->close_fd = close_fd;
+
+	return f;
+}
+
+sink_t *new_fd_sink (int fd, int close_fd)
+{
+	return (sink_t *)new_fd_sink_real(fd, close_fd);
+}
+
+sink_t *new_file_sink (FILE *fh, const char *filename)
+{
+	fd_sink_t *f = new_fd_sink_real(fileno(fh), 0);
+
+	if (f == NULL)
+	{
+		fclose(fh);
+		return NULL;
+	}
+	f->fh = fh;
+	if (filename != NULL)
+		f->filename = strdup(filename);
+
+	return (sink_t *)f;
+}
+
+sink_t *new_file_sink_at (FILE *fh, const char *filename, uint64_t offset)
+{
+	if (cut_file(fh, offset))
+	{
+		fclose(fh);
+		return NULL;
+	}
+
+	return new_file_sink(fh, filename);
+}
+
+sink_t *open_file_sink (const char *filename)
+{
+	FILE *fh;
+
+	if ((fh = fopen(filename, "wb")) == NULL)
+		return NULL;
+
+	return new_file_sink(fh, filename);
+}
+
+/* Memory */
+
+typedef struct memory_sink_s
+{
+	sink_t s;
+	sink_buffer_t *buf;
+	size_t pos;
+} memory_sink_t;
+
+static int memory_write (sink_t *s, const sink_buf_t *bufs, int n)
+{
+	memory_sink_t *m = (memory_sink_t *)s;
+	sink_buffer_t *buf = m->buf;
+	size_t end = m->pos, size;
+	uint8_t *data;
+	int i;
+
+	for (i = 0; i < n; i++)
+		end += bufs[i].len;
+	if (end > buf->size)
+	{
+		size = buf->size ? buf->size : 64 * 1024;
+		while (size < end)
+			size *= 2;
+		if ((data = realloc(buf->data, size)) == NULL)
+			return -1;
+		buf->data = data;
+		buf->size = size;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		memcpy(buf->data + m->pos, bufs[i].data, bufs[i].len);
+		m->pos += bufs[i].len;
+	}
+	if (m->pos > buf->len)
+		buf->len = m->pos;
+
+	return 0;
+}
+
+static int memory_seek (sink_t *s, uint64_t offset)
+{
+	memory_sink_t *m = (memory_sink_t *)s;
+
+	if (offset > m->buf->len)
+		return -1;
+	m->pos = offset;
+
+	return 0;
+}
+
+static int memory_close (sink_t *s, int discard)
+{
+	memory_sink_t *m = (memory_sink_t *)s;
+
+	if (discard)
+		m->buf->len = 0;
+	free(m);
+
+	return 0;
+}
+
+sink_t *new_memory_sink (sink_buffer_t *buf)
+{
+	memory_sink_t *m = calloc(1, sizeof(memory_sink_t));
+
+	if (m == NULL)
+		return NULL;
+	m->s.write = memory_write;
+	m->s.seek = memory_seek;
+	m->s.close = memory_close;
+	m->buf = buf;
+	m->pos = buf->len;
+
+	return (sink_t *)m;
+}
+
+/* Callbacks */
+
+typedef struct callback_sink_s
+{
+	sink_t s;
+	sink_write_cb write;
+	sink_seek_cb seek;
+	sink_close_cb close;
+} callback_sink_t;
+
+static int callback_write (sink_t *s, const sink_buf_t *bufs, int n)
+{
+	callback_sink_t *c = (callback_sink_t *)s;
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (bufs[i].len && c->write(s->opaque, bufs[i].data, bufs[i].len))
+			return -1;
+
+	return 0;
+}
+
+static int callback_seek (sink_t *s, uint64_t offset)
+{
+	callback_sink_t *c = (callback_sink_t *)s;
+
+	return c->seek(s->opaque, offset);
+}
+
+static int callback_close (sink_t *s, int discard)
+{
+	callback_sink_t *c = (callback_sink_t *)s;
+	int r = 0;
+
+	if (c->close != NULL)
+		r = c->close(s->opaque, discard);
+	free(c);
+
+	return r;
+}
+
+sink_t *new_callback_sink (void *opaque, sink_write_cb write, sink_seek_cb seek, sink_close_cb close)
+{
+	callback_sink_t *c = calloc(1, sizeof(callback_sink_t));
+
+	if (c == NULL)
+		return NULL;
+	c->s.write = callback_write;
+	c->s.seek = seek != NULL ? callback_seek : NULL;
+	c->s.close = callback_close;
+	c->s.opaque = opaque;
+	c->write = write;
+	c->seek = seek;
+	c->close = close;
+
+	return (sink_t *)c;
+}
+
+/* Sets of files */
+
+sink_t *sink_dir_open (const sink_dir_t *d, const char *name)
+{
+	sink_t *s;
+	char *filename;
+
+	if (d->open != NULL)
+	{
+		if ((s = d->open(d->opaque, name)) == NULL)
+			fprintf(stderr, "Cannot open %s for writing.\n", name);
+		return s;
+	}
+
+	filename = malloc(strlen(d->dir) + strlen(name) + 1);
+	strcpy(filename, d->dir);
+	strcat(filename, name);
+	if ((s = open_file_sink(filename)) == NULL)
+		fprintf(stderr, "Cannot open %s for writing: %s\n", filename, strerror(errno));
+	free(filename);
+
+	return s;
+}
@@ -0,0 +1,118 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef SINK_H
+#define SINK_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+typedef struct sink_buf_s
+{
+	const void *data;
+	size_t len;
+} sink_buf_t;
+
+/* Where the SUP, XML and PNG writers put their output. Writers hand over
+ * pointers into their own buffers, so a sink sees each byte exactly once
+ * and need not copy anything it passes on.
+ */
+typedef struct sink_s sink_t;
+struct sink_s
+{
+	/* Write n buffers in order. Returns 0, or -1 on failure. */
+	int (*write) (sink_t *s, const sink_buf_t *bufs, int n);
+	/* Continue writing at offset from the start. NULL if not possible. */
+	int (*seek) (sink_t *s, uint64_t offset);
+	/* Finish and free the sink. With discard set, the output is not
+	 * complete and need not be kept.
+	 */
+	int (*close) (sink_t *s, int discard);
+	/* Hand buffered data to the system and return the offset reached.
+	 * NULL if not possible.
+	 */
+	int64_t (*sync) (sink_t *s);
+	void *opaque;
+};
+
+int sink_write (sink_t *s, const void *data, size_t len);
+int sink_writev (sink_t *s, const sink_buf_t *bufs, int n);
+int sink_seek (sink_t *s, uint64_t offset);
+/* Returns -1 if the sink cannot sync */
+int64_t sink_sync (sink_t *s);
+int close_sink (sink_t *s);
+void discard_sink (sink_t *s);
+
+/* Write into an open file, which the sink closes. A discarded file is
+ * deleted, if filename is not NULL.
+ */
+sink_t *new_file_sink (FILE *fh, const char *filename);
+
+/* Create a file. Returns NULL and sets errno on failure. */
+sink_t *open_file_sink (const char *filename);
+
+/* Same as new_file_sink for a file opened for update, which is cut at
+ * offset and continued there. Returns NULL on failure, after closing fh.
+ */
+sink_t *new_file_sink_at (FILE *fh, const char *filename, uint64_t offset);
+
+/* Write to a file descriptor, like a pipe. It is closed with the sink if
+ * close_fd is set. Seeking works if the descriptor allows it.
+ */
+sink_t *new_fd_sink (int fd, int close_fd);
+
+/* Memory owned by the caller, which is grown with realloc. Free data when
+ * done with it, also after the sink is closed.
+ */
+typedef struct sink_buffer_s
+{
+	uint8_t *data;
+	size_t len;
+	size_t size;
+} sink_buffer_t;
+
+sink_t *new_memory_sink (sink_buffer_t *buf);
+
+/* Pass output on to the caller, seek and close may be NULL */
+typedef int (*sink_write_cb) (void *opaque, const void *data, size_t len);
+typedef int (*sink_seek_cb) (void *opaque, uint64_t offset);
+typedef int (*sink_close_cb) (void *opaque, int discard);
+
+sink_t *new_callback_sink (void *opaque, sink_write_cb write, sink_seek_cb seek, sink_close_cb close);
+
+/* A set of files, like the PNG files of a BDN XML file. Without an open
+ * function, they are created in dir, which ends in a path separator.
+ */
+typedef struct sink_dir_s
+{
+	const char *dir;
+	sink_t *(*open) (void *opaque, const char *name);
+	void *opaque;
+} sink_dir_t;
+
+/* Returns NULL and prints the reason on failure */
+sink_t *sink_dir_open (const sink_dir_t *d, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,92 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include "common.h"
+#include "stats.h"
+
+static const char *stage_names[STAGES] = { "read", "empty", "duplicate", "cache", "swap", "crop", "palette", "rle", "png", "png_queue", "sup", "xml" };
+static const char *stage_titles[STAGES] = { "Frame read", "Empty check", "Dup check", "Line lookup", "Zero/swap", "Crop/split", "Palettize", "RLE", "PNG encode", "PNG queue", "SUP write", "XML write" };
+
+double stats_now (stats_t *st)
+{
+	return st != NULL ? wall_clock() : 0;
+}
+
+double stats_lap (stats_t *st, int stage, double start)
+{
+	double now;
+
+	if (st == NULL)
+		return 0;
+
+	now = wall_clock();
+	st->seconds[stage] += now - start;
+	st->calls[stage]++;
+
+	return now;
+}
+
+void print_stats (stats_t *st, FILE *fh)
+{
+	double total = st->total > 0 ? st->total : 1;
+	int i;
+
+	fprintf(fh, "%-12s %10s %7s %10s\n", "Stage", "Time", "Share", "Calls");
+	for (i = 0; i < STAGES; i++)
+		fprintf(fh, "%-12s %9.3fs %6.1f%% %10lld\n", stage_titles[i], st->seconds[i], 100 * st->seconds[i] / total, st->calls[i]);
+	fprintf(fh, "Total        %9.3fs (%.0f frames/s, %.1f MB/s, PNG encode runs on its own threads)\n", st->total, st->frames / total, st->read_bytes / total / 1e6);
+	fprintf(fh, "Frames: %lld read, %lld empty, %lld duplicate - Lines: %lld, %lld cached, %lld repeated\n", st->frames, st->empty_frames, st->dup_frames, st->lines, st->cached_lines, st->repeated_lines);
+	fprintf(fh, "Epochs: %lld - Palettes: %lld - ODS bytes: %lld - SUP bytes: %lld - PNG files: %lld\n", st->epochs, st->palettes, st->ods_bytes, st->sup_bytes, st->png_files);
+}
+
+int write_stats_json (stats_t *st, const char *filename)
+{
+	FILE *fh = stdout;
+	double total = st->total > 0 ? st->total : 1;
+	int i, r;
+
+	if (strcmp(filename, "-") && (fh = fopen(filename, "w")) == NULL)
+	{
+		perror("Error opening stats file");
+		return -1;
+	}
+
+	fprintf(fh, "{\n  \"seconds\": %.6f,\n", st->total);
+	fprintf(fh, "  \"frames_per_second\": %.1f,\n  \"mb_per_second\": %.1f,\n  \"read_bytes\": %lld,\n", st->frames / total, st->read_bytes / total / 1e6, st->read_bytes);
+	fprintf(fh, "  \"frames\": %lld,\n  \"empty_frames\": %lld,\n  \"dup_frames\": %lld,\n  \"lines\": %lld,\n  \"cached_lines\": %lld,\n  \"repeated_lines\": %lld,\n", st->frames, st->empty_frames, st->dup_frames, st->lines, st->cached_lines, st->repeated_lines);
+	fprintf(fh, "  \"epochs\": %lld,\n  \"palettes\": %lld,\n  \"ods_bytes\": %lld,\n  \"sup_bytes\": %lld,\n  \"png_files\": %lld,\n", st->epochs, st->palettes, st->ods_bytes, st->sup_bytes, st->png_files);
+	fprintf(fh, "  \"stages\": {\n");
+	for (i = 0; i < STAGES; i++)
+		fprintf(fh, "    \"%s\": {\"seconds\": %.6f, \"calls\": %lld}%s\n", stage_names[i], st->seconds[i], st->calls[i], i < STAGES - 1 ? "," : "");
+	fprintf(fh, "  }\n}\n");
+
+	r = ferror(fh);
+	if (fh != stdout)
+		r |= fclose(fh);
+	else
+		fflush(fh);
+	if (r)
+	{
+		perror("Error writing stats file");
+		return -1;
+	}
+
+	return 0;
+}
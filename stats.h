@@ -0,0 +1,75 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+/* Stages of the pipeline, timed separately. No stage includes another. */
+enum
+{
+	STAGE_READ,      /* Reading or rendering input frames */
+	STAGE_EMPTY,     /* Checking for empty frames */
+	STAGE_DUP,       /* Checking for duplicate frames */
+	STAGE_CACHE,     /* Hashing first frames of lines, looking up earlier lines */
+	STAGE_SWAP,      /* Zeroing transparent pixels and swapping R and B */
+	STAGE_CROP,      /* Cropping and splitting images */
+	STAGE_PALETTE,
+	STAGE_RLE,
+	STAGE_PNG,       /* Encoding PNG files, summed over writer threads */
+	STAGE_PNG_QUEUE, /* Handing PNG files to writer threads and dedup */
+	STAGE_SUP,       /* Building and writing SUP display sets */
+	STAGE_XML,
+	STAGES
+};
+
+typedef struct stats_s
+{
+	double seconds[STAGES];
+	long long calls[STAGES];
+	double total;             /* Whole run, set by the caller */
+	long long frames;         /* Frames read */
+	long long read_bytes;     /* RGBA data of the frames read */
+	long long empty_frames;   /* Skipped as empty */
+	long long dup_frames;     /* Skipped as identical to the previous one */
+	long long lines;
+	long long cached_lines;   /* Taken from the frame cache */
+	long long repeated_lines; /* Taken from an earlier line of this run */
+	long long epochs;
+	long long palettes;       /* Palette definition segments */
+	long long ods_bytes;      /* RLE data of object definition segments */
+	long long sup_bytes;
+	long long png_files;
+} stats_t;
+
+/* Current time for stats_lap, or 0 if st is NULL, which disables timing */
+double stats_now (stats_t *st);
+
+/* Add the time since start to stage and return the current time */
+double stats_lap (stats_t *st, int stage, double start);
+
+/* Human readable summary */
+void print_stats (stats_t *st, FILE *fh);
+
+/* The same as JSON, written to filename or stdout for "-". Returns -1 on
+ * failure.
+ */
+int write_stats_json (stats_t *st, const char *filename);
+
+#endif
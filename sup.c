@@ -23,21 +23,10 @@
 #include <math.h>
 #include "auto_split.h"
 #include "sup.h"
-#include "abstract_lists.h"
-
-#ifdef BE_ARCH
-#define SWAP32(x) (x)
-#define SWAP16(x) (x)
-#endif
-#ifdef LE_ARCH
-#define SWAP32(x) ((int32_t)(((x & 0xff000000) >> 24) | ((x & 0xff0000) >> 8) | ((x & 0xff00) << 8) | ((x & 0xff) << 24)))
-#define SWAP16(x) ((int16_t)(((x & 0xff) << 8) | ((x & 0xff00) >> 8)))
-#endif
-#ifndef LE_ARCH
-#ifndef BE_ARCH
-#error "Please specify endian-ness with -DLE_ARCH or -DBE_ARCH."
-#endif
-#endif
+#include "pgs_model.h"
+#include "sup_index.h"
+#include "stats.h"
+#include "abstract_vectors.h"
 
 #ifdef _WIN32
 #include <wchar.h>
@@ -56,11 +45,10 @@ static int count (uint8_t *im, int x, int w, int col)
 	return c;
 }
 
-/* Output buffer will contain malloced RLE data */
 #define PUSH(x) {*(b++)=(x);(*len)++;}
 #define FLAG_COLOR 0x80
 #define FLAG_LONG 0x40
-static uint8_t *rl_encode (uint8_t *im, int w, int h, rect_t crop, int *len)
+uint8_t *rl_encode (uint8_t *im, int w, int h, rect_t crop, int *len)
 {
 	uint8_t *b = calloc(crop.w * crop.h, 4); /* Over-allocation */
 	uint8_t *rle = b;
@@ -115,256 +103,294 @@ static uint8_t *rl_encode (uint8_t *im, int w, int h, rect_t crop, int *len)
 	return rle;
 }
 
-typedef struct sup_header_s
-{
-	uint8_t m1;          /* 'P' */
-	uint8_t m2;          /* 'G' */
-	uint32_t start_time;
-	uint32_t dts;
-	uint8_t packet_type; /* 0x16 = pcs_start/end, 0x17 = wds, 0x14 = palette, 0x15 = ods_first, 0x80 = null */
-	uint16_t packet_len;
-} __attribute ((packed)) sup_header_t;
+/* Display sets are put together in sw->ds and written with a single call
+ * once they are complete. Large RLE payloads are not copied into the buffer,
+ * but referenced from sw->segs and written with writev where available.
+ * All fields are stored big-endian.
+ */
+#define PUT8(p,x) { *((p)++) = (uint8_t)(x); }
+#define PUT16(p,x) { PUT8(p, (x) >> 8) PUT8(p, x) }
+#define PUT32(p,x) { PUT16(p, (uint32_t)(x) >> 16) PUT16(p, x) }
 
-void conv_sup_header (sup_header_t *h)
-{
-	h->start_time = SWAP32(h->start_time);
-	h->dts = SWAP32(h->dts);
-	h->packet_len = SWAP16(h->packet_len);
-}
+/* RLE data shorter than this is copied into the display set buffer */
+#define DS_REF_MIN 4096
 
-static void write_header (FILE *fh, int start_time, int dts, int packet_type, int packet_len)
+typedef struct sup_seg_s
 {
-	sup_header_t h;
-
-	h.m1 = 80; h.m2 = 71;
-	h.start_time = start_time;
-	h.dts = dts;
-	h.packet_type = packet_type;
-	h.packet_len = packet_len;
+	int off;       /* Position in sw->ds, data goes before sw->ds[off] */
+	uint8_t *data;
+	int len;
+} sup_seg_t;
 
-	conv_sup_header(&h);
-	fwrite(&h, sizeof(h), 1, fh);
-}
+STATIC_VECTOR(sup_seg, sup_seg_t)
 
-typedef struct sup_pcs_start_s
+/* Returns room for len more bytes at the end of the display set buffer */
+static uint8_t *ds_grow (sup_writer_t *sw, int len)
 {
-	uint16_t width;
-	uint16_t height; /* height - 2 * Core.getCropOfsY */
-	uint8_t fps_id; /* getFpsId() */
-	uint16_t comp_num;
-	uint8_t follower;  /* 0x80 if first or single, 0x40 if follows directly (end = start) or the frame after */
-	uint16_t m; /* 0 */
-	uint8_t objects; /* 1 */
-} __attribute ((packed)) sup_pcs_start_t;
+	uint8_t *p;
 
-void conv_sup_pcs_start (sup_pcs_start_t *pcss)
-{
-	pcss->width = SWAP16(pcss->width);
-	pcss->height = SWAP16(pcss->height);
-	pcss->comp_num = SWAP16(pcss->comp_num);
-	pcss->m = SWAP16(pcss->m);
+	if (sw->ds_len + len > sw->ds_size)
+	{
+		while (sw->ds_len + len > sw->ds_size)
+			sw->ds_size *= 2;
+		sw->ds = realloc(sw->ds, sw->ds_size);
+	}
+	p = sw->ds + sw->ds_len;
+	sw->ds_len += len;
+
+	return p;
 }
 
-typedef struct sup_pcs_start_obj_s
+/* Add payload data, which has to stay valid until ds_flush */
+static void ds_data (sup_writer_t *sw, uint8_t *data, int len)
 {
-	uint16_t picture;
-	uint8_t window;
-	uint8_t forced; /* forced ? 64 : 0 */
-	uint16_t x_off;
-	uint16_t y_off;
-} __attribute ((packed)) sup_pcs_start_obj_t;
+	sup_seg_t *seg;
 
-void conv_sup_pcs_start_obj (sup_pcs_start_obj_t *pcsso)
-{
-	pcsso->picture = SWAP16(pcsso->picture);
-	pcsso->x_off = SWAP16(pcsso->x_off);
-	pcsso->y_off = SWAP16(pcsso->y_off);
+	if (len < DS_REF_MIN)
+	{
+		memcpy(ds_grow(sw, len), data, len);
+		return;
+	}
+
+	seg = sup_seg_vec_append(sw->segs);
+	seg->off = sw->ds_len;
+	seg->data = data;
+	seg->len = len;
 }
 
-static void write_pcs_start (FILE *fh, int start_time, int dts, int follower, int objects, int vid_w, int vid_h, int fps_id, int comp_num)
+/* Bytes in the display set, including referenced data */
+static int ds_total (sup_writer_t *sw)
 {
-	sup_pcs_start_t pcss;
+	int len = sw->ds_len, i;
 
-	write_header(fh, start_time, dts, 22, sizeof(pcss) + objects * sizeof(sup_pcs_start_obj_t));
+	for (i = sw->segs->head; i < sw->segs->tail; i++)
+		len += sup_seg_vec_get(sw->segs, i)->len;
 
-	pcss.m = 0;
-	pcss.width = vid_w;
-	pcss.height = vid_h;
-	pcss.fps_id = fps_id;
-	pcss.comp_num = comp_num;
-	pcss.follower = !follower ? 0x80 : 0x40; /* 0x80 for single lines, and first lines, 0x40 for following directly or with one frame between */
-	pcss.objects = objects;
+	return len;
+}
 
-	conv_sup_pcs_start(&pcss);
-	fwrite(&pcss, sizeof(pcss), 1, fh);
+static void ds_error (sup_writer_t *sw)
+{
+	if (!sw->error)
+		perror("Error writing SUP/PGS file");
+	sw->error = 1;
 }
 
-static void write_pcs_start_obj (FILE *fh, int picture, int window, int x_off, int y_off, int forced)
+/* Hand the display set to the sink, with segment data in place */
+static void ds_flush (sup_writer_t *sw)
 {
-	sup_pcs_start_obj_t pcsso;
+	sink_buf_t buf_buf[16], *bufs = buf_buf;
+	sup_seg_t *seg;
+	int off = 0, n = 0, i;
 
-	pcsso.picture = picture;
-	pcsso.window = window;
-	pcsso.forced = (forced ? 64 : 0);
-	pcsso.x_off = x_off;
-	pcsso.y_off = y_off;
+	if (2 * sup_seg_vec_len(sw->segs) + 1 > 16)
+		bufs = malloc((2 * sup_seg_vec_len(sw->segs) + 1) * sizeof(sink_buf_t));
 
-	conv_sup_pcs_start_obj(&pcsso);
-	fwrite(&pcsso, sizeof(pcsso), 1, fh);
+	for (i = sw->segs->head; i < sw->segs->tail; i++)
+	{
+		seg = sup_seg_vec_get(sw->segs, i);
+		if (seg->off > off)
+		{
+			bufs[n].data = sw->ds + off;
+			bufs[n++].len = seg->off - off;
+		}
+		bufs[n].data = seg->data;
+		bufs[n++].len = seg->len;
+		off = seg->off;
+	}
+	if (sw->ds_len > off)
+	{
+		bufs[n].data = sw->ds + off;
+		bufs[n++].len = sw->ds_len - off;
+	}
+	if (!sw->error && sink_writev(sw->sink, bufs, n))
+		ds_error(sw);
+
+	if (bufs != buf_buf)
+		free(bufs);
+	if (sw->stats != NULL)
+		sw->stats->sup_bytes += ds_total(sw);
+	sw->offset += ds_total(sw);
+	sw->ds_len = 0;
+	sup_seg_vec_clear(sw->segs);
 }
 
-typedef struct sup_wds_s
+/* packet_type: 0x16 = pcs_start/end, 0x17 = wds, 0x14 = palette, 0x15 = ods_first, 0x80 = null */
+static void write_header (sup_writer_t *sw, int start_time, int dts, int packet_type, int packet_len)
 {
-	uint8_t windows; /* 1 or 2 */
-} __attribute ((packed)) sup_wds_t;
+	uint8_t *p = ds_grow(sw, 13);
+
+	PUT8(p, 'P')
+	PUT8(p, 'G')
+	PUT32(p, start_time)
+	PUT32(p, dts)
+	PUT8(p, packet_type)
+	PUT16(p, packet_len)
+}
 
-void conv_sup_wds (sup_wds_t *wds)
+static void write_pcs_start (sup_writer_t *sw, int start_time, int dts, int follower, int objects, int vid_w, int vid_h, int fps_id, int comp_num)
 {
-	/* Do nothing. */
+	uint8_t *p;
+
+	write_header(sw, start_time, dts, 22, 11 + objects * 8);
+
+	p = ds_grow(sw, 11);
+	PUT16(p, vid_w)
+	PUT16(p, vid_h) /* height - 2 * Core.getCropOfsY */
+	PUT8(p, fps_id)
+	PUT16(p, comp_num)
+	PUT8(p, !follower ? 0x80 : 0x40) /* 0x80 for single lines, and first lines, 0x40 for following directly or with one frame between */
+	PUT16(p, 0)
+	PUT8(p, objects)
 }
 
-typedef struct sup_wds_obj_s
+static void write_pcs_start_obj (sup_writer_t *sw, int picture, int window, int x_off, int y_off, int forced)
 {
-	uint8_t window; /* 0 or 1 */
-	uint16_t x_off;
-	uint16_t y_off;
-	uint16_t width;
-	uint16_t height;
-} __attribute ((packed)) sup_wds_obj_t;
+	uint8_t *p = ds_grow(sw, 8);
 
-void conv_sup_wds_obj (sup_wds_obj_t *wdso)
-{
-	wdso->x_off = SWAP16(wdso->x_off);
-	wdso->y_off = SWAP16(wdso->y_off);
-	wdso->width = SWAP16(wdso->width);
-	wdso->height = SWAP16(wdso->height);
+	PUT16(p, picture)
+	PUT8(p, window)
+	PUT8(p, forced ? 64 : 0)
+	PUT16(p, x_off)
+	PUT16(p, y_off)
 }
 
-static void write_wds (FILE *fh, int timestamp, int dts, int windows)
+static void write_wds (sup_writer_t *sw, int timestamp, int dts, int windows)
 {
-	sup_wds_t wds;
+	uint8_t *p;
 
-	write_header(fh, timestamp, dts, 23, sizeof(wds) + windows * sizeof(sup_wds_obj_t));
+	write_header(sw, timestamp, dts, 23, 1 + windows * 9);
 
-	wds.windows = windows;
-
-	conv_sup_wds(&wds);
-	fwrite(&wds, sizeof(wds), 1, fh);
+	p = ds_grow(sw, 1);
+	PUT8(p, windows) /* 1 or 2 */
 }
 
-static void write_wds_obj (FILE *fh, int window, int w, int h, int x_off, int y_off)
+static void write_wds_obj (sup_writer_t *sw, int window, int w, int h, int x_off, int y_off)
 {
-	sup_wds_obj_t wdso;
-
-	wdso.window = window;
-	wdso.x_off = x_off;
-	wdso.y_off = y_off;
-	wdso.width = w;
-	wdso.height = h;
+	uint8_t *p = ds_grow(sw, 9);
 
-	conv_sup_wds_obj(&wdso);
-	fwrite(&wdso, sizeof(wdso), 1, fh);
+	PUT8(p, window) /* 0 or 1 */
+	PUT16(p, x_off)
+	PUT16(p, y_off)
+	PUT16(p, w)
+	PUT16(p, h)
 }
 
+/* RGB to YCrCb conversion as used for palettes. Each output is the sum of
+ * one term per channel, so the terms are tabulated once per writer. The sum
+ * is done in 8.23 fixed point. Only when it lands within a few units of a
+ * rounding boundary, the double precision terms are summed instead, so the
+ * result matches the straightforward floating point conversion exactly.
+ */
 #define CLAMP(x,min,max) (MAX(MIN(x,max),min))
-static uint8_t get_y (uint32_t c, int s)
-{
-	uint8_t *v = (uint8_t *)&c;
-	uint8_t r = v[0], g = v[1], b = v[2];
-	if (s)
-		return (uint8_t)CLAMP(16 + (int)floor(0.5 + (double)(r * 0.299 * 219.0 / 255.0 + g * 0.587 * 219.0 / 255.0 + b * 0.114 * 219.0 / 255.0)), 16, 235);
-	else
-		return (uint8_t)CLAMP(16 + (int)floor(0.5 + (double)(r * 0.2126 * 219.0 / 255.0 + g * 0.7152 * 219.0 / 255.0 + b * 0.0722 * 219.0 / 255.0)), 16, 235);
-}
-static uint8_t get_u (uint32_t c, int s)
+#define YCC_SHIFT 23
+#define YCC_ONE (1 << YCC_SHIFT)
+#define YCC_SLACK 8
+
+struct ycc_table_s
 {
-	uint8_t *v = (uint8_t *)&c;
-	uint8_t r = v[0], g = v[1], b = v[2];
-	if (s)
-		return (uint8_t)CLAMP(128 + (int)floor(0.5 + (double)(r * 0.5 * 224.0 / 255.0 - (g * 0.418688 * 224.0 / 255.0) - (b * 0.081312 * 224.0 / 255.0))), 16, 240);
-	else
-		return (uint8_t)CLAMP(128 + (int)floor(0.5 + (double)(r * 0.5 * 224.0 / 255.0 - (g * 0.7152 / 1.5748 * 224.0 / 255.0) - (b * 0.0722 / 1.5748 * 224.0 / 255.0))), 16, 240);
-}
-static uint8_t get_v (uint32_t c, int s)
+	int32_t fix[3][3][256];  /* Output (Y, Cr, Cb), input channel (R, G, B), value */
+	double fp[3][3][256];
+};
+
+/* Colorspace = 1 for BT.601, 2 for BT.2020, 0 for BT.709 */
+static ycc_table_t *new_ycc_table (int colorspace)
 {
-	uint8_t *v = (uint8_t *)&c;
-	uint8_t r = v[0], g = v[1], b = v[2];
-	if (s)
-		return (uint8_t)CLAMP(128 + (int)floor(0.5 + (double)(-r * 0.168736 * 224.0 / 255.0 - (g * 0.331264 * 224.0 / 255.0) + b * 0.5 * 224.0 / 255.0)), 16, 240);
-	else
-		return (uint8_t)CLAMP(128 + (int)floor(0.5 + (double)(-r * 0.2126 / 1.8556 * 224.0 / 255.0 - (g * 0.7152 / 1.8556 * 224.0 / 255.0) + b * 0.5 * 224.0 / 255.0)), 16, 240);
+	ycc_table_t *t = malloc(sizeof(ycc_table_t));
+	double kr, kg, kb, cr_div, cb_div;
+	int o, c, v;
+
+	switch (colorspace)
+	{
+		case 1:
+			kr = 0.299; kg = 0.587; kb = 0.114;
+			cr_div = 1.402; cb_div = 1.772;
+			break;
+		case 2:
+			kr = 0.2627; kg = 0.6780; kb = 0.0593;
+			cr_div = 1.4746; cb_div = 1.8814;
+			break;
+		default:
+			kr = 0.2126; kg = 0.7152; kb = 0.0722;
+			cr_div = 1.5748; cb_div = 1.8556;
+			break;
+	}
+
+	for (v = 0; v < 256; v++)
+	{
+		/* Same expressions and evaluation order as the reference formulas */
+		t->fp[0][0][v] = v * kr * 219.0 / 255.0;
+		t->fp[0][1][v] = v * kg * 219.0 / 255.0;
+		t->fp[0][2][v] = v * kb * 219.0 / 255.0;
+		t->fp[1][0][v] = v * 0.5 * 224.0 / 255.0;
+		t->fp[2][2][v] = v * 0.5 * 224.0 / 255.0;
+		if (colorspace == 1)
+		{
+			t->fp[1][1][v] = -(v * 0.418688 * 224.0 / 255.0);
+			t->fp[1][2][v] = -(v * 0.081312 * 224.0 / 255.0);
+			t->fp[2][0][v] = -v * 0.168736 * 224.0 / 255.0;
+			t->fp[2][1][v] = -(v * 0.331264 * 224.0 / 255.0);
+		}
+		else
+		{
+			t->fp[1][1][v] = -(v * kg / cr_div * 224.0 / 255.0);
+			t->fp[1][2][v] = -(v * kb / cr_div * 224.0 / 255.0);
+			t->fp[2][0][v] = -v * kr / cb_div * 224.0 / 255.0;
+			t->fp[2][1][v] = -(v * kg / cb_div * 224.0 / 255.0);
+		}
+	}
+
+	for (o = 0; o < 3; o++)
+		for (c = 0; c < 3; c++)
+			for (v = 0; v < 256; v++)
+				t->fix[o][c][v] = (int32_t)floor(t->fp[o][c][v] * YCC_ONE + 0.5);
+
+	return t;
 }
 
-typedef struct sup_palette_s
+static uint8_t ycc_convert (ycc_table_t *t, int o, uint8_t r, uint8_t g, uint8_t b, int offset, int max)
 {
-	uint16_t palette;
-} __attribute ((packed)) sup_palette_t;
+	int32_t sum = t->fix[o][0][r] + t->fix[o][1][g] + t->fix[o][2][b] + YCC_ONE / 2;
+	int32_t frac = sum & (YCC_ONE - 1);
+	int x;
 
-void conv_sup_palette (sup_palette_t *p)
-{
-	p->palette = SWAP16(p->palette);
+	if (frac < YCC_SLACK || frac > YCC_ONE - YCC_SLACK)
+		x = (int)floor(0.5 + (t->fp[o][0][r] + t->fp[o][1][g] + t->fp[o][2][b]));
+	else
+		x = sum >> YCC_SHIFT;
+
+	return (uint8_t)CLAMP(offset + x, 16, max);
 }
 
-/* Colorspace = 1 for 480p/576p, 0 otherwise */
-#define PUT(x) { t = (uint8_t)(x); fwrite(&t, 1, 1, fh); }
-static void write_palette (FILE *fh, int dts, int palette, uint32_t *pal, int colorspace)
+static void write_palette (sup_writer_t *sw, int dts, int palette, uint32_t *pal)
 {
-	sup_palette_t p;
+	uint8_t *p, *c;
 	int entries = 1, i;
-	uint8_t t;
 
 	for (i = 1; i < 256 && pal[i]; i++)
 		entries++;
-	write_header(fh, dts, 0, 20, sizeof(p) + entries * 5);
+	write_header(sw, dts, 0, 20, 2 + entries * 5);
+	if (sw->stats != NULL)
+		sw->stats->palettes++;
 
-	p.palette = palette;
-	conv_sup_palette(&p);
-	fwrite(&p, sizeof(p), 1, fh);
+	p = ds_grow(sw, 2 + entries * 5);
+	PUT16(p, palette)
 
 	for (i = 0; i < entries; i++)
 	{
-		PUT(i)
-		PUT(get_y(pal[i], colorspace))
-		PUT(get_u(pal[i], colorspace))
-		PUT(get_v(pal[i], colorspace))
-		PUT(((uint8_t *)&(pal[i]))[3])
+		c = (uint8_t *)&(pal[i]);
+		PUT8(p, i)
+		PUT8(p, ycc_convert(sw->ycc, 0, c[0], c[1], c[2], 16, 235))
+		PUT8(p, ycc_convert(sw->ycc, 1, c[0], c[1], c[2], 128, 240))
+		PUT8(p, ycc_convert(sw->ycc, 2, c[0], c[1], c[2], 128, 240))
+		PUT8(p, c[3])
 	}
 }
 
-typedef struct sup_ods_first_s
-{
-	uint16_t picture;
-	uint8_t m; /* 0 */
-	uint32_t magic_len; /* (single_packet ? 0xc0000000 : 0x80000000) | (length + 4) */
-	uint16_t width;
-	uint16_t height;
-} __attribute ((packed)) sup_ods_first_t;
-
-void conv_sup_ods_first (sup_ods_first_t *odsf)
+static void write_image (sup_writer_t *sw, int timestamp, int dts, int picture, int w, int h, uint8_t *rle, int rle_len)
 {
-	odsf->picture = SWAP16(odsf->picture);
-	odsf->magic_len = SWAP32(odsf->magic_len);
-	odsf->width = SWAP16(odsf->width);
-	odsf->height = SWAP16(odsf->height);
-}
-
-typedef struct sup_ods_next_s
-{
-	uint16_t picture;
-	uint8_t m; /* 0 */
-	uint8_t last; /* 0 if not, if 64 yes */
-} __attribute ((packed)) sup_ods_next_t;
-
-void conv_sup_ods_next (sup_ods_next_t *odsn)
-{
-	odsn->picture = SWAP16(odsn->picture);
-}
-
-static void write_image (FILE *fh, int timestamp, int dts, int picture, int w, int h, uint8_t *rle, int rle_len)
-{
-	sup_ods_first_t odsf;
-	sup_ods_next_t odsn = {picture, 0, 0};
-	int length = 0x80000000 | (rle_len + 4);
+	uint32_t length = 0x80000000 | (rle_len + 4);
+	uint8_t *p;
 	int size;
 
 	if (rle_len > 65508)
@@ -376,17 +402,15 @@ static void write_image (FILE *fh, int timestamp, int dts, int picture, int w, i
 	}
 	rle_len -= size;
 
-	write_header(fh, timestamp, dts, 21, sizeof(odsf) + size);
-
-	odsf.picture = picture;
-	odsf.m = 0;
-	odsf.magic_len = length;
-	odsf.width = w;
-	odsf.height = h;
+	write_header(sw, timestamp, dts, 21, 11 + size);
 
-	conv_sup_ods_first(&odsf);
-	fwrite(&odsf, sizeof(odsf), 1, fh);
-	fwrite(rle, size, 1, fh);
+	p = ds_grow(sw, 11);
+	PUT16(p, picture)
+	PUT8(p, 0)
+	PUT32(p, length) /* (single_packet ? 0xc0000000 : 0x80000000) | (length + 4) */
+	PUT16(p, w)
+	PUT16(p, h)
+	ds_data(sw, rle, size);
 	rle += size;
 
 	while (rle_len)
@@ -397,53 +421,96 @@ static void write_image (FILE *fh, int timestamp, int dts, int picture, int w, i
 			size = rle_len;
 		rle_len -= size;
 
-		if (!rle_len)
-			odsn.last = 64;
-
-		write_header(fh, timestamp, dts, 21, sizeof(odsn) + size);
-		conv_sup_ods_next(&odsn);
-		fwrite(&odsn, sizeof(odsn), 1, fh);
-		fwrite(rle, size, 1, fh);
+		write_header(sw, timestamp, dts, 21, 4 + size);
+		p = ds_grow(sw, 4);
+		PUT16(p, picture)
+		PUT8(p, 0)
+		PUT8(p, rle_len ? 0 : 64) /* Last fragment */
+		ds_data(sw, rle, size);
 		rle += size;
 	}
 }
 
-static void write_marker (FILE *fh, int time)
+static void write_marker (sup_writer_t *sw, int time)
 {
-	write_header(fh, time, 0, 0x80, 0);
+	write_header(sw, time, 0, 0x80, 0);
 }
 
-typedef struct sup_pcs_end_s
+static void write_pcs_end (sup_writer_t *sw, int end_time, int dts, int w, int h, int fps_id, int comp_num)
 {
-	uint16_t width;
-	uint16_t height;
-	uint8_t fps_id;
-	uint16_t comp_num;
-	uint32_t m;
-} __attribute ((packed)) sup_pcs_end_t;
+	uint8_t *p;
 
-void conv_sup_pcs_end (sup_pcs_end_t *pcse)
+	write_header(sw, end_time, dts, 22, 11);
+
+	p = ds_grow(sw, 11);
+	PUT16(p, w)
+	PUT16(p, h)
+	PUT8(p, fps_id)
+	PUT16(p, comp_num)
+	PUT32(p, 0)
+}
+
+static uint8_t *ds_index_grow (sup_writer_t *sw)
 {
-	pcse->width = SWAP16(pcse->width);
-	pcse->height = SWAP16(pcse->height);
-	pcse->comp_num = SWAP16(pcse->comp_num);
-	pcse->m = SWAP32(pcse->m);
+	uint8_t *p;
+
+	if (sw->index_len + SUP_INDEX_ENTRY_SIZE > sw->index_size)
+	{
+		sw->index_size *= 2;
+		sw->index = realloc(sw->index, sw->index_size);
+	}
+	p = sw->index + sw->index_len;
+	sw->index_len += SUP_INDEX_ENTRY_SIZE;
+
+	return p;
 }
 
-static void write_pcs_end (FILE *fh, int end_time, int dts, int w, int h, int fps_id, int comp_num)
+/* Index entry for the display set about to be built */
+static void add_index_entry (sup_writer_t *sw, uint32_t pts, uint32_t dts, int epoch_start, int comp_num)
 {
-	sup_pcs_end_t pcse;
+	uint64_t offset = sw->offset + ds_total(sw);
+	uint8_t *p;
 
-	write_header(fh, end_time, dts, 22, sizeof(pcse));
+	if (sw->index == NULL)
+		return;
+
+	p = ds_index_grow(sw);
+	PUT32(p, pts)
+	PUT32(p, dts)
+	PUT32(p, offset >> 32)
+	PUT32(p, offset)
+	PUT8(p, epoch_start ? SUP_INDEX_EPOCH_START : 0)
+	PUT8(p, 0)
+	PUT16(p, comp_num)
+}
 
-	pcse.width = w;
-	pcse.height = h;
-	pcse.fps_id = fps_id;
-	pcse.comp_num = comp_num;
-	pcse.m = 0;
+static int write_index (sup_writer_t *sw)
+{
+	FILE *fh;
+	uint8_t header[SUP_INDEX_HEADER_SIZE], *p = header;
+	int r = 0;
+
+	memcpy(p, SUP_INDEX_MAGIC, 4);
+	p += 4;
+	PUT32(p, SUP_INDEX_VERSION)
+	PUT32(p, sw->index_len / SUP_INDEX_ENTRY_SIZE)
+
+	if ((fh = fopen(sw->index_fn, "wb")) == NULL || fwrite(header, sizeof(header), 1, fh) != 1 || (sw->index_len && fwrite(sw->index, sw->index_len, 1, fh) != 1))
+		r = -1;
+	if (fh != NULL && fclose(fh))
+		r = -1;
+	if (r)
+		perror("Error writing SUP index file");
+
+	return r;
+}
 
-	conv_sup_pcs_end(&pcse);
-	fwrite(&pcse, sizeof(pcse), 1, fh);
+void enable_sup_index (sup_writer_t *sw, char *filename)
+{
+	sw->index_fn = strdup(filename);
+	sw->index_size = 1024 * SUP_INDEX_ENTRY_SIZE;
+	sw->index_len = 0;
+	sw->index = malloc(sw->index_size);
 }
 
 typedef struct fps_id_s
@@ -468,30 +535,66 @@ static int get_id (int fps_num, int fps_den)
 	return 16;
 }
 
-sup_writer_t *new_sup_writer (char *filename, int im_w, int im_h, int fps_num, int fps_den)
+static FILE *open_sup_file (char *filename, int update)
 {
-	sup_writer_t *sw = malloc(sizeof(sup_writer_t));
-
 #ifdef _WIN32
     wchar_t wfilename[512];
     MultiByteToWideChar(CP_UTF8, 0, filename, -1, wfilename, sizeof(wfilename) / sizeof(wchar_t));
-    if ((sw->fh = _wfopen(wfilename, L"wb")) == NULL)
+    return _wfopen(wfilename, update ? L"r+b" : L"wb");
 #else
-	if ((sw->fh = fopen(filename, "wb")) == NULL)
+	return fopen(filename, update ? "r+b" : "wb");
 #endif
+}
+
+sup_writer_t *new_sup_writer (char *filename, int im_w, int im_h, int fps_num, int fps_den)
+{
+	FILE *fh;
+	sink_t *sink;
+
+	if ((fh = open_sup_file(filename, 0)) == NULL || (sink = new_file_sink(fh, filename)) == NULL)
 	{
         perror("Error opening output SUP/PGS file");
-		exit(1);
+		return NULL;
 	}
 
+	return new_sup_writer_sink(sink, im_w, im_h, fps_num, fps_den);
+}
+
+sup_writer_t *reopen_sup_writer (char *filename, uint64_t offset, int im_w, int im_h, int fps_num, int fps_den)
+{
+	sup_writer_t *sw;
+	FILE *fh;
+	sink_t *sink;
+
+	if ((fh = open_sup_file(filename, 1)) == NULL || (sink = new_file_sink_at(fh, filename, offset)) == NULL)
+	{
+		perror("Error reopening output SUP/PGS file");
+		return NULL;
+	}
+
+	sw = new_sup_writer_sink(sink, im_w, im_h, fps_num, fps_den);
+	sw->offset = offset;
+	return sw;
+}
+
+sup_writer_t *new_sup_writer_sink (sink_t *sink, int im_w, int im_h, int fps_num, int fps_den)
+{
+	sup_writer_t *sw = malloc(sizeof(sup_writer_t));
+
+	sw->sink = sink;
+	sw->error = 0;
 	sw->non_new = 0;
 	sw->im_w = im_w;
 	sw->im_h = im_h;
 
 	if (im_h == 480 || im_h == 576)
 		sw->colorspace = 1;
+	else if (im_h > 1080)
+		sw->colorspace = 2;
 	else
 		sw->colorspace = 0;
+	sw->ycc = new_ycc_table(sw->colorspace);
+	sw->model = new_pgs_model(im_w, im_h, fps_num, fps_den);
 
 	sw->fps_num = fps_num;
 	sw->fps_den = fps_den;
@@ -499,15 +602,20 @@ sup_writer_t *new_sup_writer (char *filename, int im_w, int im_h, int fps_num, i
 	sw->comp_num = 0;
 	sw->end = -2;
 	sw->follower_end = -2;
-	sw->objects = 0;
-	sw->palettes = 0;
-	sw->buffer = 0;
 	sw->palette_offset = 0;
 	sw->picture_offset = 0;
 	sw->last_end_ts = 0;
 	sw->last_window_ts = 0;
 	sw->window_num = 0;
-	sw->sil = si_list_new();
+	sw->sil = si_vec_new();
+	sw->ds_size = 64 * 1024;
+	sw->ds_len = 0;
+	sw->ds = malloc(sw->ds_size);
+	sw->segs = sup_seg_vec_new();
+	sw->offset = 0;
+	sw->index = NULL;
+	sw->index_fn = NULL;
+	sw->stats = NULL;
 
 	memset(sw->windows, 0, 2 * sizeof(rect_t));
 
@@ -520,8 +628,6 @@ void destroy_si (subtitle_info_t *si)
 
 	for (i = 0; i < si->num_crop; i++)
 		free(si->rle[i]);
-
-	free(si);
 }
 
 void write_subtitle (sup_writer_t *sw, uint8_t **rle, int *rle_len, int num_crop, rect_t *crops, uint32_t *pal, int start, int end, int new_composition, int forced)
@@ -603,18 +709,19 @@ void write_subtitle (sup_writer_t *sw, uint8_t **rle, int *rle_len, int num_crop
 			}
 
 	/* Write PCSS */
-	write_pcs_start(sw->fh, start_ts, dts, follower, num_crop, sw->im_w, sw->im_h, sw->fps_id, sw->comp_num);
+	add_index_entry(sw, start_ts, dts, new_composition, sw->comp_num);
+	write_pcs_start(sw, start_ts, dts, follower, num_crop, sw->im_w, sw->im_h, sw->fps_id, sw->comp_num);
 	for (i = 0; i < num_crop; i++)
-		write_pcs_start_obj(sw->fh, sw->picture_offset + i, in_window[i], crops[i].x, crops[i].y, forced);
+		write_pcs_start_obj(sw, sw->picture_offset + i, in_window[i], crops[i].x, crops[i].y, forced);
 
 	/* Write WDS */
 	ts = start_ts - window_ts; /* Can be very slightly off, possible rounding error (FIXME: fixed?) */
-	write_wds(sw->fh, ts, dts, sw->window_num);
+	write_wds(sw, ts, dts, sw->window_num);
 	for (i = 0; i < sw->window_num; i++)
-		write_wds_obj(sw->fh, i, sw->windows[i].w, sw->windows[i].h, sw->windows[i].x, sw->windows[i].y);
+		write_wds_obj(sw, i, sw->windows[i].w, sw->windows[i].h, sw->windows[i].x, sw->windows[i].y);
 
 	/* Write palette */
-	write_palette(sw->fh, dts, sw->palette_offset, pal, sw->colorspace);
+	write_palette(sw, dts, sw->palette_offset, pal);
 
 	/* Write image data */
 	for (i = 0; i < num_crop; i++)
@@ -646,11 +753,12 @@ void write_subtitle (sup_writer_t *sw, uint8_t **rle, int *rle_len, int num_crop
 				dts = start_ts - later_window - decode_ts_list[1];
 			}
 		}
-		write_image(sw->fh, im_ts, dts, sw->picture_offset + i, crops[i].w, crops[i].h, rle[i], rle_len[i]);
+		write_image(sw, im_ts, dts, sw->picture_offset + i, crops[i].w, crops[i].h, rle[i], rle_len[i]);
 	}
 
 	/* Write marker */
-	write_marker(sw->fh, im_ts);
+	write_marker(sw, im_ts);
+	ds_flush(sw);
 
 	/* Remember data for creation of composition end */
 	sw->last_end_ts = end_ts;
@@ -666,29 +774,24 @@ void write_composition (sup_writer_t *sw)
 	int new_composition = 1;
 	int si_rects = 0;
 	int ts, dts;
-	int i;
+	int i, n;
 
 	/* Only write anything if there is a non-empty composition */
 	if (!sw->non_new)
 		return;
 
 	/* Count subtitles */
-	si = si_list_first(sw->sil);
-	while (si != NULL)
-	{
-		si_rects += si->num_crop;
-		si = si_list_next(sw->sil);
-	}
+	for (n = sw->sil->head; n < sw->sil->tail; n++)
+		si_rects += si_vec_get(sw->sil, n)->num_crop;
 
 	/* Gather crop rects. */
 	rects = malloc(si_rects * sizeof(rect_t));
-	si = si_list_first(sw->sil);
 	si_rects = 0;
-	while (si != NULL)
+	for (n = sw->sil->head; n < sw->sil->tail; n++)
 	{
+		si = si_vec_get(sw->sil, n);
 		for (i = 0; i < si->num_crop; i++)
 			rects[si_rects++] = si->crops[i];
-		si = si_list_next(sw->sil);
 	}
 
 	/* Calculate windows */
@@ -701,9 +804,9 @@ void write_composition (sup_writer_t *sw)
 	}
 
 	/* Write subtitles */
-	si = si_list_first(sw->sil);
-	while (si != NULL)
+	for (n = sw->sil->head; n < sw->sil->tail; n++)
 	{
+		si = si_vec_get(sw->sil, n);
 		if (!new_composition && (last_num_crop != si->num_crop || memcmp(last_crops, si->crops, MIN(last_num_crop, si->num_crop) * sizeof(rect_t))))
 		{
 			(sw->comp_num)++;
@@ -714,23 +817,24 @@ void write_composition (sup_writer_t *sw)
 		memcpy(last_crops, si->crops, si->num_crop * sizeof(rect_t));
 		write_subtitle(sw, si->rle, si->rle_len, si->num_crop, si->crops, si->pal, si->start, si->end, new_composition, si->forced);
 		new_composition = 0;
-		si_list_delete(sw->sil);
 		destroy_si(si);
-		si = si_list_get(sw->sil);
 	}
+	si_vec_clear(sw->sil);
 
 	/* Write PCSE */
 	dts = sw->last_end_ts - sw->last_window_ts - 1;
-	write_pcs_end(sw->fh, sw->last_end_ts, dts, sw->im_w, sw->im_h, sw->fps_id, ++(sw->comp_num));
+	add_index_entry(sw, sw->last_end_ts, dts, 0, sw->comp_num + 1);
+	write_pcs_end(sw, sw->last_end_ts, dts, sw->im_w, sw->im_h, sw->fps_id, ++(sw->comp_num));
 
 	/* Write WDS */
 	ts = sw->last_end_ts - sw->last_window_ts;
-	write_wds(sw->fh, ts, dts, sw->window_num);
+	write_wds(sw, ts, dts, sw->window_num);
 	for (i = 0; i < sw->window_num; i++)
-		write_wds_obj(sw->fh, i, sw->windows[i].w, sw->windows[i].h, sw->windows[i].x, sw->windows[i].y);
+		write_wds_obj(sw, i, sw->windows[i].w, sw->windows[i].h, sw->windows[i].x, sw->windows[i].y);
 
 	/* Write marker */
-	write_marker(sw->fh, dts);
+	write_marker(sw, dts);
+	ds_flush(sw);
 
 	/* Cleanup */
 	free(rects);
@@ -739,16 +843,19 @@ void write_composition (sup_writer_t *sw)
 	(sw->comp_num)++;
 
 	/* Reset picture and palette count, new buffer. */
-	sw->objects = 0;
-	sw->palettes = 0;
 	sw->palette_offset = 0;
 	sw->picture_offset = 0;
-	sw->buffer = 0;
+	pgs_model_end_epoch(sw->model);
+	if (sw->stats != NULL)
+		sw->stats->epochs++;
 }
 
-subtitle_info_t *collect_si (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t *crops, uint32_t *pal, int start, int end, int forced)
+/* Append the RLE encoded event to the subtitles of the current epoch. The
+ * RLE buffers are taken over.
+ */
+static subtitle_info_t *collect_si (sup_writer_t *sw, int num_crop, rect_t *crops, uint8_t **rle, int *rle_len, uint32_t *pal, int start, int end, int forced)
 {
-	subtitle_info_t *si = malloc(sizeof(subtitle_info_t));
+	subtitle_info_t *si = si_vec_append(sw->sil);
 	int i;
 
 	si->start = start;
@@ -760,7 +867,10 @@ subtitle_info_t *collect_si (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t
 		si->crops[i].h = crops[i].h;
 		si->crops[i].x = crops[i].x;
 		si->crops[i].y = crops[i].y;
-		si->rle[i] = rl_encode(im, sw->im_w, sw->im_h, si->crops[i], &(si->rle_len[i]));
+		si->rle[i] = rle[i];
+		si->rle_len[i] = rle_len[i];
+		if (sw->stats != NULL)
+			sw->stats->ods_bytes += si->rle_len[i];
 	}
 	memcpy(si->pal, pal, 256 * sizeof(uint32_t));
     si->forced = forced;
@@ -768,57 +878,155 @@ subtitle_info_t *collect_si (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t
 	return si;
 }
 
-void close_sup_writer (sup_writer_t *sw)
+static void free_sup_writer (sup_writer_t *sw)
+{
+	while (!si_vec_empty(sw->sil))
+	{
+		destroy_si(si_vec_first(sw->sil));
+		si_vec_shift(sw->sil, NULL);
+	}
+	si_vec_destroy(sw->sil);
+	sup_seg_vec_destroy(sw->segs);
+	free(sw->ds);
+	free(sw->ycc);
+	close_pgs_model(sw->model);
+	free(sw->index);
+	free(sw->index_fn);
+	free(sw);
+}
+
+int close_sup_writer (sup_writer_t *sw)
 {
+	double t = stats_now(sw->stats);
+	int r = 0;
+
 	write_composition(sw);
 
-	si_list_first(sw->sil);
-	while(!si_list_empty(sw->sil))
+	if (close_sink(sw->sink))
+		ds_error(sw);
+	if (sw->error)
+		r = -1;
+	else if (sw->index != NULL && write_index(sw))
+		r = -1;
+	stats_lap(sw->stats, STAGE_SUP, t);
+
+	free_sup_writer(sw);
+	return r;
+}
+
+int sup_writer_checkpoint (sup_writer_t *sw, sup_state_t *st)
+{
+	int64_t offset;
+
+	/* Without anything collected since, the next event starts a new
+	 * epoch, just like after a gap
+	 */
+	write_composition(sw);
+	sw->non_new = 0;
+
+	if (sw->error || (offset = sink_sync(sw->sink)) < 0 || (uint64_t)offset != sw->offset)
+		return -1;
+
+	st->offset = sw->offset;
+	st->comp_num = sw->comp_num;
+	st->end = sw->end;
+	st->follower_end = sw->follower_end;
+	st->epochs = sw->model->epochs;
+	st->epoch_end_ts = sw->model->end_ts;
+	st->index_len = sw->index != NULL ? sw->index_len : 0;
+	st->index = sw->index;
+
+	return 0;
+}
+
+void restore_sup_writer (sup_writer_t *sw, sup_state_t *st)
+{
+	sw->comp_num = st->comp_num;
+	sw->end = st->end;
+	sw->follower_end = st->follower_end;
+	sw->model->epochs = st->epochs;
+	sw->model->end_ts = st->epoch_end_ts;
+	if (sw->index != NULL && st->index_len)
 	{
-		destroy_si(si_list_first(sw->sil));
-		si_list_delete(sw->sil);
+		while (sw->index_size < st->index_len)
+			sw->index_size *= 2;
+		sw->index = realloc(sw->index, sw->index_size);
+		memcpy(sw->index, st->index, st->index_len);
+		sw->index_len = st->index_len;
 	}
-	si_list_destroy(sw->sil);
+}
 
-	fclose(sw->fh);
-	free(sw);
+void discard_sup_writer (sup_writer_t *sw)
+{
+	discard_sink(sw->sink);
+	free_sup_writer(sw);
 }
 
-IMPLEMENT_LIST(si, subtitle_info_t)
+IMPLEMENT_VECTOR(si, subtitle_info_t)
 
-void write_sup (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t *crops, uint32_t *pal, int start, int end, int strict, int forced)
+/* Let's order them, so the one closer to 0/0 is the second. RLE data, if
+ * given, is swapped along.
+ */
+static void order_crops (int num_crop, rect_t *crops, uint8_t **rle, int *rle_len)
 {
 	rect_t tmp;
+	uint8_t *tmp_rle;
+	int tmp_len;
+
+	if (num_crop > 1 && (crops[0].y < crops[1].y || (crops[0].y == crops[1].y && crops[0].x < crops[1].x)))
+	{
+		tmp = crops[0];
+		crops[0] = crops[1];
+		crops[1] = tmp;
+		if (rle != NULL)
+		{
+			tmp_rle = rle[0];
+			rle[0] = rle[1];
+			rle[1] = tmp_rle;
+			tmp_len = rle_len[0];
+			rle_len[0] = rle_len[1];
+			rle_len[1] = tmp_len;
+		}
+	}
+}
+
+static void add_sup (sup_writer_t *sw, int num_crop, rect_t *crops, uint8_t **rle, int *rle_len, uint32_t *pal, int start, int end, int strict, int forced)
+{
+	subtitle_info_t *si;
+	pgs_usage_t *use = &(sw->model->use);
+	double t = stats_now(sw->stats);
 	int buffer_increase;
 	int i;
 
 	buffer_increase = 0;
 	for (i = 0; i < num_crop; i++)
 		buffer_increase += crops[i].w * crops[i].h + 16;
-	/* Disabled some conditions for now. */
-	if (sw->non_new && ((start > sw->end + 1) || (sw->objects + num_crop > 64) || (strict && ((sw->buffer + buffer_increase >= 4 * 1024 * 1024) || (sw->palettes + 1 > 8)))))
+	/* Start a new epoch after a gap, or when the decoder model runs out of
+	 * object buffer, object ids or palettes.
+	 */
+	if (sw->non_new && ((start > sw->end + 1) || !pgs_model_fits(sw->model, num_crop, crops, strict)))
 	{
 #		if DEBUG != 0
 #		warning "DEBUG enabled."
 			printf("Starting new composition ");
-			if (start > sw->end)
+			if (start > sw->end + 1)
 				printf("due to time difference. %u > %u + 1\n", start, sw->end);
-			else if (sw->buffer + buffer_increase >= 4 * 1024 * 1024)
-				printf("due to buffer overflow. %u + %u = %u > %u\n", sw->buffer, buffer_increase, sw->buffer + buffer_increase, 4*1024*1024);
-			else if (sw->objects + num_crop > 64)
-				printf("due to number of composition objects. %u + %u = %u > %u\n", sw->objects, num_crop, sw->picture + num_crop, 64);
-			else if (sw->palette + 1 > 8)
-				printf("due to number of palettes. %u + %u = %u > %u\n", sw->palette, 1, sw->palette + 1, 8);
+			else if (use->db + buffer_increase >= PGS_DB_SIZE)
+				printf("due to buffer overflow. %u + %u = %u > %u\n", use->db, buffer_increase, use->db + buffer_increase, PGS_DB_SIZE);
+			else if (use->objects + num_crop > PGS_MAX_OBJECTS)
+				printf("due to number of composition objects. %u + %u = %u > %u\n", use->objects, num_crop, use->objects + num_crop, PGS_MAX_OBJECTS);
+			else if (use->palettes + 1 > PGS_MAX_PALETTES)
+				printf("due to number of palettes. %u + %u = %u > %u\n", use->palettes, 1, use->palettes + 1, PGS_MAX_PALETTES);
 			else
 				printf("for unknown reasons.\n");
 #		else
-		if (strict)
+		if (strict && start <= sw->end + 1)
 		{
-			if (sw->buffer + buffer_increase >= 4 * 1024 * 1024)
+			if (use->db + buffer_increase >= PGS_DB_SIZE)
 			{
-				printf("Warning: Starting new epoch due to buffer overflow (%u -> %u > %u) for event starting at frame %u (including offsets) in stricter mode.\n", sw->buffer, sw->buffer + buffer_increase, 4 * 1024 * 1024, start);
+				printf("Warning: Starting new epoch due to buffer overflow (%u -> %u > %u) for event starting at frame %u (including offsets) in stricter mode.\n", use->db, use->db + buffer_increase, PGS_DB_SIZE, start);
 			}
-			else if (sw->palettes + 1 > 8)
+			else if (use->palettes + 1 > PGS_MAX_PALETTES)
 			{
 				printf("Warning: Starting new epoch due to too many palettes for event starting at frame %u (including offsets) in stricter mode.\n", start);
 			}
@@ -828,21 +1036,38 @@ void write_sup (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t *crops, uint
 	}
 	sw->non_new = 1;
 	sw->end = end;
-	sw->buffer += buffer_increase;
-	sw->objects += num_crop;
-	(sw->palettes)++; /* FIXME: It's probably okay not to increase this if the palette is identical to the last, but this would require further testing and possibly additional code so identical palettes are not written to the stream multiple times? */
+	stats_lap(sw->stats, STAGE_SUP, t);
+
+	si = collect_si(sw, num_crop, crops, rle, rle_len, pal, start, end, forced);
+	pgs_model_add(sw->model, num_crop, si->crops, si->rle_len, start, end, strict);
+}
+
+void write_sup (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t *crops, uint32_t *pal, int start, int end, int strict, int forced)
+{
+	uint8_t *rle[2];
+	int rle_len[2];
+	double t = stats_now(sw->stats);
+	int i;
+
+	order_crops(num_crop, crops, NULL, NULL);
+	for (i = 0; i < num_crop; i++)
+		rle[i] = rl_encode(im, sw->im_w, sw->im_h, crops[i], &(rle_len[i]));
+	stats_lap(sw->stats, STAGE_RLE, t);
 
-	if (num_crop > 1)
+	add_sup(sw, num_crop, crops, rle, rle_len, pal, start, end, strict, forced);
+}
+
+void write_sup_rle (sup_writer_t *sw, int num_crop, rect_t *crops, uint8_t **rle, int *rle_len, uint32_t *pal, int start, int end, int strict, int forced)
+{
+	uint8_t *copy[2];
+	int i;
+
+	order_crops(num_crop, crops, rle, rle_len);
+	for (i = 0; i < num_crop; i++)
 	{
-		/* Let's order them, so the one closer to 0/0 is the second. */
-		if (crops[0].y < crops[1].y || (crops[0].y == crops[1].y && crops[0].x < crops[1].x))
-		{
-			tmp = crops[0];
-			crops[0] = crops[1];
-			crops[1] = tmp;
-		}
+		copy[i] = malloc(rle_len[i]);
+		memcpy(copy[i], rle[i], rle_len[i]);
 	}
 
-	si_list_insert_after(sw->sil, collect_si(sw, im, num_crop, crops, pal, start, end, forced));
+	add_sup(sw, num_crop, crops, copy, rle_len, pal, start, end, strict, forced);
 }
-
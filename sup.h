@@ -20,7 +20,9 @@
 #define SUP_H
 
 #include "auto_split.h"
-#include "abstract_lists.h"
+#include "abstract_vectors.h"
+#include "pgs_model.h"
+#include "sink.h"
 
 typedef struct subtitle_info_s
 {
@@ -34,41 +36,103 @@ typedef struct subtitle_info_s
     int forced;
 } subtitle_info_t;
 
-DECLARE_LIST(si, subtitle_info_t)
+DECLARE_VECTOR(si, subtitle_info_t)
+
+struct sup_seg_vec_s;
+typedef struct ycc_table_s ycc_table_t;
 
 typedef struct sup_writer_s
 {
-	FILE *fh;
+	sink_t *sink;
+	int error;      /* Set once writing failed, nothing is written after */
 	int non_new;
 	int im_w;
 	int im_h;
-	int colorspace;
+	int colorspace; /* 0 = BT.709, 1 = BT.601 (SD), 2 = BT.2020 (UHD) */
+	ycc_table_t *ycc;
 	int fps_num;
 	int fps_den;
 	int fps_id;
 	uint16_t comp_num;
 	unsigned int end;
 	unsigned int follower_end;
-	int buffer;
-	int objects;
-	int palettes;
 	int palette_offset;
 	int picture_offset;
 	int last_end_ts;
 	int last_window_ts;
 	int window_num;
 	rect_t windows[2];
-	si_list_t *sil;
+	si_vec_t *sil;
+	uint8_t *ds;   /* Display set being built */
+	int ds_len;
+	int ds_size;
+	struct sup_seg_vec_s *segs;
+	pgs_model_t *model;
+	uint64_t offset;  /* Bytes written to fh */
+	uint8_t *index;   /* Seek index entries, NULL if disabled */
+	int index_len;
+	int index_size;
+	char *index_fn;
+	struct stats_s *stats;  /* Timing and counters, or NULL */
 } sup_writer_t;
 
-/* Create a new sup writer state */
+/* Create a new sup writer state. Returns NULL if the file cannot be
+ * created.
+ */
 sup_writer_t *new_sup_writer (char *filename, int im_w, int im_h, int fps_num, int fps_den);
 
+/* Same for output to a sink, which is closed with the writer */
+sup_writer_t *new_sup_writer_sink (sink_t *sink, int im_w, int im_h, int fps_num, int fps_den);
+
 /* Write sup data for subtitle */
 void write_sup (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t *crops, uint32_t *pal, int start, int end, int strict, int forced);
 
-/* Call this once at the end */
-void close_sup_writer (sup_writer_t *sw);
+/* Same for crops already RLE encoded. The RLE data is copied. */
+void write_sup_rle (sup_writer_t *sw, int num_crop, rect_t *crops, uint8_t **rle, int *rle_len, uint32_t *pal, int start, int end, int strict, int forced);
+
+/* RLE encode crop of the 8bpp image im into a malloced buffer of *len bytes */
+uint8_t *rl_encode (uint8_t *im, int w, int h, rect_t crop, int *len);
+
+/* Write a seek index (see sup_index.h) to filename when closing */
+void enable_sup_index (sup_writer_t *sw, char *filename);
+
+/* What a SUP writer needs to continue its file after an epoch */
+typedef struct sup_state_s
+{
+	uint64_t offset;   /* Bytes of finished epochs */
+	int comp_num;
+	int end;
+	int follower_end;
+	int epochs;
+	int epoch_end_ts;
+	int index_len;     /* Seek index entries so far */
+	uint8_t *index;
+} sup_state_t;
+
+/* Finish the epoch being collected and describe the writer in st, with
+ * st->index pointing into the writer. Only call this when the next event
+ * would start a new epoch anyway, or the output changes. Returns -1 if the
+ * SUP file could not be written.
+ */
+int sup_writer_checkpoint (sup_writer_t *sw, sup_state_t *st);
+
+/* Continue a SUP file written up to offset, cutting off anything after it.
+ * Returns NULL if the file cannot be opened.
+ */
+sup_writer_t *reopen_sup_writer (char *filename, uint64_t offset, int im_w, int im_h, int fps_num, int fps_den);
+
+/* Take over the state saved by sup_writer_checkpoint. Call after
+ * enable_sup_index, if the index is written.
+ */
+void restore_sup_writer (sup_writer_t *sw, sup_state_t *st);
+
+/* Call this once at the end. Returns -1 if the SUP file or its index could
+ * not be written completely.
+ */
+int close_sup_writer (sup_writer_t *sw);
+
+/* Close and discard the SUP output without finishing it */
+void discard_sup_writer (sup_writer_t *sw);
 
 #endif
 
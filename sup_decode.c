@@ -0,0 +1,389 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "sup_decode.h"
+#include "auto_split.h"
+#include "abstract_vectors.h"
+
+#define CLAMP(x,min,max) (MAX(MIN(x,max),min))
+
+/* Objects of the current epoch. Objects sent in a single ODS point into the
+ * mapped file, fragmented ones are put back together in buf.
+ */
+typedef struct sup_object_s
+{
+	int id;
+	int w;
+	int h;
+	const uint8_t *rle;
+	int rle_len;
+	uint8_t *buf;
+	int buf_size;
+} sup_object_t;
+
+STATIC_VECTOR(sup_obj, sup_object_t)
+
+static int pts_to_frame (sup_decoder_t *d, uint32_t pts)
+{
+	return (int)floor((double)pts / d->tick_fac + 0.5);
+}
+
+/* Find the PCS starting the next display set */
+static void peek_pcs (sup_decoder_t *d)
+{
+	int ret;
+
+	while ((ret = sup_reader_next(d->r, &(d->next))) == 1)
+		if (d->next.type == SUP_PCS)
+		{
+			d->next_frame = pts_to_frame(d, d->next.pts);
+			return;
+		}
+
+	if (ret < 0)
+		fprintf(stderr, "Warning: Stopped decoding SUP at %08x: %s\n", (unsigned int)d->r->pos, d->r->error);
+	d->next_frame = INT_MAX;
+}
+
+sup_decoder_t *open_sup_decoder (char *filename, int fps_num, int fps_den)
+{
+	sup_decoder_t *d;
+	sup_reader_t *r;
+	sup_segment_t s;
+	uint32_t last_pts = 0;
+	int ret;
+
+	if ((r = open_sup_reader(filename)) == NULL)
+		return NULL;
+
+	d = calloc(1, sizeof(sup_decoder_t));
+	d->r = r;
+	d->tick_fac = 90000.0 * ((double)fps_den) / ((double)fps_num);
+
+	/* Only the segment headers are touched here */
+	while ((ret = sup_reader_next(r, &s)) == 1)
+		if (s.type == SUP_PCS)
+		{
+			if (!d->display_sets)
+			{
+				d->im_w = seg_u16(&s, 0);
+				d->im_h = seg_u16(&s, 2);
+			}
+			d->display_sets++;
+			last_pts = s.pts;
+		}
+	if (ret < 0)
+		fprintf(stderr, "Warning: SUP file is broken at %08x: %s\n", (unsigned int)r->pos, r->error);
+	if (!d->display_sets)
+	{
+		fprintf(stderr, "No display sets found in SUP file (%s).\n", filename);
+		close_sup_decoder(d);
+		return NULL;
+	}
+
+	if (d->im_h == 480 || d->im_h == 576)
+		d->colorspace = 1;
+	else if (d->im_h > 1080)
+		d->colorspace = 2;
+	else
+		d->colorspace = 0;
+	d->frames = pts_to_frame(d, last_pts) + 1;
+	d->objects = sup_obj_vec_new();
+
+	sup_reader_seek(r, 0);
+	peek_pcs(d);
+
+	return d;
+}
+
+static void reset_epoch (sup_decoder_t *d)
+{
+	sup_object_t *o;
+	int i;
+
+	for (i = d->objects->head; i < d->objects->tail; i++)
+	{
+		o = sup_obj_vec_get(d->objects, i);
+		free(o->buf);
+	}
+	sup_obj_vec_clear(d->objects);
+	memset(d->pal, 0, sizeof(d->pal));
+}
+
+/* Inverse of the palette conversion in sup.c, limited range */
+static void decode_palette (sup_decoder_t *d, sup_segment_t *s)
+{
+	double kr, kb, cr_div, cb_div, y, cr, cb, r, g, b;
+	uint32_t *pal = d->pal[seg_u8(s, 0)];
+	uint8_t *c;
+	int o;
+
+	switch (d->colorspace)
+	{
+		case 1:
+			kr = 0.299; kb = 0.114;
+			cr_div = 1.402; cb_div = 1.772;
+			break;
+		case 2:
+			kr = 0.2627; kb = 0.0593;
+			cr_div = 1.4746; cb_div = 1.8814;
+			break;
+		default:
+			kr = 0.2126; kb = 0.0722;
+			cr_div = 1.5748; cb_div = 1.8556;
+			break;
+	}
+
+	for (o = 2; o + 5 <= s->len; o += 5)
+	{
+		c = (uint8_t *)&(pal[seg_u8(s, o)]);
+		if (!seg_u8(s, o + 4))
+		{
+			memset(c, 0, 4);
+			continue;
+		}
+		y = (seg_u8(s, o + 1) - 16) * 255.0 / 219.0;
+		cr = (seg_u8(s, o + 2) - 128) * 255.0 / 224.0;
+		cb = (seg_u8(s, o + 3) - 128) * 255.0 / 224.0;
+		r = y + cr_div * cr;
+		b = y + cb_div * cb;
+		g = (y - kr * r - kb * b) / (1.0 - kr - kb);
+		c[0] = (uint8_t)CLAMP((int)floor(b + 0.5), 0, 255);
+		c[1] = (uint8_t)CLAMP((int)floor(g + 0.5), 0, 255);
+		c[2] = (uint8_t)CLAMP((int)floor(r + 0.5), 0, 255);
+		c[3] = seg_u8(s, o + 4);
+	}
+}
+
+static sup_object_t *get_object (sup_decoder_t *d, int id)
+{
+	sup_object_t *o;
+	int i;
+
+	for (i = d->objects->head; i < d->objects->tail; i++)
+	{
+		o = sup_obj_vec_get(d->objects, i);
+		if (o->id == id)
+			return o;
+	}
+
+	return NULL;
+}
+
+static void decode_object (sup_decoder_t *d, sup_segment_t *s)
+{
+	sup_object_t *o;
+	const uint8_t *data;
+	int id = seg_u16(s, 0), seq = seg_u8(s, 3), len;
+
+	if ((o = get_object(d, id)) == NULL)
+	{
+		o = sup_obj_vec_append(d->objects);
+		o->id = id;
+	}
+
+	if (seq & 0x80)
+	{
+		if (s->len < 11)
+			return;
+		o->w = seg_u16(s, 7);
+		o->h = seg_u16(s, 9);
+		o->rle_len = 0;
+		data = s->data + 11;
+		len = s->len - 11;
+
+		/* Single fragment, no copy needed */
+		if (seq & 0x40)
+		{
+			o->rle = data;
+			o->rle_len = len;
+			return;
+		}
+	}
+	else
+	{
+		if (s->len < 4)
+			return;
+		data = s->data + 4;
+		len = s->len - 4;
+	}
+
+	if (o->rle_len + len > o->buf_size)
+	{
+		o->buf_size = MAX(2 * o->buf_size, o->rle_len + len);
+		if ((o->buf = realloc(o->buf, o->buf_size)) == NULL)
+		{
+			fprintf(stderr, "Cannot allocate %d bytes for object %d.\n", o->buf_size, id);
+			exit(1);
+		}
+	}
+	memcpy(o->buf + o->rle_len, data, len);
+	o->rle = o->buf;
+	o->rle_len += len;
+}
+
+/* Take over the composition of the next display set and decode its
+ * palettes and objects.
+ */
+static void decode_display_set (sup_decoder_t *d)
+{
+	sup_segment_t pcs = d->next, s;
+	sup_comp_obj_t *c;
+	int n, o, i, flags, ret;
+
+	if (seg_u8(&pcs, 7) & 0x80)
+		reset_epoch(d);
+
+	n = seg_u8(&pcs, 10);
+	d->num_comp = 0;
+	d->forced = 0;
+	d->palette_id = seg_u8(&pcs, 9);
+	for (i = 0, o = 11; i < n && o + 8 <= pcs.len; i++)
+	{
+		c = &(d->comp[MIN(d->num_comp, SUP_DECODE_MAX_COMP - 1)]);
+		flags = seg_u8(&pcs, o + 3);
+		c->id = seg_u16(&pcs, o);
+		c->forced = (flags & 0x40) != 0;
+		c->cropped = (flags & 0x80) != 0;
+		c->x = seg_u16(&pcs, o + 4);
+		c->y = seg_u16(&pcs, o + 6);
+		o += 8;
+		if (c->cropped)
+		{
+			c->crop_x = seg_u16(&pcs, o);
+			c->crop_y = seg_u16(&pcs, o + 2);
+			c->crop_w = seg_u16(&pcs, o + 4);
+			c->crop_h = seg_u16(&pcs, o + 6);
+			o += 8;
+		}
+		d->forced |= c->forced;
+		if (d->num_comp < SUP_DECODE_MAX_COMP)
+			d->num_comp++;
+	}
+	d->decoded++;
+
+	while ((ret = sup_reader_next(d->r, &s)) == 1)
+	{
+		switch (s.type)
+		{
+			case SUP_PDS:
+				decode_palette(d, &s);
+				break;
+			case SUP_ODS:
+				decode_object(d, &s);
+				break;
+			case SUP_PCS:
+				/* Missing END segment */
+				d->next = s;
+				d->next_frame = pts_to_frame(d, s.pts);
+				return;
+			case SUP_END:
+				peek_pcs(d);
+				return;
+		}
+	}
+
+	if (ret < 0)
+		fprintf(stderr, "Warning: Stopped decoding SUP at %08x: %s\n", (unsigned int)d->r->pos, d->r->error);
+	d->next_frame = INT_MAX;
+}
+
+/* Draw one composition object, clipped to its cropping rectangle and the
+ * video frame. The top left of the cropping rectangle is shown at the
+ * position of the composition object.
+ */
+static void render_object (sup_decoder_t *d, uint32_t *im, sup_comp_obj_t *c, sup_object_t *o)
+{
+	uint32_t *pal = d->pal[d->palette_id];
+	const uint8_t *p = o->rle, *end = o->rle + o->rle_len;
+	int x0 = 0, y0 = 0, x1 = o->w, y1 = o->h;
+	int x = 0, y = 0, run, col, b;
+
+	if (c->cropped)
+	{
+		x0 = c->crop_x;
+		y0 = c->crop_y;
+		x1 = MIN(x1, c->crop_x + c->crop_w);
+		y1 = MIN(y1, c->crop_y + c->crop_h);
+	}
+	/* Positions are unsigned, so only the right and bottom edge clip */
+	x1 = MIN(x1, d->im_w - c->x + x0);
+	y1 = MIN(y1, d->im_h - c->y + y0);
+
+	while (p < end && y < y1)
+	{
+		if ((col = *(p++)))
+			run = 1;
+		else
+		{
+			if (p >= end)
+				break;
+			b = *(p++);
+			if (!b)
+			{
+				/* End of line */
+				x = 0;
+				y++;
+				continue;
+			}
+			run = b & 0x3f;
+			if ((b & 0x40) && p < end)
+				run = (run << 8) | *(p++);
+			if ((b & 0x80) && p < end)
+				col = *(p++);
+		}
+
+		if (y >= y0 && pal[col])
+			for (b = MAX(x, x0); b < MIN(x + run, x1); b++)
+				im[(c->y + y - y0) * d->im_w + c->x + b - x0] = pal[col];
+		x += run;
+	}
+}
+
+int sup_decode_frame (sup_decoder_t *d, uint8_t *im, int frame)
+{
+	sup_object_t *o;
+	int i;
+
+	while (d->next_frame <= frame)
+		decode_display_set(d);
+
+	memset(im, 0, d->im_w * d->im_h * 4);
+	for (i = 0; i < d->num_comp; i++)
+		if ((o = get_object(d, d->comp[i].id)) != NULL && o->rle_len)
+			render_object(d, (uint32_t *)im, &(d->comp[i]), o);
+
+	return d->next_frame;
+}
+
+void close_sup_decoder (sup_decoder_t *d)
+{
+	if (d->objects != NULL)
+	{
+		reset_epoch(d);
+		sup_obj_vec_destroy(d->objects);
+	}
+	close_sup_reader(d->r);
+	free(d);
+}
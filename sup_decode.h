@@ -0,0 +1,80 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef SUP_DECODE_H
+#define SUP_DECODE_H
+
+#include <stdint.h>
+#include "sup_reader.h"
+
+/* Composition objects of a PCS */
+#define SUP_DECODE_MAX_COMP 8
+
+typedef struct sup_comp_obj_s
+{
+	int id;
+	int x;
+	int y;
+	int forced;
+	int cropped;
+	int crop_x;      /* Relative to the object */
+	int crop_y;
+	int crop_w;
+	int crop_h;
+} sup_comp_obj_t;
+
+struct sup_obj_vec_s;
+
+/* Decodes SUP files back into frames, for use in place of an AviSynth clip.
+ * Display sets are only decoded when the frame they start on is requested,
+ * and frames in between are never rendered.
+ */
+typedef struct sup_decoder_s
+{
+	sup_reader_t *r;
+	int im_w;
+	int im_h;
+	int colorspace;     /* Same choice as new_sup_writer */
+	double tick_fac;
+	int frames;         /* One past the frame of the last display set */
+	int display_sets;   /* Display sets in the file */
+	int decoded;        /* Display sets decoded so far */
+	sup_segment_t next; /* PCS of the next display set */
+	int next_frame;     /* INT_MAX at the end of the file */
+	int num_comp;       /* Composition currently shown */
+	sup_comp_obj_t comp[SUP_DECODE_MAX_COMP];
+	int palette_id;
+	int forced;         /* Any object of the composition is forced */
+	struct sup_obj_vec_s *objects;
+	uint32_t pal[256][256]; /* Palettes as B, G, R, A bytes */
+} sup_decoder_t;
+
+/* Scan a SUP file for its size and number of display sets. Returns NULL
+ * and prints the reason on failure.
+ */
+sup_decoder_t *open_sup_decoder (char *filename, int fps_num, int fps_den);
+
+/* Render the picture shown at frame into im, as B, G, R, A bytes like
+ * AviSynth RGB32 frames. Frames must be requested in increasing order.
+ * Returns the next frame on which the picture may change, or INT_MAX.
+ */
+int sup_decode_frame (sup_decoder_t *d, uint8_t *im, int frame);
+
+void close_sup_decoder (sup_decoder_t *d);
+
+#endif
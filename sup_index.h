@@ -0,0 +1,39 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef SUP_INDEX_H
+#define SUP_INDEX_H
+
+/* Seek index for SUP files, written by the SUP writer next to FILE.sup as
+ * FILE.sup.idx. All numbers are big-endian.
+ *
+ * Header (12 bytes):
+ *   "PGSI", uint32 version, uint32 number of entries
+ * Entry (20 bytes), one per display set, ordered by offset and PTS:
+ *   uint32 pts, uint32 dts, uint64 file offset, uint8 flags, uint8 0,
+ *   uint16 composition number
+ */
+#define SUP_INDEX_MAGIC "PGSI"
+#define SUP_INDEX_VERSION 1
+#define SUP_INDEX_HEADER_SIZE 12
+#define SUP_INDEX_ENTRY_SIZE 20
+
+/* Entry flags */
+#define SUP_INDEX_EPOCH_START 0x01
+
+#endif
@@ -0,0 +1,210 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "sup_reader.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+static int map_file (sup_reader_t *r, const char *filename)
+{
+	HANDLE file, mapping;
+	LARGE_INTEGER size;
+
+	file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return 0;
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return 0;
+	}
+	r->size = size.QuadPart;
+	r->map = NULL;
+	r->handle = NULL;
+	if (r->size)
+	{
+		mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL)
+		{
+			CloseHandle(file);
+			return 0;
+		}
+		r->map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+
+	return !r->size || r->map != NULL;
+}
+
+static void unmap_file (sup_reader_t *r)
+{
+	if (r->map != NULL)
+		UnmapViewOfFile(r->map);
+}
+#else
+static int map_file (sup_reader_t *r, const char *filename)
+{
+	struct stat st;
+	int fd;
+
+	if ((fd = open(filename, O_RDONLY)) < 0)
+		return 0;
+	if (fstat(fd, &st))
+	{
+		close(fd);
+		return 0;
+	}
+	r->size = st.st_size;
+	r->map = NULL;
+	if (r->size)
+	{
+		r->map = mmap(NULL, r->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (r->map == MAP_FAILED)
+		{
+			r->map = NULL;
+			close(fd);
+			return 0;
+		}
+#ifdef MADV_SEQUENTIAL
+		madvise((void *)r->map, r->size, MADV_SEQUENTIAL);
+#endif
+	}
+	close(fd);
+
+	return 1;
+}
+
+static void unmap_file (sup_reader_t *r)
+{
+	if (r->map != NULL)
+		munmap((void *)r->map, r->size);
+}
+#endif
+
+sup_reader_t *open_sup_reader (const char *filename)
+{
+	sup_reader_t *r = calloc(1, sizeof(sup_reader_t));
+
+	if (!map_file(r, filename))
+	{
+		fprintf(stderr, "Couldn't open SUP file (%s): ", filename);
+		perror(NULL);
+		free(r);
+		return NULL;
+	}
+	r->pos = 0;
+
+	return r;
+}
+
+static uint16_t get_u16 (const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static uint32_t get_u32 (const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+int sup_reader_next (sup_reader_t *r, sup_segment_t *seg)
+{
+	const uint8_t *p;
+
+	if (r->pos >= r->size)
+		return 0;
+	if (r->size - r->pos < SUP_HEADER_SIZE)
+	{
+		snprintf(r->error, sizeof(r->error), "Truncated PG header.");
+		return -1;
+	}
+
+	p = r->map + r->pos;
+	if (p[0] != 'P' || p[1] != 'G')
+	{
+		snprintf(r->error, sizeof(r->error), "Invalid PG header.");
+		return -1;
+	}
+
+	seg->offset = r->pos;
+	seg->pts = get_u32(p + 2);
+	seg->dts = get_u32(p + 6);
+	seg->type = p[10];
+	seg->len = get_u16(p + 11);
+	seg->data = p + SUP_HEADER_SIZE;
+
+	if (r->size - r->pos - SUP_HEADER_SIZE < (uint64_t)seg->len)
+	{
+		snprintf(r->error, sizeof(r->error), "Could not read all %uB of segment payload.", seg->len);
+		return -1;
+	}
+	r->pos += SUP_HEADER_SIZE + seg->len;
+
+	return 1;
+}
+
+void sup_reader_seek (sup_reader_t *r, uint64_t offset)
+{
+	r->pos = offset;
+}
+
+int sup_reader_walk (sup_reader_t *r, int (*cb)(sup_segment_t *seg, void *arg), void *arg)
+{
+	sup_segment_t seg;
+	int ret;
+
+	while ((ret = sup_reader_next(r, &seg)) == 1)
+		if ((ret = cb(&seg, arg)) != 0)
+			return ret;
+
+	return ret;
+}
+
+void close_sup_reader (sup_reader_t *r)
+{
+	unmap_file(r);
+	free(r);
+}
+
+uint8_t seg_u8 (const sup_segment_t *s, int off)
+{
+	return off + 1 <= s->len ? s->data[off] : 0;
+}
+
+uint16_t seg_u16 (const sup_segment_t *s, int off)
+{
+	return off + 2 <= s->len ? get_u16(s->data + off) : 0;
+}
+
+uint32_t seg_u32 (const sup_segment_t *s, int off)
+{
+	return off + 4 <= s->len ? get_u32(s->data + off) : 0;
+}
@@ -0,0 +1,78 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef SUP_READER_H
+#define SUP_READER_H
+
+#include <stdint.h>
+
+/* Segment types */
+#define SUP_PDS 0x14
+#define SUP_ODS 0x15
+#define SUP_PCS 0x16
+#define SUP_WDS 0x17
+#define SUP_END 0x80
+
+#define SUP_HEADER_SIZE 13
+
+/* A segment, pointing into the mapped file */
+typedef struct sup_segment_s
+{
+	uint64_t offset;     /* Offset of the segment header */
+	uint32_t pts;
+	uint32_t dts;
+	int type;
+	int len;
+	const uint8_t *data; /* Payload of len bytes */
+} sup_segment_t;
+
+typedef struct sup_reader_s
+{
+	const uint8_t *map;
+	uint64_t size;
+	uint64_t pos;
+	char error[128];
+	void *handle;        /* Platform specific mapping state */
+} sup_reader_t;
+
+/* Map a SUP file. Returns NULL and prints the reason on failure. */
+sup_reader_t *open_sup_reader (const char *filename);
+
+/* Get the next segment. Returns 1 on success, 0 at the end of the file and
+ * -1 on a broken segment, with r->error describing the problem.
+ */
+int sup_reader_next (sup_reader_t *r, sup_segment_t *seg);
+
+/* Continue reading at offset, e.g. taken from a seek index */
+void sup_reader_seek (sup_reader_t *r, uint64_t offset);
+
+/* Call cb for every remaining segment, until it returns non-zero. Returns
+ * the last value returned by cb, 0 at the end of the file or -1 on error.
+ */
+int sup_reader_walk (sup_reader_t *r, int (*cb)(sup_segment_t *seg, void *arg), void *arg);
+
+void close_sup_reader (sup_reader_t *r);
+
+/* Big-endian accessors for segment payloads. Reading past the end of the
+ * payload yields 0.
+ */
+uint8_t seg_u8 (const sup_segment_t *s, int off);
+uint16_t seg_u16 (const sup_segment_t *s, int off);
+uint32_t seg_u32 (const sup_segment_t *s, int off);
+
+#endif
@@ -0,0 +1,374 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include "common.h"
+#include "xml_writer.h"
+
+/* Events are streamed to the file as they finish. The header, which needs
+ * the event count and first/last timecodes, is written over a reserved area
+ * at the start of the file in the end. Since the event count may be shorter
+ * than reserved, the header line ending in Type="Graphic"/> is padded with
+ * trailing spaces. Sinks that cannot seek get the whole file at the end.
+ */
+
+/* Longest possible event, see write_event */
+#define XML_EVENT_MAX 512
+
+static void xml_flush (xml_writer_t *xw)
+{
+	if (xw->len && !xw->error && sink_write(xw->sink, xw->buf, xw->len))
+	{
+		perror("Error writing XML file");
+		xw->error = 1;
+	}
+	xw->len = 0;
+}
+
+/* Make room for another event */
+static void xml_reserve (xml_writer_t *xw)
+{
+	if (xw->len + XML_EVENT_MAX <= xw->size)
+		return;
+	if (xw->seekable)
+		xml_flush(xw);
+	else
+	{
+		xw->size *= 2;
+		xw->buf = realloc(xw->buf, xw->size);
+	}
+}
+
+static char *put_str (char *p, const char *s)
+{
+	while (*s)
+		*(p++) = *(s++);
+	return p;
+}
+
+static char *put_int (char *p, int v)
+{
+	char t[12];
+	int n = 0;
+
+	if (v < 0)
+	{
+		*(p++) = '-';
+		v = -v;
+	}
+	do
+	{
+		t[n++] = '0' + v % 10;
+		v /= 10;
+	}
+	while (v);
+	while (n)
+		*(p++) = t[--n];
+
+	return p;
+}
+
+/* Zero padded to at least digits characters */
+static char *put_int_pad (char *p, int v, int digits)
+{
+	int n = 1, t = v;
+
+	while (t >= 10)
+	{
+		t /= 10;
+		n++;
+	}
+	for (; n < digits; n++)
+		*(p++) = '0';
+	return put_int(p, v);
+}
+
+#define PUT_2DIGITS(p, v) { *(p++) = '0' + (v) / 10; *(p++) = '0' + (v) % 10; }
+
+/* Same as mk_timecode, without the trailing \0. Sets the error flag and
+ * writes nothing if out of range.
+ */
+static char *put_tc (xml_writer_t *xw, char *p, int frame)
+{
+	int fps = xw->fps;
+	int frames, s, m, h;
+	int tc = frame;
+
+	frames = tc % fps;
+	tc /= fps;
+	s = tc % 60;
+	tc /= 60;
+	m = tc % 60;
+	tc /= 60;
+	h = tc;
+
+	if (h > 99)
+	{
+		fprintf(stderr, "Timecodes above 99:59:59:99 not supported: %u:%02u:%02u:%02u\n", h, m, s, frames);
+		xw->error = 1;
+		return p;
+	}
+	if (frame < 0 || fps > 100)
+	{
+		/* Leave odd cases to the printf based code */
+		char buf[12];
+		if (mk_timecode(frame, fps, buf))
+		{
+			xw->error = 1;
+			return p;
+		}
+		return put_str(p, buf);
+	}
+
+	PUT_2DIGITS(p, h)
+	*(p++) = ':';
+	PUT_2DIGITS(p, m)
+	*(p++) = ':';
+	PUT_2DIGITS(p, s)
+	*(p++) = ':';
+	PUT_2DIGITS(p, frames)
+
+	return p;
+}
+
+static void write_event (xml_writer_t *xw, event_t *e, int auto_cut)
+{
+	char *p;
+	int end = e->end_frame;
+	int i;
+
+	if (xw->error)
+		return;
+	if (auto_cut && end == xw->frames - 1)
+		end++;
+
+	xml_reserve(xw);
+	p = xw->buf + xw->len;
+
+	p = put_str(p, e->forced ? "<Event Forced=\"True\" InTC=\"" : "<Event Forced=\"False\" InTC=\"");
+	p = put_tc(xw, p, e->start_frame);
+	p = put_str(p, "\" OutTC=\"");
+	p = put_tc(xw, p, end);
+	p = put_str(p, "\">\n");
+	for (i = 0; i < e->graphics; i++)
+	{
+		p = put_str(p, "<Graphic Width=\"");
+		p = put_int(p, e->c[i].w);
+		p = put_str(p, "\" Height=\"");
+		p = put_int(p, e->c[i].h);
+		p = put_str(p, "\" X=\"");
+		p = put_int(p, xw->xo + e->c[i].x);
+		p = put_str(p, "\" Y=\"");
+		p = put_int(p, xw->yo + e->c[i].y);
+		p = put_str(p, "\">");
+		p = put_int_pad(p, e->png[i].file_id, 8);
+		*(p++) = '_';
+		p = put_int(p, e->png[i].graphic);
+		p = put_str(p, ".png</Graphic>\n");
+	}
+	p = put_str(p, "</Event>\n");
+
+	xw->len = p - xw->buf;
+}
+
+#define XML_HEADER "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" \
+	"<BDN Version=\"0.93\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\"\n" \
+	"xsi:noNamespaceSchemaLocation=\"BD-03-006-0093b BDN File Format.xsd\">\n" \
+	"<Description>\n" \
+	"<Name Title=\"%s\" Content=\"\"/>\n" \
+	"<Language Code=\"%s\"/>\n" \
+	"<Format VideoFormat=\"%s\" FrameRate=\"%s\" DropFrame=\"%s\"/>\n" \
+	"<Events LastEventOutTC=\"%s\" FirstEventInTC=\"%s\"\n" \
+	"ContentInTC=\"%s\" ContentOutTC=\"%s\" NumberofEvents=\"%d\" Type=\"Graphic\"/>%*s\n" \
+	"</Description>\n" \
+	"<Events>\n"
+
+/* Returns the length of the header, and writes it if sink is not NULL.
+ * Returns -1 if writing failed, or sets the error flag and returns -1 if a
+ * timecode is out of range.
+ */
+static int write_header (xml_writer_t *xw, sink_t *sink, int first_tc, int last_tc, int num_of_events, int pad)
+{
+	char intc_buf[12], outtc_buf[12], content_in[12], content_out[12];
+	char *header;
+	int len;
+
+	if (mk_timecode(first_tc, xw->fps, intc_buf) || mk_timecode(last_tc, xw->fps, outtc_buf) || mk_timecode(0, xw->fps, content_in) || mk_timecode(xw->content_out, xw->fps, content_out))
+	{
+		xw->error = 1;
+		return -1;
+	}
+
+	len = snprintf(NULL, 0, XML_HEADER, xw->track_name, xw->language, xw->video_format, xw->frame_rate, xw->drop_frame, outtc_buf, intc_buf, content_in, content_out, num_of_events, pad, "");
+	if (sink == NULL)
+		return len;
+
+	header = malloc(len + 1);
+	snprintf(header, len + 1, XML_HEADER, xw->track_name, xw->language, xw->video_format, xw->frame_rate, xw->drop_frame, outtc_buf, intc_buf, content_in, content_out, num_of_events, pad, "");
+	if (sink_write(sink, header, len))
+		len = -1;
+	free(header);
+
+	return len;
+}
+
+xml_writer_t *new_xml_writer (const char *filename, int fps, int frames, int to, int xo, int yo, const char *track_name, const char *language, const char *video_format, const char *frame_rate, const char *drop_frame)
+{
+	FILE *fh;
+	sink_t *sink;
+
+	if ((fh = fopen(filename, "w")) == NULL || (sink = new_file_sink(fh, filename)) == NULL)
+		return NULL;
+
+	return new_xml_writer_sink(sink, fps, frames, to, xo, yo, track_name, language, video_format, frame_rate, drop_frame);
+}
+
+static xml_writer_t *init_xml_writer (sink_t *sink, int fps, int frames, int to, int xo, int yo, const char *track_name, const char *language, const char *video_format, const char *frame_rate, const char *drop_frame)
+{
+	xml_writer_t *xw = calloc(1, sizeof(xml_writer_t));
+
+	xw->sink = sink;
+	xw->seekable = sink->seek != NULL;
+	xw->size = XML_BUFFER_SIZE;
+	xw->buf = malloc(xw->size);
+	xw->fps = fps;
+	xw->frames = frames;
+	xw->xo = xo;
+	xw->yo = yo;
+	xw->track_name = track_name;
+	xw->language = language;
+	xw->video_format = video_format;
+	xw->frame_rate = frame_rate;
+	xw->drop_frame = drop_frame;
+	xw->content_out = frames + to;
+
+	return xw;
+}
+
+xml_writer_t *new_xml_writer_sink (sink_t *sink, int fps, int frames, int to, int xo, int yo, const char *track_name, const char *language, const char *video_format, const char *frame_rate, const char *drop_frame)
+{
+	xml_writer_t *xw = init_xml_writer(sink, fps, frames, to, xo, yo, track_name, language, video_format, frame_rate, drop_frame);
+
+	/* Reserve room for the longest possible event count */
+	if (xw->seekable && (xw->header = write_header(xw, sink, 0, 0, INT_MAX, 0)) < 0 && !xw->error)
+	{
+		perror("Error writing XML file");
+		xw->error = 1;
+	}
+
+	return xw;
+}
+
+xml_writer_t *reopen_xml_writer (const char *filename, uint64_t offset, int fps, int frames, int to, int xo, int yo, const char *track_name, const char *language, const char *video_format, const char *frame_rate, const char *drop_frame)
+{
+	xml_writer_t *xw;
+	FILE *fh;
+	sink_t *sink;
+
+	if ((fh = fopen(filename, "r+")) == NULL || (sink = new_file_sink_at(fh, filename, offset)) == NULL)
+		return NULL;
+
+	/* The reserved header is already there */
+	xw = init_xml_writer(sink, fps, frames, to, xo, yo, track_name, language, video_format, frame_rate, drop_frame);
+	xw->header = write_header(xw, NULL, 0, 0, INT_MAX, 0);
+
+	return xw;
+}
+
+int64_t xml_writer_checkpoint (xml_writer_t *xw, event_vec_t *events)
+{
+	write_xml_events(xw, events);
+	if (!event_vec_empty(events) || !xw->seekable)
+		return -1;
+	xml_flush(xw);
+	if (xw->error)
+		return -1;
+
+	return sink_sync(xw->sink);
+}
+
+void write_xml_events (xml_writer_t *xw, event_vec_t *events)
+{
+	event_t *e;
+
+	while ((e = event_vec_first(events)) != NULL)
+	{
+		/* Whether auto_cut applies is only known at the end */
+		if (e->end_frame == xw->frames - 1)
+			return;
+		write_event(xw, e, 0);
+		event_vec_shift(events, NULL);
+	}
+}
+
+int close_xml_writer (xml_writer_t *xw, event_vec_t *events, int first_tc, int last_tc, int num_of_events, int auto_cut)
+{
+	event_t *e;
+	int len, r = 0;
+
+	/* Write remaining XML events */
+	while ((e = event_vec_first(events)) != NULL)
+	{
+		write_event(xw, e, auto_cut);
+		event_vec_shift(events, NULL);
+	}
+
+	/* Write XML footer */
+	xml_reserve(xw);
+	memcpy(xw->buf + xw->len, "</Events>\n</BDN>\n", 17);
+	xw->len += 17;
+
+	/* Write XML header into the reserved area, or in front of the events */
+	if (xw->seekable)
+	{
+		xml_flush(xw);
+		len = write_header(xw, NULL, first_tc, last_tc, num_of_events, 0);
+		if (!xw->error && (sink_seek(xw->sink, 0) || write_header(xw, xw->sink, first_tc, last_tc, num_of_events, xw->header - len) < 0))
+		{
+			perror("Error writing XML file");
+			xw->error = 1;
+		}
+	}
+	else if (!xw->error && write_header(xw, xw->sink, first_tc, last_tc, num_of_events, 0) < 0)
+	{
+		if (!xw->error)
+			perror("Error writing XML file");
+		xw->error = 1;
+	}
+	else
+		xml_flush(xw);
+
+	/* Close XML file */
+	if (close_sink(xw->sink) && !xw->error)
+	{
+		perror("Error writing XML file");
+		xw->error = 1;
+	}
+	if (xw->error)
+		r = -1;
+	free(xw->buf);
+	free(xw);
+
+	return r;
+}
+
+void discard_xml_writer (xml_writer_t *xw)
+{
+	discard_sink(xw->sink);
+	free(xw->buf);
+	free(xw);
+}
@@ -0,0 +1,81 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef XML_WRITER_H
+#define XML_WRITER_H
+
+#include <stdio.h>
+#include "sink.h"
+
+#define XML_BUFFER_SIZE (1024 * 1024)
+
+struct event_vec_s;
+
+typedef struct xml_writer_s
+{
+	sink_t *sink;
+	int seekable; /* Otherwise the file is kept in buf until closing */
+	char *buf;
+	int len;
+	int size;
+	int error;    /* Set once writing failed, nothing is written after */
+	int fps;
+	int frames;   /* Total number of input frames */
+	int xo, yo;
+	int header;   /* Bytes reserved for the header */
+	const char *track_name;
+	const char *language;
+	const char *video_format;
+	const char *frame_rate;
+	const char *drop_frame;
+	int content_out;
+} xml_writer_t;
+
+/* Create the XML file and reserve room for the header. Returns NULL if the
+ * file cannot be created.
+ */
+xml_writer_t *new_xml_writer (const char *filename, int fps, int frames, int to, int xo, int yo, const char *track_name, const char *language, const char *video_format, const char *frame_rate, const char *drop_frame);
+
+/* Same for output to a sink, which is closed with the writer */
+xml_writer_t *new_xml_writer_sink (sink_t *sink, int fps, int frames, int to, int xo, int yo, const char *track_name, const char *language, const char *video_format, const char *frame_rate, const char *drop_frame);
+
+/* Continue an XML file written up to offset, cutting off anything after it.
+ * Returns NULL if the file cannot be opened.
+ */
+xml_writer_t *reopen_xml_writer (const char *filename, uint64_t offset, int fps, int frames, int to, int xo, int yo, const char *track_name, const char *language, const char *video_format, const char *frame_rate, const char *drop_frame);
+
+/* Write all events and return the size of the file, for reopen_xml_writer.
+ * Returns -1 if the file could not be written, or an event is kept back.
+ */
+int64_t xml_writer_checkpoint (xml_writer_t *xw, struct event_vec_s *events);
+
+/* Write finished events and remove them from the vector. Events that might
+ * still need their OutTC extended by close_xml_writer are kept back.
+ */
+void write_xml_events (xml_writer_t *xw, struct event_vec_s *events);
+
+/* Write remaining events, the footer and the header, then close the file.
+ * With auto_cut set, events ending on the last input frame end one later.
+ * Returns -1 if the file could not be written completely.
+ */
+int close_xml_writer (xml_writer_t *xw, struct event_vec_s *events, int first_tc, int last_tc, int num_of_events, int auto_cut);
+
+/* Close and discard the XML output without finishing it */
+void discard_xml_writer (xml_writer_t *xw);
+
+#endif